@@ -0,0 +1,93 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+class GraphicsDevice;
+
+struct GraphicsDescriptorPoolChain;
+
+/* A persistent set and the pool it must be freed back to */
+struct GraphicsDescriptorSet
+{
+	vk::DescriptorSet set;
+	vk::DescriptorPool pool;
+	GraphicsDescriptorPoolChain *chain;
+
+	explicit operator vk::DescriptorSet() const { return set; }
+};
+
+/*
+ * Descriptor sets for the whole device, allocated from chains of pools that
+ * grow as they fill. New pools are sized by the mix of descriptor types
+ * allocated so far, so a scene of materials fits in a handful of pools.
+ *
+ * Persistent sets come from a chain owned by the allocating thread and may
+ * be freed from any thread. Transient sets, written fresh every frame like
+ * the lighting pass's, come from a chain per frame slot and are all
+ * released at once when that slot is reset.
+ */
+class GraphicsDescriptorAllocator
+{
+public:
+	explicit GraphicsDescriptorAllocator(GraphicsDevice *device);
+	GraphicsDescriptorAllocator(const GraphicsDescriptorAllocator &) = delete;
+	~GraphicsDescriptorAllocator();
+
+	/* The layout must come from the device's layout cache */
+	GraphicsDescriptorSet allocate(vk::DescriptorSetLayout layout);
+	void free(const GraphicsDescriptorSet& set);
+
+	/* Valid until reset_frame is called for the same slot */
+	vk::DescriptorSet allocate_transient(vk::DescriptorSetLayout layout, uint32_t frame);
+
+	/* The slot's previous frame must have finished on the GPU */
+	void reset_frame(uint32_t frame);
+
+private:
+	GraphicsDevice *device;
+
+	std::mutex chains_mutex;
+	std::unordered_map<std::thread::id, std::unique_ptr<GraphicsDescriptorPoolChain>> thread_chains;
+	std::deque<std::unique_ptr<GraphicsDescriptorPoolChain>> frame_chains;
+
+	/* Descriptors of each type allocated per set so far, to size new pools */
+	std::mutex usage_mutex;
+	std::unordered_map<uint32_t, uint64_t> descriptor_usage;
+	uint64_t set_usage;
+
+	GraphicsDescriptorPoolChain& get_thread_chain();
+	GraphicsDescriptorPoolChain& get_frame_chain(uint32_t frame);
+
+	vk::DescriptorSet allocate_from_chain(GraphicsDescriptorPoolChain& chain, vk::DescriptorSetLayout layout, vk::DescriptorPool *pool);
+	vk::DescriptorPool create_pool(const std::vector<vk::DescriptorSetLayoutBinding>& bindings, uint32_t set_count, bool freeable);
+	void record_usage(const std::vector<vk::DescriptorSetLayoutBinding>& bindings);
+};
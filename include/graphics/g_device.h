@@ -24,7 +24,11 @@
 #include <memory>
 #include <vulkan/vulkan.hpp>
 
+#include "g_descriptor_allocator.h"
+#include "g_layout_cache.h"
 #include "g_queue.h"
+#include "g_retire_queue.h"
+#include "g_shader_cache.h"
 #include "g_transfer_context.h"
 #include "g_window.h"
 
@@ -53,7 +57,20 @@ public:
 
 	vk::Semaphore create_semaphore() const;
 
+    /* True if optimal tiled images of this format can be blitted with linear filtering */
+    bool supports_linear_blit(vk::Format format) const;
+
+    /* True if optimal tiled images of this format can be sampled */
+    bool supports_sampled_format(vk::Format format) const;
+
+    /* Textures one bindless array may hold, zero if bindless textures are unavailable */
+    uint32_t get_bindless_texture_limit() const { return bindless_texture_limit; }
+
     std::unique_ptr<GraphicsTransferContext> transfer_context;
+    std::unique_ptr<GraphicsShaderCache> shader_cache;
+    std::unique_ptr<GraphicsLayoutCache> layout_cache;
+    std::unique_ptr<GraphicsDescriptorAllocator> descriptor_allocator;
+    std::unique_ptr<GraphicsRetireQueue> retire_queue;
 
     std::shared_ptr<GraphicsQueue> graphics_queue;
     std::shared_ptr<GraphicsQueue> present_queue;
@@ -61,6 +78,9 @@ public:
 
 private:
 	vk::DebugUtilsMessengerEXT debug_report_callback;
+	uint32_t bindless_texture_limit;
+
+	static uint32_t query_bindless_texture_limit(vk::PhysicalDevice physical_device);
 
 	static bool is_device_suitable(::vk::PhysicalDevice physical_device, vk::SurfaceKHR surface, QueueFamilyIndicies & queue_data);
 	vk::PhysicalDevice select_physical_device(vk::SurfaceKHR surface, QueueFamilyIndicies & queue_data) const;
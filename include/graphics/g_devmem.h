@@ -22,30 +22,36 @@
 
 #pragma once
 
+#include <atomic>
+
 #include <vulkan/vulkan.hpp>
 
 #include "g_device.h"
+#include "g_uniform_ring.h"
 #include "vk_mem_alloc.h"
 
-typedef enum VmaAllocationCreateFlagBitsExtended
-{
-    VMA_ALLOCATION_CREATE_EXT_DONT_CREATE_STAGING_BUFFER = 1 << 16,
-} VmaAllocationCreateFlagBitsExtended;
-
 class GraphicsDevmemBuffer
 {
 public:
 	GraphicsDevmemBuffer(
         std::shared_ptr<GraphicsDevice> device, VmaAllocator allocator,
         VkBuffer buffer, VmaAllocation allocation, VmaAllocationInfo alloc_info,
-        VkBuffer staging_buffer, VmaAllocation staging_allocation, VmaAllocationInfo staging_alloc_info
+        std::atomic<VkDeviceSize> *direct_write_usage = nullptr
     );
 	~GraphicsDevmemBuffer();
 
 	bool is_visible() const;
 	void map_memory(void **data) const;
 	void unmap_memory() const;
-    void commit_memory() const;
+
+    /*
+     * Copy data in through the staging ring and wait for it to land, or
+     * write it straight in if the buffer is host visible
+     */
+    void upload(const void *data, VkDeviceSize size, VkDeviceSize offset = 0) const;
+
+    /* As upload, but record the staged copy into a batch the caller submits */
+    void record_upload(GraphicsTransferBatch& batch, const void *data, VkDeviceSize size, VkDeviceSize offset = 0) const;
 
 	vk::BufferView create_buffer_view(vk::BufferViewCreateInfo& create_info) const;
 
@@ -58,9 +64,8 @@ private:
 	VmaAllocation allocation;
 	VmaAllocationInfo alloc_info;
 
-    vk::Buffer staging_buffer;
-    VmaAllocation staging_allocation;
-    VmaAllocationInfo staging_alloc_info;
+	/* Set if this buffer counts against the direct write budget */
+	std::atomic<VkDeviceSize> *direct_write_usage;
 };
 
 class GraphicsDevmemImage
@@ -73,7 +78,9 @@ public:
         VmaAllocation allocation,
         VmaAllocationInfo alloc_info,
         vk::ImageLayout layout,
-        vk::Format format
+        vk::Format format,
+        vk::Extent3D extent,
+        uint32_t mip_levels
     );
 	~GraphicsDevmemImage();
 
@@ -84,10 +91,21 @@ public:
 	vk::ImageView create_image_view(vk::ImageViewCreateInfo& create_info) const;
 
     vk::Format get_format() const { return format; };
+    vk::Extent3D get_extent() const { return extent; }
+    uint32_t get_mip_levels() const { return mip_levels; }
 
     vk::ImageLayout get_layout() const;
     void transition_layout(vk::ImageLayout dest);
 
+    /* Record the transition into a batch the caller submits */
+    void record_transition_layout(const GraphicsTransferBatch& batch, vk::ImageLayout dest);
+
+    /*
+     * Record blits filling every mip level from level 0, the image must be
+     * in TransferDstOptimal and is left in ShaderReadOnlyOptimal
+     */
+    void record_generate_mipmaps(const GraphicsTransferBatch& batch);
+
     vk::Image image;
 
 private:
@@ -99,6 +117,8 @@ private:
 
     vk::ImageLayout layout;
     vk::Format format;
+    vk::Extent3D extent;
+    uint32_t mip_levels;
 };
 
 class GraphicsDevmem
@@ -110,7 +130,20 @@ public:
 	std::unique_ptr<GraphicsDevmemBuffer> create_buffer(vk::BufferCreateInfo buffer_create_info, VmaAllocationCreateInfo alloc_create_info) const;
 	std::unique_ptr<GraphicsDevmemImage> create_image(vk::ImageCreateInfo create_info, VmaAllocationCreateInfo alloc_create_info) const;
 
+	const std::shared_ptr<GraphicsDevice>& get_device() const { return device; }
+	GraphicsUniformRing *get_uniform_ring() const { return uniform_ring.get(); }
+
 private:
 	std::shared_ptr<GraphicsDevice> device;
 	VmaAllocator allocator;
+
+	/*
+	 * Gpu only buffers are placed in device local memory the host can map
+	 * when the device has any, so uploads skip the staging copy. The heap is
+	 * often a small BAR window, so only part of it is used this way.
+	 */
+	VkDeviceSize direct_write_budget;
+	mutable std::atomic<VkDeviceSize> direct_write_usage;
+
+	std::unique_ptr<GraphicsUniformRing> uniform_ring;
 };
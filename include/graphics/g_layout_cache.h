@@ -0,0 +1,72 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+class GraphicsDevice;
+
+/*
+ * Descriptor set and pipeline layouts shared across the device, keyed by
+ * their contents. Layouts live as long as the device, so pipelines and
+ * descriptor sets never own the layouts they were made with.
+ */
+class GraphicsLayoutCache
+{
+public:
+	explicit GraphicsLayoutCache(GraphicsDevice *device);
+	GraphicsLayoutCache(const GraphicsLayoutCache &) = delete;
+	~GraphicsLayoutCache();
+
+	vk::DescriptorSetLayout get_descriptor_set_layout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings);
+	std::vector<vk::DescriptorSetLayoutBinding> get_descriptor_set_bindings(vk::DescriptorSetLayout layout);
+	vk::PipelineLayout get_pipeline_layout(vk::DescriptorSetLayout set_layout, const std::vector<vk::PushConstantRange>& push_constant_ranges);
+
+private:
+	struct SetLayout
+	{
+		std::vector<vk::DescriptorSetLayoutBinding> bindings;
+		vk::DescriptorSetLayout layout;
+	};
+
+	struct PipelineLayout
+	{
+		vk::DescriptorSetLayout set_layout;
+		std::vector<vk::PushConstantRange> push_constant_ranges;
+		vk::PipelineLayout layout;
+	};
+
+	GraphicsDevice *device;
+
+	std::mutex mutex;
+	std::unordered_multimap<size_t, SetLayout> set_layouts;
+	std::unordered_map<VkDescriptorSetLayout, const SetLayout *> set_layouts_by_handle;
+	std::unordered_multimap<size_t, PipelineLayout> pipeline_layouts;
+
+	uint32_t created_count;
+	uint32_t reused_count;
+};
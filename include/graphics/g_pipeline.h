@@ -21,6 +21,9 @@
 ******************************************************************************/
 #pragma once
 
+#include <future>
+#include <memory>
+
 #include <vulkan/vulkan.hpp>
 
 #include "g_device.h"
@@ -53,19 +56,43 @@ VULKAN_HPP_INLINE GraphicsDynamicStateFlags operator~(GraphicsDynamicStateBits b
 class GraphicsPipeline
 {
 public:
-	GraphicsPipeline(std::shared_ptr<GraphicsDevice>& device, vk::PipelineCache cache, vk::GraphicsPipelineCreateInfo create_info, vk::PipelineLayout pipeline_layout, vk::DescriptorSet descriptor_set, vk::DescriptorSetLayout descriptor_set_layout);
+	GraphicsPipeline(std::shared_ptr<GraphicsDevice>& device, vk::Pipeline pipeline, vk::PipelineLayout pipeline_layout, vk::DescriptorSet descriptor_set, vk::DescriptorSetLayout descriptor_set_layout);
+
+	/*
+	 * A pipeline still being compiled elsewhere, drawn with the fallback
+	 * until it is ready. The fallback must be ready and have a compatible
+	 * layout, vertex input and render pass.
+	 */
+	GraphicsPipeline(std::shared_ptr<GraphicsDevice>& device, std::shared_future<vk::Pipeline> pending, std::shared_ptr<GraphicsPipeline> fallback, vk::PipelineLayout pipeline_layout, vk::DescriptorSet descriptor_set, vk::DescriptorSetLayout descriptor_set_layout);
 	~GraphicsPipeline();
 
-	void bind_pipeline(vk::CommandBuffer cmd) const;
+	static vk::Pipeline compile(vk::Device device, vk::PipelineCache cache, const vk::GraphicsPipelineCreateInfo& create_info);
+
+	/* True once compilation has finished, a failed compile keeps drawing with the fallback */
+	bool is_ready() const;
+	void wait() const;
+
+	/*
+	 * Binds the pipeline's own descriptor set as well, if it was given one.
+	 * Dynamic offsets are in binding order, one per dynamic descriptor.
+	 */
+	void bind_pipeline(vk::CommandBuffer cmd, const std::vector<uint32_t>& dynamic_offsets = {}) const;
+	void bind_descriptor_set(vk::CommandBuffer cmd, vk::DescriptorSet set, const std::vector<uint32_t>& dynamic_offsets = {}) const;
 	void push_shader_data(vk::CommandBuffer cmd, int offset, vk::ShaderStageFlagBits stage, size_t size, void* data) const;
 
-	void update_descriptor_sets(std::vector<vk::WriteDescriptorSet> writes) const;
+	/* Writes go to the pipeline's own descriptor set unless another is given */
+	void update_descriptor_sets(std::vector<vk::WriteDescriptorSet> writes, vk::DescriptorSet set = vk::DescriptorSet()) const;
+
+	vk::DescriptorSetLayout get_descriptor_set_layout() const { return descriptor_set_layout; }
 
 	static std::vector<vk::DynamicState> GraphicsPipeline::get_dynamic_states(GraphicsDynamicStateFlags mask);
 private:
-	std::shared_ptr<GraphicsDevice>& device;
+	std::shared_ptr<GraphicsDevice> device;
+
+	mutable vk::Pipeline pipeline;
+	mutable std::shared_future<vk::Pipeline> pending;
+	std::shared_ptr<GraphicsPipeline> fallback;
 
-	vk::Pipeline pipeline;
 	vk::PipelineLayout pipeline_layout;
 	vk::DescriptorSet descriptor_set;
 	vk::DescriptorSetLayout descriptor_set_layout;
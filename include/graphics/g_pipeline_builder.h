@@ -27,22 +27,47 @@
 
 #include "g_pipeline.h"
 #include "g_shader.h"
+#include "g_shaderif.h"
 
 struct GraphicsPipelineCreateInfo
 {
 	GraphicsPipelineCreateInfo(std::shared_ptr<GraphicsDevice>& device, std::string vertex_shader, std::string fragment_shader)
 		: vertex_shader(device, vertex_shader),
 		  fragment_shader(device, fragment_shader),
+          vertex_format(VertexFormat::Standard),
           primitive_topology(vk::PrimitiveTopology::eTriangleList),
           dynamic_states(GraphicsDynamicStateFlags(0)),
           viewports({vk::Viewport()}),
-          scissors({vk::Rect2D()})
+          scissors({vk::Rect2D()}),
+          depth_enable(false),
+          subpass(0)
 	{
+        ShaderReflection reflection = this->vertex_shader.get_reflection();
+        reflection.merge(this->fragment_shader.get_reflection());
+
+        set_bindings = reflection.set_bindings;
+        push_constant_ranges = reflection.push_constant_ranges;
 	}
 
+    /*
+     * Structural hash and equality over everything that ends up in the
+     * pipeline. Shaders compare by source name, layouts by their bindings
+     * when the builder creates them and by handle otherwise.
+     */
+    std::size_t hash() const;
+    bool operator==(const GraphicsPipelineCreateInfo& other) const;
+
+    /*
+     * True if a pipeline built from other can be drawn in place of this one,
+     * it consumes the same vertices, descriptors and push constants and
+     * writes the same attachments
+     */
+    bool is_interface_compatible(const GraphicsPipelineCreateInfo& other) const;
+
 	GraphicsShader vertex_shader;
 	GraphicsShader fragment_shader;
 
+	VertexFormat vertex_format;
 	vk::PrimitiveTopology primitive_topology;
 	GraphicsDynamicStateFlags dynamic_states;
 
@@ -53,6 +78,15 @@ struct GraphicsPipelineCreateInfo
     vk::DescriptorSetLayout descriptor_set_layout;
     vk::PipelineLayout pipeline_layout;
 
+    /*
+     * Reflected from the shaders and used to fetch the layouts from the
+     * device's layout cache when none are given, so identical pipelines from
+     * different callers share them. Callers then allocate their own
+     * descriptor sets against the pipeline's set layout.
+     */
+    std::vector<vk::DescriptorSetLayoutBinding> set_bindings;
+    std::vector<vk::PushConstantRange> push_constant_ranges;
+
     bool depth_enable;
 
     vk::RenderPass renderpass;
@@ -69,11 +103,7 @@ namespace std
 
 		result_type operator()(argument_type const& info) const noexcept
 		{
-			// TODO
-			result_type const h1((VkFlags) info.dynamic_states);
-			result_type const h2((VkFlags) info.primitive_topology);
-            result_type const h3(info.subpass);
-			return h1 ^ (h2 << 1) ^ (h3 << 2);
+			return info.hash();
 		}
 	};
 }
@@ -81,12 +111,19 @@ namespace std
 class GraphicsPipelineBuilder
 {
 public:
-	GraphicsPipelineBuilder(std::shared_ptr<GraphicsDevice>& device, vk::DescriptorPool descriptor_poo);
+	GraphicsPipelineBuilder(std::shared_ptr<GraphicsDevice>& device);
 	~GraphicsPipelineBuilder();
-    std::unique_ptr<GraphicsPipeline> create_pipeline(vk::PipelineCache cache, std::unique_ptr<GraphicsPipelineCreateInfo> create_info, vk::RenderPass renderpass);
+    std::unique_ptr<GraphicsPipeline> create_pipeline(vk::PipelineCache cache, const GraphicsPipelineCreateInfo& create_info, vk::RenderPass renderpass);
+
+    /* Look up the layouts the create info describes, or pass through the ones it was given */
+    void create_layouts(const GraphicsPipelineCreateInfo& create_info, vk::DescriptorSetLayout *descriptor_set_layout, vk::PipelineLayout *pipeline_layout) const;
+
+    /*
+     * Compile the pipeline object alone. Touches nothing but the device and
+     * the pipeline cache, which are both safe to use from any thread.
+     */
+    static vk::Pipeline compile_pipeline(vk::Device device, vk::PipelineCache cache, const GraphicsPipelineCreateInfo& create_info, vk::PipelineLayout pipeline_layout);
 
 private:
 	std::shared_ptr<GraphicsDevice> device;
-
-    vk::DescriptorPool descriptor_pool;
 };
@@ -22,25 +22,87 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 #include <vulkan/vulkan.hpp>
 
 #include "g_device.h"
 #include "g_pipeline.h"
 #include "g_pipeline_builder.h"
+#include "u_thread_pool.h"
+
+#define PIPELINE_CACHE_FILE "pipeline_cache.bin"
+
+/* Compile time of the last run without a cache, to report what a warm cache saved */
+#define PIPELINE_CACHE_STATS_FILE "pipeline_cache.stats"
 
+/*
+ * Pipelines are compiled against a driver cache that is read from disk on
+ * creation and written back on destruction, so later launches skip most of
+ * the shader compilation. Requests for a pipeline identical to a live one
+ * return the same pipeline without compiling.
+ */
 class GraphicsPipelineCache
 {
 public:
-	GraphicsPipelineCache(std::shared_ptr<GraphicsDevice> device, vk::DescriptorPool descriptor_pool);
+	GraphicsPipelineCache(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<ThreadPool> thread_pool);
 	~GraphicsPipelineCache();
 
-    std::unique_ptr<GraphicsPipeline> create_pipeline(std::unique_ptr<GraphicsPipelineCreateInfo> create_info, vk::RenderPass renderpass);
+	/* Write the driver cache to disk, also done on destruction */
+	void save() const;
+
+    std::shared_ptr<GraphicsPipeline> create_pipeline(std::unique_ptr<GraphicsPipelineCreateInfo> create_info, vk::RenderPass renderpass);
+
+    /*
+     * Compile on the thread pool, the returned pipeline draws with a ready
+     * pipeline of a compatible interface until then. The first pipeline of
+     * each interface has nothing to fall back to and is compiled in place.
+     */
+    std::shared_ptr<GraphicsPipeline> create_pipeline_async(std::unique_ptr<GraphicsPipelineCreateInfo> create_info, vk::RenderPass renderpass);
+
+    /*
+     * Returns the number of background compiles finished since the last
+     * call, anything recorded against their fallbacks must be re-recorded
+     */
+    uint32_t process_compiled_pipelines();
 
 private:
+	struct CachedPipeline
+	{
+		std::shared_ptr<GraphicsPipelineCreateInfo> create_info;
+		std::weak_ptr<GraphicsPipeline> pipeline;
+	};
+
 	std::shared_ptr<GraphicsDevice> device;
 
 	GraphicsPipelineBuilder pipeline_builder;
 	vk::PipelineCache pipeline_cache;
 
-	std::size_t hash_pipeline_info(GraphicsPipelineCreateInfo create_info);
+	std::shared_ptr<ThreadPool> thread_pool;
+
+	std::unordered_multimap<std::size_t, CachedPipeline> pipelines;
+	std::vector<std::weak_ptr<GraphicsPipeline>> compiling_pipelines;
+
+	bool loaded_from_disk;
+	uint32_t pipeline_count;
+	uint32_t reused_count;
+	std::atomic<uint64_t> compile_microseconds;
+
+	/* Zero if no cold run has been recorded */
+	uint32_t cold_pipeline_count;
+	uint64_t cold_compile_microseconds;
+
+	std::size_t hash_pipeline_info(const GraphicsPipelineCreateInfo& create_info) const;
+	std::shared_ptr<GraphicsPipeline> find_pipeline(const GraphicsPipelineCreateInfo& create_info, std::size_t hash);
+	std::shared_ptr<GraphicsPipeline> find_fallback(const GraphicsPipelineCreateInfo& create_info) const;
+	void prune_pipelines();
+	void wait_compiling_pipelines();
+	void report_compile_time() const;
+
+	/* Cache data from a different driver or device is rejected by us, not the driver */
+	bool is_cache_compatible(const void *data, size_t size) const;
 };
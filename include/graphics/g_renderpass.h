@@ -31,7 +31,7 @@
 class GraphicsRenderpass
 {
 public:
-	explicit GraphicsRenderpass(std::shared_ptr<GraphicsDevice> &device, vk::DescriptorPool descriptor_pool);
+	GraphicsRenderpass(std::shared_ptr<GraphicsDevice> &device, std::shared_ptr<ThreadPool> thread_pool);
 	~GraphicsRenderpass();
 
 	void add_attachment(vk::AttachmentDescription attachment);
@@ -46,7 +46,11 @@ public:
 	void begin_renderpass(vk::CommandBuffer command_buffer, vk::Framebuffer framebuffer, vk::Rect2D render_area, std::vector<vk::ClearValue> clear_values, vk::SubpassContents contents = vk::SubpassContents::eInline) const;
 	void end_renderpass(vk::CommandBuffer command_buffer) const;
 
-	std::unique_ptr<GraphicsPipeline> create_pipeline(std::unique_ptr<GraphicsPipelineCreateInfo> create_info);
+	std::shared_ptr<GraphicsPipeline> create_pipeline(std::unique_ptr<GraphicsPipelineCreateInfo> create_info);
+
+	/* See GraphicsPipelineCache::create_pipeline_async */
+	std::shared_ptr<GraphicsPipeline> create_pipeline_async(std::unique_ptr<GraphicsPipelineCreateInfo> create_info);
+	uint32_t process_compiled_pipelines();
 
 	explicit operator vk::RenderPass() const { return renderpass; }
 
@@ -56,7 +60,6 @@ private:
 
 	vk::Device parent;
 	vk::RenderPass renderpass;
-	vk::DescriptorPool descriptor_pool;
 
 	std::vector<vk::AttachmentDescription> attachments;
 	std::vector<vk::SubpassDescription> subpasses;
@@ -0,0 +1,72 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class GraphicsDevice;
+
+/*
+ * Holds on to destroyed resources until every frame that may have used them
+ * has finished on the GPU. Each retired resource is stamped with the frame
+ * being recorded, and the queue is freed from the front in bulk as frame
+ * slots are waited on, so nothing is destroyed with a stall.
+ *
+ * Only frames are tracked, transfer batches reading a resource must already
+ * have been waited on. Resources may be retired from any thread.
+ */
+class GraphicsRetireQueue
+{
+public:
+	explicit GraphicsRetireQueue(GraphicsDevice *device);
+	GraphicsRetireQueue(const GraphicsRetireQueue &) = delete;
+	~GraphicsRetireQueue();
+
+	/* Called once no frame in flight now can still be using the resource */
+	void retire(std::function<void()> destroy);
+
+	/* The slot's previous frame must have finished on the GPU */
+	void begin_frame(uint32_t frame);
+
+	/* Wait for the device to go idle and destroy everything retired */
+	void flush();
+
+private:
+	struct RetiredResource
+	{
+		uint64_t serial;
+		std::function<void()> destroy;
+	};
+
+	GraphicsDevice *device;
+
+	std::mutex mutex;
+	std::deque<RetiredResource> retired;
+
+	/* Serial of the frame being recorded, and of the frame in flight in each slot */
+	uint64_t serial;
+	std::vector<uint64_t> frame_serials;
+};
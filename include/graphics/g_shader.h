@@ -25,6 +25,7 @@
 #include <vulkan/vulkan.hpp>
 
 #include "g_device.h"
+#include "g_shader_reflect.h"
 
 class GraphicsShader
 {
@@ -32,12 +33,13 @@ public:
 	GraphicsShader(std::shared_ptr<GraphicsDevice>& device, std::string shader_file);
 	~GraphicsShader();
 
-    std::string get_shader_name() { return shader_file; }
+    std::string get_shader_name() const { return shader_file; }
 	explicit operator vk::ShaderModule() const { return shader; }
 
-private:
-	std::shared_ptr<GraphicsDevice>& device;
+	const ShaderReflection& get_reflection() const { return *reflection; }
 
+private:
     std::string shader_file;
 	vk::ShaderModule shader;
+	const ShaderReflection *reflection;
 };
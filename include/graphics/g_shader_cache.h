@@ -0,0 +1,82 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "g_shader_reflect.h"
+
+class GraphicsDevice;
+
+/*
+ * Shader modules shared across the device, keyed by shader name and by a
+ * hash of the SPIR-V so differently named copies of the same code share a
+ * module too. Modules live as long as the device.
+ *
+ * The interface of each module is reflected once when it is created.
+ *
+ * With ENABLE_EMBEDDED_SHADERS the code comes from the headers generated at
+ * build time and no shader files are read, otherwise from <name>.spv.
+ * Files are read through read_files, so a batch of modules loaded together
+ * has all of its reads in flight at once.
+ */
+class GraphicsShaderCache
+{
+public:
+	explicit GraphicsShaderCache(GraphicsDevice *device);
+	GraphicsShaderCache(const GraphicsShaderCache &) = delete;
+	~GraphicsShaderCache();
+
+	struct Module
+	{
+		vk::ShaderModule module;
+		ShaderReflection reflection;
+	};
+
+	/* Entries stay valid for the lifetime of the cache */
+	const Module& get_module(const std::string& name);
+
+	/* Create every module not cached yet, reading their files in one batch */
+	void load_modules(const std::vector<std::string>& names);
+
+private:
+	GraphicsDevice *device;
+
+	std::mutex mutex;
+	std::unordered_map<std::string, const Module *> modules_by_name;
+	std::unordered_map<uint64_t, Module> modules_by_hash;
+
+	uint32_t created_count;
+	uint32_t reused_count;
+
+	const Module& create_module(const std::string& name, const void *code, size_t size);
+	void load_modules_locked(const std::vector<std::string>& names);
+};
+
+/* Look up SPIR-V compiled into the binary, false if it was not embedded */
+bool find_embedded_shader(const std::string& name, const uint8_t **code, size_t *size);
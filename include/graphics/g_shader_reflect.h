@@ -0,0 +1,44 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+/*
+ * The resource interface of a shader, read from its SPIR-V. Only
+ * descriptor set 0 is reflected, the engine binds a single set.
+ */
+struct ShaderReflection
+{
+	vk::ShaderStageFlags stages;
+	std::vector<vk::DescriptorSetLayoutBinding> set_bindings;
+	std::vector<vk::PushConstantRange> push_constant_ranges;
+
+	/* Fold in the interface of another stage, throws if the two disagree on a binding */
+	void merge(const ShaderReflection& other);
+};
+
+/* False if the code is not valid SPIR-V */
+bool reflect_shader(const uint32_t *code, size_t size, ShaderReflection *reflection);
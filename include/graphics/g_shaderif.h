@@ -71,6 +71,68 @@ struct Vertex
 	}
 };
 
+enum class VertexFormat : uint32_t
+{
+	Standard,	/* Vertex */
+	Packed,		/* PackedVertex */
+};
+
+/*
+ * Compact 16 byte vertex: fp16 position (w = 1), octahedral snorm16 normal and
+ * fp16 uv. Color is dropped as meshes only ever carry white.
+ */
+struct PackedVertex
+{
+	uint16_t position[4];
+	uint16_t normal[2];
+	uint16_t uv[2];
+
+	static std::vector<vk::VertexInputAttributeDescription> get_vertex_input_attributes()
+	{
+		return std::vector<vk::VertexInputAttributeDescription>{
+			vk::VertexInputAttributeDescription(
+				0, 0,
+				vk::Format::eR16G16B16A16Sfloat,
+				offsetof(PackedVertex, position)
+			),
+			vk::VertexInputAttributeDescription(
+				1, 0,
+				vk::Format::eR16G16Snorm,
+				offsetof(PackedVertex, normal)
+			),
+			vk::VertexInputAttributeDescription(
+				3, 0,
+				vk::Format::eR16G16Sfloat,
+				offsetof(PackedVertex, uv)
+			)
+		};
+	}
+
+	static std::vector<vk::VertexInputBindingDescription> get_vertex_input_bindings()
+	{
+		return std::vector<vk::VertexInputBindingDescription>{
+			vk::VertexInputBindingDescription(
+				0, sizeof(PackedVertex), vk::VertexInputRate::eVertex
+			)
+		};
+	}
+};
+
+inline std::vector<vk::VertexInputAttributeDescription> get_vertex_input_attributes(VertexFormat format)
+{
+	return format == VertexFormat::Packed ? PackedVertex::get_vertex_input_attributes() : Vertex::get_vertex_input_attributes();
+}
+
+inline std::vector<vk::VertexInputBindingDescription> get_vertex_input_bindings(VertexFormat format)
+{
+	return format == VertexFormat::Packed ? PackedVertex::get_vertex_input_bindings() : Vertex::get_vertex_input_bindings();
+}
+
+inline size_t get_vertex_stride(VertexFormat format)
+{
+	return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
 struct MaterialShaderData
 {
 	glm::vec4 ambient;
@@ -88,6 +150,20 @@ struct MaterialShaderData
 	}
 };
 
+/* MaterialData in model_bindless.frag, std430 */
+#define BINDLESS_NO_TEXTURE 0xffffffffu
+
+struct BindlessMaterialData
+{
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+	float alpha;
+	uint32_t ambient_texture;
+	uint32_t diffuse_texture;
+	uint32_t specular_texture;
+};
+
 struct VertexShaderData
 {
 	glm::mat4 model;
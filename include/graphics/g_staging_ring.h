@@ -0,0 +1,98 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <deque>
+
+#include <vulkan/vulkan.hpp>
+
+class GraphicsDevice;
+
+/*
+ * Identifies a transfer batch, increasing with every start_batch call and
+ * whenever a batch is flushed part way through
+ */
+typedef uint64_t GraphicsTransferTicket;
+
+#define STAGING_RING_SIZE (32 * 1024 * 1024)
+
+/*
+ * A slice of the ring, mapped for the caller to fill before its batch is
+ * submitted
+ */
+struct GraphicsStagingRegion
+{
+    vk::Buffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void *data;
+};
+
+/*
+ * One persistently mapped host buffer every upload copies through. Regions
+ * are handed out in order and reclaimed in order once the batch that reads
+ * them has completed, so staging memory stays bounded however much is
+ * uploaded.
+ */
+class GraphicsStagingRing
+{
+public:
+    GraphicsStagingRing(GraphicsDevice *device, VkDeviceSize size);
+    ~GraphicsStagingRing();
+
+    /* False if the free space can't hold size bytes until older regions retire */
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, GraphicsTransferTicket ticket, GraphicsStagingRegion *region);
+
+    /* Reclaim regions from the oldest onwards while their batch has completed */
+    template<typename IsComplete>
+    void retire(IsComplete is_complete)
+    {
+        while (!in_flight.empty() && is_complete(in_flight.front().ticket))
+        {
+            in_flight.pop_front();
+        }
+    }
+
+    /* Ticket holding the oldest region, zero if the ring is empty */
+    GraphicsTransferTicket get_oldest_ticket() const { return in_flight.empty() ? 0 : in_flight.front().ticket; }
+
+    VkDeviceSize get_size() const { return size; }
+
+private:
+    struct InFlightRegion
+    {
+        GraphicsTransferTicket ticket;
+        VkDeviceSize begin;
+        VkDeviceSize end;
+    };
+
+    GraphicsDevice *device;
+
+    vk::Buffer buffer;
+    vk::DeviceMemory memory;
+    uint8_t *mapped;
+    VkDeviceSize size;
+
+    /* Next free byte, the space up to the oldest region's start is free */
+    VkDeviceSize head;
+    std::deque<InFlightRegion> in_flight;
+};
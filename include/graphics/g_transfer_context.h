@@ -27,8 +27,10 @@
 #include <vector>
 
 #include "g_queue.h"
+#include "g_staging_ring.h"
 
 class GraphicsDevice;
+class GraphicsTransferContext;
 
 enum GraphicsTransferHardwareDest
 {
@@ -42,9 +44,10 @@ struct BatchSubmissionInfo
     vk::Fence fence;
     std::vector<vk::Semaphore> update_semaphores;
     vk::CommandBuffer buffer;
+    GraphicsTransferTicket ticket;
 
-    BatchSubmissionInfo(GraphicsTransferHardwareDest hw_dest, vk::Fence fence, std::vector<vk::Semaphore> update_semaphores, vk::CommandBuffer buffer)
-        : hw_dest(hw_dest), fence(fence), update_semaphores(update_semaphores), buffer(buffer)
+    BatchSubmissionInfo(GraphicsTransferHardwareDest hw_dest, vk::Fence fence, std::vector<vk::Semaphore> update_semaphores, vk::CommandBuffer buffer, GraphicsTransferTicket ticket)
+        : hw_dest(hw_dest), fence(fence), update_semaphores(update_semaphores), buffer(buffer), ticket(ticket)
     {
     }
 };
@@ -52,38 +55,87 @@ struct BatchSubmissionInfo
 class GraphicsTransferBatch
 {
 public:
-    explicit GraphicsTransferBatch(GraphicsTransferHardwareDest dest, vk::CommandBuffer cmd) : dest(dest), cmd(cmd) {}
+    GraphicsTransferBatch(GraphicsTransferContext *context, GraphicsTransferHardwareDest dest, vk::CommandBuffer cmd, GraphicsTransferTicket ticket)
+        : dest(dest), context(context), cmd(cmd), ticket(ticket), empty(true) {}
 
     void pipeline_barrier(vk::PipelineStageFlags source_stage, vk::PipelineStageFlags dest_stage, vk::ArrayProxy<const vk::ImageMemoryBarrier> memory_barriers) const;
+
+    /*
+     * Fill levels 1..mip_count-1 by successive linear blits from level 0.
+     * Every level must be in TransferDstOptimal, all of them are left in
+     * ShaderReadOnlyOptimal.
+     */
     void generate_mipmaps(vk::Image src, uint32_t mip_count, vk::Rect2D size) const;
+
     void blit_buffer_to_buffer(vk::Buffer src, vk::Buffer dest, vk::ArrayProxy<const vk::BufferCopy> regions) const;
     void blit_image_to_image(vk::Image src, vk::ImageLayout src_layout, vk::Image dest, vk::ImageLayout dest_layout, vk::ArrayProxy<const vk::ImageCopy> regions) const;
     void blit_buffer_to_image(vk::Buffer src, vk::Image dest, vk::ImageLayout dest_layout, vk::ArrayProxy<const vk::BufferImageCopy> regions) const;
     void blit_image_to_buffer(vk::Image src, vk::ImageLayout src_layout, vk::Buffer dest, vk::ArrayProxy<const vk::BufferImageCopy> regions) const;
 
+    /*
+     * Take size bytes of the staging ring for the caller to fill and copy
+     * from. Size must not exceed get_staging_chunk_size(), if the ring is full
+     * the commands recorded so far are submitted to free it up.
+     */
+    GraphicsStagingRegion stage(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+    /* Copy data into dest through the staging ring, a chunk at a time */
+    void stage_buffer(const void *data, VkDeviceSize size, vk::Buffer dest, VkDeviceSize dest_offset = 0);
+
+    VkDeviceSize get_staging_chunk_size() const;
+    GraphicsTransferTicket get_ticket() const { return ticket; }
+
+    /* True if nothing was recorded, such batches are never submitted */
+    bool is_empty() const { return empty; }
+
     explicit operator vk::CommandBuffer() const { return cmd; }
     GraphicsTransferHardwareDest dest;
 
 private:
+    friend class GraphicsTransferContext;
+
+    GraphicsTransferContext *context;
     vk::CommandBuffer cmd;
+    GraphicsTransferTicket ticket;
+    mutable bool empty;
 };
 
 class GraphicsTransferContext
 {
 public:
     explicit GraphicsTransferContext(GraphicsDevice *device);
+    ~GraphicsTransferContext();
+
+    std::unique_ptr<GraphicsTransferBatch> start_batch(GraphicsTransferHardwareDest dest);
+    GraphicsTransferTicket end_batch(std::unique_ptr<GraphicsTransferBatch>, bool sync_frame);
+
+    /*
+     * Submit what the batch recorded so far and continue it in a fresh
+     * command buffer under a new ticket
+     */
+    void flush_batch(GraphicsTransferBatch& batch);
 
-    std::unique_ptr<GraphicsTransferBatch> start_batch(GraphicsTransferHardwareDest dest) const;
-    void end_batch(std::unique_ptr<GraphicsTransferBatch>, bool sync_frame);
+    /* True once the GPU has finished executing the batch */
+    bool is_batch_complete(GraphicsTransferTicket ticket) const;
+
+    /* Block until the batch has executed, without waiting on anything else */
+    void wait_for_batch(GraphicsTransferTicket ticket) const;
     
     std::vector<vk::Semaphore> get_next_frame_sync();
 
 private:
+    friend class GraphicsTransferBatch;
+
     GraphicsDevice *device;
 
     std::shared_ptr<GraphicsQueue> queue;
     std::vector<BatchSubmissionInfo> frame_syncs;
     std::vector<BatchSubmissionInfo> deffer_free_list;
+    std::vector<GraphicsTransferTicket> open_tickets;
+    GraphicsTransferTicket next_ticket;
+    std::unique_ptr<GraphicsStagingRing> staging_ring;
 
     std::shared_ptr<GraphicsQueue> get_hw_queue(GraphicsTransferHardwareDest dest) const;
+    vk::Fence submit(GraphicsTransferHardwareDest dest, vk::CommandBuffer buffer, const std::vector<vk::Semaphore>& signal_semaphores) const;
+    GraphicsStagingRegion allocate_staging(GraphicsTransferBatch& batch, VkDeviceSize size, VkDeviceSize alignment);
 };
@@ -0,0 +1,79 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+class GraphicsDevmem;
+class GraphicsDevmemBuffer;
+
+#define UNIFORM_RING_FRAMES 8
+#define UNIFORM_RING_FRAME_SIZE (64 * 1024)
+
+/* A slice reserved at the same offset in every frame's copy of the ring */
+struct GraphicsUniformBlock
+{
+    uint32_t offset;
+    uint32_t size;
+};
+
+/*
+ * One persistently mapped uniform buffer holding a copy of every block per
+ * frame in flight. Writes land in a host side shadow and are copied into a
+ * frame's copy once that frame's fence has been waited on, so the gpu never
+ * reads a block while it is being written. Blocks are bound with dynamic
+ * offsets, which stay fixed for a given frame so recorded command buffers
+ * can be reused.
+ */
+class GraphicsUniformRing
+{
+public:
+    GraphicsUniformRing(const GraphicsDevmem& devmem, uint32_t frame_count, VkDeviceSize frame_size);
+    ~GraphicsUniformRing();
+
+    /* Blocks live as long as the ring */
+    GraphicsUniformBlock allocate(VkDeviceSize size);
+    void write(const GraphicsUniformBlock& block, const void *data);
+
+    /* Call once the frame's previous submission has completed */
+    void begin_frame(uint32_t frame);
+
+    uint32_t get_dynamic_offset(const GraphicsUniformBlock& block, uint32_t frame) const;
+    vk::DescriptorBufferInfo get_buffer_info(const GraphicsUniformBlock& block) const;
+
+private:
+    std::unique_ptr<GraphicsDevmemBuffer> buffer;
+    uint8_t *mapped;
+
+    uint32_t frame_count;
+    VkDeviceSize frame_size;
+    VkDeviceSize alignment;
+    VkDeviceSize used;
+
+    /* Latest contents of every block, and how up to date each frame's copy is */
+    std::vector<uint8_t> shadow;
+    uint64_t generation;
+    std::vector<uint64_t> frame_generations;
+};
@@ -0,0 +1,99 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "g_devmem.h"
+#include "g_image_sampler.h"
+#include "g_shaderif.h"
+#include "r_texture.h"
+
+#define BINDLESS_MATERIAL_LIMIT 4096
+#define BINDLESS_TEXTURE_LIMIT 4096
+
+/*
+ * Every material's textures in one sampler2D array and its parameters in
+ * one storage buffer, bound once for all model draws. Draws pass their
+ * material's first instance, which model.vert forwards to
+ * model_bindless.frag.
+ *
+ * The storage buffer holds a copy of every material per frame, so a write
+ * never touches data an in-flight frame reads. Texture slots only hold a
+ * weak reference, once a sampler is destroyed its slot is retired and
+ * reused. Only used from the main thread.
+ */
+class BindlessTable
+{
+public:
+    BindlessTable(std::shared_ptr<GraphicsDevice>& device, std::shared_ptr<GraphicsDevmem>& devmem, uint32_t frame_count);
+    BindlessTable(const BindlessTable &) = delete;
+    ~BindlessTable();
+
+    uint32_t add_material();
+    void remove_material(uint32_t index);
+
+    void write_material(
+        uint32_t index,
+        uint32_t frame,
+        const MaterialShaderData& shader_data,
+        const std::shared_ptr<RenderTexture>& ambient_texture,
+        const std::shared_ptr<RenderTexture>& diffuse_texture,
+        const std::shared_ptr<RenderTexture>& specular_texture
+    );
+
+    void bind(vk::CommandBuffer cmd, uint32_t frame) const;
+
+    uint32_t get_first_instance(uint32_t index, uint32_t frame) const { return frame * BINDLESS_MATERIAL_LIMIT + index; }
+
+    vk::DescriptorSetLayout get_set_layout() const { return set_layout; }
+    vk::PipelineLayout get_pipeline_layout() const { return pipeline_layout; }
+
+private:
+    std::shared_ptr<GraphicsDevice> device;
+
+    uint32_t texture_limit;
+    uint32_t frame_count;
+    vk::DescriptorSetLayout camera_set_layout;
+    vk::DescriptorSetLayout set_layout;
+    vk::PipelineLayout pipeline_layout;
+    vk::DescriptorPool descriptor_pool;
+    vk::DescriptorSet camera_set;
+    vk::DescriptorSet descriptor_set;
+
+    std::unique_ptr<GraphicsDevmemBuffer> material_buffer;
+    uint8_t *material_data;
+    uint32_t material_count;
+    std::vector<uint32_t> free_materials;
+
+    std::unordered_map<const GraphicsImageSampler *, uint32_t> texture_slots;
+    std::vector<std::weak_ptr<GraphicsImageSampler>> textures;
+    std::vector<uint32_t> free_textures;
+
+    uint32_t get_texture_slot(const std::shared_ptr<RenderTexture>& texture);
+    void retire_texture_slot(const GraphicsImageSampler *sampler, uint32_t slot);
+    void release_expired_textures();
+};
@@ -39,8 +39,15 @@ public:
 	glm::mat4 get_matrix() const;
 	vk::DescriptorBufferInfo get_buffer_info() const;
 
+    /* Binds the camera with the frame's copy of its data */
+    uint32_t get_dynamic_offset(uint32_t frame) const;
+
     float get_near_plane() const { return near; }
     float get_far_plane() const { return far; }
+    float get_fov() const { return fov; }
+
+    /* The view matrix translates by position, so the eye sits at its negation */
+    glm::vec3 get_world_position() const { return -position; }
 
     void move(glm::vec3 vec);
     void set_position(glm::vec3 vec) { position = vec; }
@@ -59,7 +66,8 @@ private:
 	glm::vec3 up;
 
 	CameraShaderData shader_data;
-	std::unique_ptr<GraphicsDevmemBuffer> shader_data_buffer;
+	std::shared_ptr<GraphicsDevmem> devmem;
+	GraphicsUniformBlock shader_data_block;
 
 	static std::shared_ptr<Camera> current_camera;
 
@@ -0,0 +1,96 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <map>
+#include <memory>
+
+#include <vulkan/vulkan.hpp>
+
+#include "g_devmem.h"
+#include "g_shaderif.h"
+
+#define GEOMETRY_ARENA_VERTEX_SIZE (128 * 1024 * 1024)
+#define GEOMETRY_ARENA_INDEX_SIZE (64 * 1024 * 1024)
+
+/*
+ * First fit over the free blocks of a fixed span, neighbouring blocks merge
+ * again when freed
+ */
+class GeometryFreeList
+{
+public:
+    explicit GeometryFreeList(VkDeviceSize size);
+
+    /* False if no free block can hold size bytes at the alignment */
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset);
+    void free(VkDeviceSize offset, VkDeviceSize size);
+
+    VkDeviceSize get_free_size() const { return free_size; }
+
+private:
+    /* Offset to size of every free block */
+    std::map<VkDeviceSize, VkDeviceSize> blocks;
+    VkDeviceSize free_size;
+};
+
+/*
+ * Where a mesh's geometry lives in the arena. Offsets are in bytes, with the
+ * base vertex and first index ready to pass straight to a draw.
+ */
+struct GeometryRange
+{
+    VkDeviceSize vertex_offset;
+    VkDeviceSize vertex_size;
+    VkDeviceSize index_offset;
+    VkDeviceSize index_size;
+
+    int32_t base_vertex;
+    uint32_t first_index;
+};
+
+/*
+ * One vertex and one index buffer shared by every mesh, so a whole scene
+ * draws after a single bind of each. Verticies of different formats share
+ * the buffer, each range is aligned to its own stride.
+ */
+class GeometryArena
+{
+public:
+    GeometryArena(std::shared_ptr<GraphicsDevmem>& devmem);
+    ~GeometryArena();
+
+    GeometryRange allocate(VertexFormat vertex_format, uint32_t vertex_count, uint32_t index_count);
+    void free(const GeometryRange& range);
+
+    void bind(vk::CommandBuffer cmd) const;
+
+    const GraphicsDevmemBuffer *get_vertex_buffer() const { return vertex_buffer.get(); }
+    const GraphicsDevmemBuffer *get_index_buffer() const { return index_buffer.get(); }
+
+private:
+    std::unique_ptr<GraphicsDevmemBuffer> vertex_buffer;
+    std::unique_ptr<GraphicsDevmemBuffer> index_buffer;
+
+    GeometryFreeList vertex_blocks;
+    GeometryFreeList index_blocks;
+};
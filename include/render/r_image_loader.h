@@ -22,19 +22,136 @@
 
 #pragma once
 
+#include <future>
+#include <list>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "g_devmem.h"
+#include "g_image_sampler.h"
+#include "r_texture.h"
+#include "u_io.h"
+#include "u_thread_pool.h"
+
+class TextureFile;
+
+struct TextureCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t bytes_saved;   /* image memory not allocated thanks to cache hits */
+};
+
+/*
+ * Pixels decoded off the main thread, ready to copy into the staging ring.
+ * Only the levels listed in level_offsets are present, any remaining levels
+ * up to mip_levels are blitted on the gpu.
+ */
+struct DecodedImage
+{
+    uint32_t width;
+    uint32_t height;
+    vk::Format format;
+    uint32_t mip_levels;
+    std::vector<VkDeviceSize> level_offsets;
+    VkDeviceSize size;
+    std::shared_ptr<uint8_t> pixels;
+};
 
 class RenderImageLoader
 {
 public:
-    RenderImageLoader(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<GraphicsDevmem> devmem)
-        : device(device), devmem(devmem) {}
+    RenderImageLoader(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<GraphicsDevmem> devmem, std::shared_ptr<ThreadPool> thread_pool);
+    ~RenderImageLoader();
+
+    /*
+     * Load a texture by asset name, sharing the image, view and sampler with
+     * every other live user of the same file. DDS and KTX2 files are uploaded
+     * as is, other images use a cooked <name>.dds beside them when it is newer
+     * and the device can sample its format.
+     */
+    std::shared_ptr<RenderTexture> load_texture(const std::string& file);
+
+    /*
+     * As load_texture, but decode on the thread pool and return straight
+     * away with the fallback bound. The file is read in one batch with every
+     * other texture requested before the next call to process_uploads, and
+     * the texture becomes resident in a later call.
+     */
+    std::shared_ptr<RenderTexture> load_texture_async(const std::string& file, std::shared_ptr<GraphicsImageSampler> fallback);
+
+    std::shared_ptr<GraphicsImageSampler> create_texture(std::shared_ptr<GraphicsDevmemImage> image);
+
+    /* Decode and upload an image by asset name, bypassing the cache */
+    std::shared_ptr<GraphicsDevmemImage> load_image(std::string file, VkDeviceSize *image_size = nullptr) const;
+
+    /*
+     * Upload every decoded image in a single transfer batch and make the
+     * textures resident, when wait is set block until all decodes finish.
+     * Returns the number of textures that became resident.
+     */
+    uint32_t process_uploads(bool wait);
+    bool has_pending_uploads() const { return !pending_textures.empty(); }
 
-    std::shared_ptr<GraphicsDevmemImage> load_image(std::string file) const;
+    /*
+     * Forget a file so the next load reads it again, textures already handed
+     * out stay valid until released
+     */
+    void evict(const std::string& file);
+
+    /* Drop entries for textures nobody references any more */
+    size_t evict_unused();
+
+    const TextureCacheStats& get_stats() const { return stats; }
 
 private:
+    struct TextureCacheEntry
+    {
+        std::weak_ptr<RenderTexture> texture;
+        VkDeviceSize size;
+    };
+
+    struct PendingTexture
+    {
+        std::string key;
+        std::string file;
+        std::shared_ptr<RenderTexture> texture;
+        std::future<DecodedImage> decoded;  /* invalid until the file is read */
+    };
+
     std::shared_ptr<GraphicsDevice> device;
     std::shared_ptr<GraphicsDevmem> devmem;
+    std::shared_ptr<ThreadPool> thread_pool;
+
+    std::unordered_map<std::string, TextureCacheEntry> texture_cache;
+    std::list<PendingTexture> pending_textures;
+    TextureCacheStats stats;
+
+    struct DecodeOptions
+    {
+        /* Box filter mip chains on the decode thread as the device can't blit them */
+        bool cpu_mipmaps;
+        std::vector<vk::Format> compressed_formats;
+    };
+
+    DecodeOptions decode_options;
+
+    /* Read the files of every texture not decoding yet, then queue their decodes */
+    void submit_reads();
+
+    /* The container or fresh cooked file to load in place of an image, empty if none */
+    static std::string get_texture_path(const std::string& file);
+
+    static DecodedImage decode_image(const std::string& file, const DecodeOptions& options);
+    static DecodedImage decode_file_data(const std::string& file, const std::string& path, std::shared_ptr<file_data> data, const DecodeOptions& options);
+    static DecodedImage decode_pixels(const std::string& file, const void *data, size_t size, const DecodeOptions& options);
+    static bool decode_texture_file(std::shared_ptr<TextureFile> texture_file, const std::string& path, const DecodeOptions& options, DecodedImage *decoded);
+
+    std::shared_ptr<GraphicsDevmemImage> upload_image(
+        GraphicsTransferBatch& batch,
+        const DecodedImage& decoded,
+        const std::string& name
+    ) const;
 };
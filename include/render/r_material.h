@@ -31,6 +31,7 @@
 #include "r_renderer.h"
 #include "g_shaderif.h"
 #include "g_image_sampler.h"
+#include "r_texture.h"
 
 class Material
 {
@@ -42,31 +43,62 @@ public:
         glm::vec4 diffuse,
         glm::vec4 specular,
         float alpha,
-        std::shared_ptr<GraphicsDevmemImage> &ambient_texture,
-        std::shared_ptr<GraphicsDevmemImage> &diffuse_texture,
-        std::shared_ptr<GraphicsDevmemImage> &specular_image);
+        std::shared_ptr<RenderTexture> ambient_texture,
+        std::shared_ptr<RenderTexture> diffuse_texture,
+        std::shared_ptr<RenderTexture> specular_texture,
+        VertexFormat vertex_format = VertexFormat::Standard);
 
 	~Material();
 
-	void bind_material(vk::CommandBuffer buffer) const;
+	/* Uniforms are bound at the frame's offsets into the uniform ring */
+	void bind_material(vk::CommandBuffer buffer, uint32_t frame) const;
+
+	/*
+	 * Bindless materials are drawn with the frame's copy as the first
+	 * instance, and only need binding again when the pipeline changes
+	 */
+	bool is_bindless() const { return bindless != nullptr; }
+	uint32_t get_bindless_instance(uint32_t frame) const { return bindless->get_first_instance(bindless_index, frame); }
+	const GraphicsPipeline *get_pipeline() const { return pipeline.get(); }
+
 	void push_shader_data(vk::CommandBuffer cmd, int binding, vk::ShaderStageFlagBits stage, size_t size, void* data) const;
 
+    /*
+     * Mark every frame's descriptors stale if a texture became resident
+     * since the last write. Returns true if anything changed.
+     */
+    bool refresh_textures();
+
+    /*
+     * Rewrite the frame's descriptors if they are stale, the frame must have
+     * been waited on. Returns true if the frame needs recording again.
+     */
+    bool update_frame(uint32_t frame);
+
 private:
 	std::shared_ptr<GraphicsDevice> device;
 	std::shared_ptr<Renderer> renderer;
+	BindlessTable *bindless;
+	uint32_t bindless_index;
 
-	std::unique_ptr<GraphicsPipeline> pipeline;
+	/* Shared with every material using the same pipeline state */
+	std::shared_ptr<GraphicsPipeline> pipeline;
 
-    std::shared_ptr<GraphicsDevmemImage> ambient_texture;
-    std::unique_ptr<GraphicsImageSampler> ambient_sampler;
-    std::shared_ptr<GraphicsDevmemImage> diffuse_texture;
-    std::unique_ptr<GraphicsImageSampler> diffuse_sampler;
-    std::shared_ptr<GraphicsDevmemImage> specular_texture;
-    std::unique_ptr<GraphicsImageSampler> specular_sampler;
+    std::shared_ptr<RenderTexture> ambient_texture;
+    std::shared_ptr<RenderTexture> diffuse_texture;
+    std::shared_ptr<RenderTexture> specular_texture;
+    uint32_t texture_generation;
 
 	MaterialShaderData shader_data;
-    vk::DescriptorPool descriptor_pool;
 
-    std::unique_ptr<GraphicsPipelineCreateInfo> get_pipeline_create_info(std::shared_ptr<GraphicsDevice>& device);
-    void write_descriptor_update();
+    /*
+     * One set per frame, so a frame's set can be rewritten while the others
+     * are still in flight
+     */
+    std::vector<GraphicsDescriptorSet> descriptor_sets;
+    std::vector<bool> frames_stale;
+
+    static std::unique_ptr<GraphicsPipelineCreateInfo> get_pipeline_create_info(std::shared_ptr<GraphicsDevice>& device, VertexFormat vertex_format, const BindlessTable *bindless);
+    void write_descriptor_update(uint32_t frame);
+    uint32_t get_texture_generation() const;
 };
@@ -0,0 +1,108 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "g_shaderif.h"
+
+struct MeshMaterialInfo
+{
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    float alpha;
+    std::string diffuse_texture;
+};
+
+struct MeshSubmesh
+{
+    uint32_t material;
+    uint32_t start_index;
+    uint32_t index_count;
+};
+
+/*
+ * A level of detail is a run of submeshes in the shared index buffer, error is
+ * the largest distance in mesh units the simplified surface deviates by
+ */
+struct MeshLod
+{
+    uint32_t submesh_start;
+    uint32_t submesh_count;
+    float error;
+};
+
+struct MeshBounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+/*
+ * Non owning view over mesh geometry, backed either by a MeshData or by a
+ * mapped cooked mesh file
+ */
+struct MeshView
+{
+    const Vertex *verticies;
+    uint32_t vertex_count;
+    const uint32_t *indicies;
+    uint32_t index_count;
+    std::vector<MeshSubmesh> submeshes;
+    std::vector<MeshLod> lods;
+    MeshBounds bounds;
+    VertexFormat vertex_format;
+};
+
+struct MeshData
+{
+    std::vector<Vertex> verticies;
+    std::vector<uint32_t> indicies;
+    std::vector<MeshSubmesh> submeshes;
+    std::vector<MeshMaterialInfo> materials;
+    std::vector<MeshLod> lods;
+    MeshBounds bounds;
+    VertexFormat vertex_format;
+
+    MeshView get_view() const;
+    void compute_bounds();
+};
+
+MeshData load_obj_mesh(const std::string& path);
+
+/*
+ * Pick the most compact vertex format that keeps positions and uvs within
+ * tolerance of the source data
+ */
+VertexFormat choose_vertex_format(const MeshView& mesh);
+
+PackedVertex pack_vertex(const Vertex& vertex);
+
+/*
+ * Convert verticies into the given format, destination must hold
+ * count * get_vertex_stride(format) bytes
+ */
+void write_verticies(void *destination, const Vertex *verticies, uint32_t count, VertexFormat format);
@@ -0,0 +1,126 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "r_mesh.h"
+#include "u_io.h"
+
+#define MESH_FILE_MAGIC 0x48534d56 /* VMSH */
+#define MESH_FILE_VERSION 5
+#define MESH_FILE_EXTENSION ".vkmesh"
+
+/*
+ * Cooked mesh file layout, all sections are 16 byte aligned and referenced by
+ * their offset from the start of the file:
+ *
+ *   MeshFileHeader
+ *   Vertex[vertex_count]
+ *   uint32_t[index_count]
+ *   MeshFileSubmesh[submesh_count]
+ *   MeshFileLod[lod_count]
+ *   MeshFileMaterial[material_count]
+ *   char[] texture name string table
+ */
+struct MeshFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime;
+
+    uint32_t vertex_count;
+    uint32_t vertex_stride;
+    uint32_t index_count;
+    uint32_t submesh_count;
+    uint32_t material_count;
+    uint32_t string_table_size;
+    uint32_t lod_count;
+    uint32_t vertex_format;     /* format verticies are uploaded in, they are always stored as Vertex */
+
+    float bounds_min[3];
+    float bounds_max[3];
+
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t submesh_offset;
+    uint64_t lod_offset;
+    uint64_t material_offset;
+    uint64_t string_table_offset;
+};
+
+struct MeshFileSubmesh
+{
+    uint32_t material;
+    uint32_t start_index;
+    uint32_t index_count;
+    uint32_t reserved;
+};
+
+struct MeshFileLod
+{
+    uint32_t submesh_start;
+    uint32_t submesh_count;
+    float error;
+    uint32_t reserved;
+};
+
+struct MeshFileMaterial
+{
+    float ambient[4];
+    float diffuse[4];
+    float specular[4];
+    float alpha;
+    uint32_t diffuse_texture_offset;
+    uint32_t diffuse_texture_length;
+    uint32_t reserved;
+};
+
+class MeshFile
+{
+public:
+    MeshFile();
+    MeshFile(const MeshFile &) = delete;
+    ~MeshFile();
+
+    /*
+     * Map a cooked mesh, failing if it is missing, corrupt or was cooked from
+     * a different version of the source file
+     */
+    bool open(const std::string& path, const file_stamp *source_stamp);
+
+    MeshView get_view() const;
+    std::vector<MeshMaterialInfo> get_materials() const;
+
+    static bool write(const std::string& path, const MeshData& mesh, const file_stamp& source_stamp);
+
+private:
+    file_mapping mapping;
+    const MeshFileHeader *header;
+
+    bool validate(const file_stamp *source_stamp) const;
+
+    template<typename T>
+    const T *get_section(uint64_t offset) const { return (const T *) ((const char *) mapping.data + offset); }
+};
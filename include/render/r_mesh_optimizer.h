@@ -0,0 +1,62 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <vector>
+
+#include "r_mesh.h"
+
+#define MESH_OPTIMIZER_CACHE_SIZE 16
+
+struct MeshCacheStats
+{
+    float acmr;     /* average cache misses per triangle */
+    float atvr;     /* average transforms per referenced vertex */
+};
+
+/*
+ * Simulate a FIFO post-transform vertex cache over an index list
+ */
+MeshCacheStats analyze_vertex_cache(const uint32_t *indicies, size_t index_count, size_t vertex_count, uint32_t cache_size = MESH_OPTIMIZER_CACHE_SIZE);
+
+/*
+ * Reorder triangles for the post transform cache (Tipsify, Sander et al. 2007),
+ * the start of each cluster of triangles is returned in clusters
+ */
+void optimize_vertex_cache(uint32_t *indicies, size_t index_count, size_t vertex_count, std::vector<uint32_t> *clusters, uint32_t cache_size = MESH_OPTIMIZER_CACHE_SIZE);
+
+/*
+ * Sort the clusters produced by optimize_vertex_cache so outward facing
+ * clusters are drawn first, reducing overdraw without breaking cache locality
+ */
+void optimize_overdraw(uint32_t *indicies, size_t index_count, const Vertex *verticies, const std::vector<uint32_t>& clusters);
+
+/*
+ * Renumber verticies in the order they are first referenced so vertex fetch
+ * walks memory linearly, unreferenced verticies are dropped
+ */
+void optimize_vertex_fetch(MeshData *mesh);
+
+/*
+ * Run all of the above on every submesh of a mesh
+ */
+void optimize_mesh(MeshData *mesh);
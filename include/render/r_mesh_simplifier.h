@@ -0,0 +1,51 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <vector>
+
+#include "r_mesh.h"
+
+#define MESH_MAX_LODS 4
+#define MESH_LOD_REDUCTION 0.5f
+#define MESH_LOD_MIN_REDUCTION 0.9f
+
+/*
+ * Simplify an indexed triangle list with quadric error metric half edge
+ * collapses until target_index_count is reached. Verticies flagged in
+ * vertex_locks and verticies on open borders are never moved. Returns the
+ * new index count, result_error receives the largest collapse error in mesh
+ * units.
+ */
+size_t simplify_mesh(
+    uint32_t *destination,
+    const uint32_t *indicies, size_t index_count,
+    const Vertex *verticies, size_t vertex_count,
+    const std::vector<bool>& vertex_locks,
+    size_t target_index_count, float *result_error
+);
+
+/*
+ * Append up to MESH_MAX_LODS - 1 simplified levels to the mesh, each roughly
+ * halving the triangle count of the previous level
+ */
+void generate_mesh_lods(MeshData *mesh);
@@ -32,58 +32,97 @@
 #include "g_device.h"
 #include "g_devmem.h"
 
+#include "r_geometry_arena.h"
 #include "r_material.h"
+#include "r_mesh.h"
 #include "r_renderer.h"
 #include "g_shaderif.h"
 
-struct MaterialData
+/*
+ * Geometry and materials loaded from a single asset, shared by every Model
+ * placed from it
+ */
+class ModelMesh
 {
-	std::unique_ptr<Material> material;
-	std::vector<uint32_t> indicies;
-	uint32_t start_index;
-
-	explicit MaterialData(std::unique_ptr<Material> & material, const std::vector<uint32_t>& indicies = std::vector<uint32_t>(), uint32_t start_index = 0)
-		: material(std::move(material)),
-		indicies(indicies),
-		start_index(start_index)
-	{
-	}
+public:
+    /*
+     * Geometry is copied into the arena through its own transfer unless a
+     * batch is given, in which case the caller submits it
+     */
+    ModelMesh(
+        std::shared_ptr<GraphicsDevmem>& devmem,
+        GeometryArena *arena,
+        const MeshView& mesh,
+        std::vector<std::unique_ptr<Material>>& materials,
+        GraphicsTransferBatch *batch = nullptr
+        );
+    ~ModelMesh();
+
+    /*
+     * The arena must already be bound, see GeometryArena::bind. Uniforms are
+     * read from the given frame's copy of the uniform ring.
+     */
+    void record_draws(vk::CommandBuffer command_buffer, uint32_t lod, const VertexShaderData& shader_data, uint32_t frame) const;
+    uint32_t select_lod(const glm::vec3& camera_position, const glm::vec3& position, float error_scale) const;
+
+    /* Mark material descriptors stale for newly resident textures */
+    bool refresh_materials();
+
+    /* Rewrite the frame's stale material descriptors, true if any were */
+    bool update_frame(uint32_t frame);
+
+    const MeshBounds& get_bounds() const { return bounds; }
+    uint32_t get_lod_count() const { return (uint32_t) lods.size(); }
+
+private:
+    std::shared_ptr<GraphicsDevmem> devmem;
+
+    std::vector<std::unique_ptr<Material>> materials;
+    std::vector<MeshSubmesh> submeshes;
+    std::vector<MeshLod> lods;
+    MeshBounds bounds;
+
+    GeometryArena *arena;
+    GeometryRange range;
+
+    void record_geometry_upload(GraphicsTransferBatch& batch, const MeshView& mesh) const;
 };
 
+/*
+ * A placement of a ModelMesh, owns its transform and draws into the scene's
+ * command buffers
+ */
 class Model
 {
 public:
-	Model(
-        std::shared_ptr<GraphicsDevice>& device,
-        std::shared_ptr<GraphicsDevmem>& devmem,
-        std::shared_ptr<Renderer>& renderer,
-        std::vector<Vertex>& verticies,
-        std::vector<std::unique_ptr<Material>>& materials,
-        std::vector<std::vector<uint32_t>>& indicies
-        );
+	Model(std::shared_ptr<ModelMesh> mesh);
 	~Model();
 
     void set_position(glm::vec3 & position) { this->position = position; }
     void set_rotation(glm::quat & rotation) { this->rotation = rotation; }
 
-	void invalidate_recording();
-	void render(vk::CommandBuffer command_buffer, uint32_t image) const;
+	/* Draw the current lod, the geometry arena must already be bound */
+	void record_draws(vk::CommandBuffer command_buffer, uint32_t frame) const;
 
-private:
-	std::shared_ptr<GraphicsDevice>& device;
-	std::shared_ptr<GraphicsDevmem> devmem;
-	std::shared_ptr<Renderer> renderer;
+    /*
+     * Pick up textures that became resident, descriptors are rewritten a
+     * frame at a time by update_frame
+     */
+    bool refresh_materials();
+    bool update_frame(uint32_t frame);
 
-	std::vector<vk::CommandBuffer> command_buffers;
+    /*
+     * Pick the coarsest level whose error projects to at most one unit once
+     * scaled by error_scale / distance, error_scale converts mesh units at
+     * distance 1 into the caller's error budget
+     */
+    void update_lod(const glm::vec3& camera_position, float error_scale);
+    uint32_t get_lod() const { return current_lod; }
+
+private:
+	std::shared_ptr<ModelMesh> mesh;
+	uint32_t current_lod;
 
 	glm::vec3 position;
     glm::quat rotation;
-
-	std::vector<Vertex> verticies;
-	std::vector<std::unique_ptr<MaterialData>> material_data;
-
-	uint32_t index_count;
-
-	std::unique_ptr<GraphicsDevmemBuffer> vertex_buffer;
-	std::unique_ptr<GraphicsDevmemBuffer> index_buffer;
 };
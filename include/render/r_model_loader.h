@@ -21,37 +21,75 @@
 ******************************************************************************/
 #pragma once
 
+#include <unordered_map>
+
 #include <vulkan/vulkan.hpp>
 
 #include "g_device.h"
-#include "r_model.h"
-#include <tiny_obj_loader.h>
 #include "r_image_loader.h"
+#include "r_mesh.h"
+#include "r_mesh_file.h"
+#include "r_model.h"
+#include "u_thread_pool.h"
 
 class ModelLoader
 {
 public:
-    ModelLoader(std::shared_ptr<GraphicsDevice> &device, std::shared_ptr<GraphicsDevmem> &devmem, std::shared_ptr<Renderer> &renderer);
+    ModelLoader(std::shared_ptr<GraphicsDevice> &device, std::shared_ptr<GraphicsDevmem> &devmem, std::shared_ptr<Renderer> &renderer, std::shared_ptr<ThreadPool> thread_pool);
     ~ModelLoader();
 
+    /*
+     * Meshes are cached by path for as long as a Model placed from them is
+     * alive, repeated loads only allocate the per placement command buffers
+     */
     std::unique_ptr<Model> ModelLoader::load_model(std::string path);
 
+    /*
+     * Load several models at once, returned in the order of paths. Meshes
+     * are parsed on the thread pool and their geometry goes to the device in
+     * a single transfer batch.
+     */
+    std::vector<std::unique_ptr<Model>> load_models(const std::vector<std::string>& paths);
+
+    /*
+     * Textures are decoded in the background and drawn with a placeholder
+     * until they arrive. Call once per frame, returns the number of textures
+     * that became resident, callers must then refresh the scene's materials.
+     */
+    uint32_t process_texture_uploads();
+
 private:
+    /*
+     * CPU side of a mesh load, either a mapped cooked mesh or one freshly
+     * parsed from the source file
+     */
+    struct PreparedMesh
+    {
+        MeshFile cooked;
+        MeshData mesh;
+        bool is_cooked;
+
+        MeshView get_view() const { return is_cooked ? cooked.get_view() : mesh.get_view(); }
+        std::vector<MeshMaterialInfo> get_materials() const { return is_cooked ? cooked.get_materials() : mesh.materials; }
+    };
+
     std::shared_ptr<GraphicsDevice> device;
     std::shared_ptr<GraphicsDevmem> devmem;
     std::shared_ptr<Renderer> renderer;
+    std::shared_ptr<ThreadPool> thread_pool;
 
     std::unique_ptr<RenderImageLoader> image_loader;
 
-    std::shared_ptr<GraphicsDevmemImage> dummy_image;
+    std::shared_ptr<RenderTexture> dummy_texture;
 
-    static std::string get_library_path(const std::string& library, const std::string& file);
+    std::unordered_map<std::string, std::weak_ptr<ModelMesh>> mesh_cache;
 
-    static glm::vec4 to_vec4(float f[3]);
+    static std::string get_library_path(const std::string& library, const std::string& file);
 
-    static glm::vec4 get_vertex(const tinyobj::attrib_t& attrib, int index);
-    static glm::vec4 get_normal(const tinyobj::attrib_t& attrib, int index);
-    static glm::vec2 get_uv(const tinyobj::attrib_t& attrib, int index);
+    /* Touches no Vulkan objects, safe to run on the thread pool */
+    static std::unique_ptr<PreparedMesh> prepare_mesh(const std::string& path);
 
+    std::shared_ptr<ModelMesh> load_mesh(const std::string& path);
+    std::shared_ptr<ModelMesh> create_mesh(const MeshView& mesh, const std::vector<MeshMaterialInfo>& material_infos, GraphicsTransferBatch *batch);
     void create_dummy_texture_sampler();
 };
@@ -27,6 +27,8 @@
 #include "g_devmem.h"
 #include "g_renderpass.h"
 #include "g_swapchain.h"
+#include "r_bindless.h"
+#include "r_geometry_arena.h"
 
 struct RenderAttachment
 {
@@ -46,7 +48,7 @@ struct RenderAttachments
 class Renderer
 {
 public:
-	Renderer(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<GraphicsWindow> window, std::shared_ptr<GraphicsDevmem> devmem, std::shared_ptr<GraphicsSwapchain> swapchain);
+	Renderer(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<GraphicsWindow> window, std::shared_ptr<GraphicsDevmem> devmem, std::shared_ptr<GraphicsSwapchain> swapchain, std::shared_ptr<ThreadPool> thread_pool);
 	~Renderer();
 
 	vk::Framebuffer get_framebuffer(uint32_t index) const { return framebuffers[index]; }
@@ -63,6 +65,15 @@ public:
 
 	std::shared_ptr<GraphicsRenderpass> get_renderpass() const;
 
+	/* Swapchain images, each recorded and waited on as its own frame */
+	uint32_t get_frame_count() const { return swapchain->get_image_count(); }
+
+	/* Null unless bindless textures were enabled and the device supports them */
+	BindlessTable *get_bindless() const { return bindless.get(); }
+
+	/* Holds the geometry of every mesh drawn with this renderer */
+	GeometryArena *get_geometry_arena() const { return geometry_arena.get(); }
+
 private:
 	std::shared_ptr<GraphicsDevice> device;
 	std::shared_ptr<GraphicsWindow> window;
@@ -74,15 +85,17 @@ private:
 	RenderAttachments attachments;
 	std::vector<vk::CommandBuffer> command_buffers;
 
-    std::unique_ptr<GraphicsPipeline> deferred_pipeline;
-    vk::DescriptorPool deferred_descriptor_pool;
+    std::shared_ptr<GraphicsPipeline> deferred_pipeline;
     std::unique_ptr<GraphicsDevmemBuffer> screen_vertex_buffer;
     vk::Sampler deferred_sampler;
 
+    std::unique_ptr<BindlessTable> bindless;
+    std::unique_ptr<GeometryArena> geometry_arena;
+
     RenderAttachment create_attachment(vk::Format format, vk::ImageUsageFlags usage, std::string attachment_name) const;
-    void update_buffer_descriptor_sets() const;
+    void write_lighting_descriptor_set(vk::DescriptorSet descriptor_set) const;
 	void create_lighting_pass_resources();
-    std::unique_ptr<GraphicsPipeline> create_deffered_pipeline();
+    std::shared_ptr<GraphicsPipeline> create_deffered_pipeline();
 
 	static vk::Format pick_depth_buffer_format(std::shared_ptr<GraphicsDevice> device);
 };
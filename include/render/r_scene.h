@@ -31,6 +31,7 @@
 #include "g_devmem.h"
 #include "g_shaderif.h"
 #include "r_model.h"
+#include "r_renderer.h"
 
 class Scene
 {
@@ -41,23 +42,64 @@ public:
 	// TODO register models to a scene
 
 	vk::DescriptorBufferInfo get_light_data_info() const;
+	uint32_t get_light_data_offset(uint32_t frame) const;
     void add_model(std::unique_ptr<Model> model);
 
+    /*
+     * The renderer reads the scene's lights as it is created, so it is
+     * attached afterwards and before anything is drawn
+     */
+    void set_renderer(std::shared_ptr<Renderer>& renderer);
+
+    /*
+     * Every model is drawn from one secondary per image, re-recorded when a
+     * lod changed. The caller must have waited on the image.
+     */
     void render_models(vk::CommandBuffer buffer, uint32_t index);
 
+    /* Mark material descriptors stale after texture uploads */
+    void refresh_materials();
+
+    /*
+     * Rewrite the image's stale material descriptors, re-recording its
+     * secondary if any were. The caller must have waited on the image.
+     */
+    void update_frame(uint32_t index);
+
+    /* Re-record each image's secondary before it is next drawn */
+    void invalidate_recording();
+
+    /*
+     * Models switch to a coarser lod once its error projects to fewer than
+     * max_pixel_error pixels on a viewport viewport_height pixels tall
+     */
+    void set_lod_target(float viewport_height, float max_pixel_error);
+
 	static std::shared_ptr<Scene> get() { return current_scene; }
 	static void set(std::shared_ptr<Scene>& scene) { current_scene = scene; }
 
 private:
 	std::shared_ptr<GraphicsDevice> device;
 	std::shared_ptr<GraphicsDevmem> devmem;
+	std::shared_ptr<Renderer> renderer;
 
 	LightShaderData light_data;
-	std::unique_ptr<GraphicsDevmemBuffer> light_data_buffer;
+	GraphicsUniformBlock light_data_block;
 
     std::vector<std::unique_ptr<Model>> models;
 
+	std::vector<vk::CommandBuffer> command_buffers;
+
+    /* The lod each model was drawn at in each image's secondary */
+    std::vector<std::vector<uint32_t>> recorded_lods;
+    std::vector<bool> recording_invalid;
+
+    float lod_viewport_height;
+    float lod_max_pixel_error;
+
 	static std::shared_ptr<Scene> current_scene;
 
 	void update_buffer() const;
+	bool needs_recording(uint32_t index) const;
+	void record_command_buffer(uint32_t index);
 };
@@ -0,0 +1,54 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <memory>
+
+#include "g_image_sampler.h"
+
+/*
+ * Handle to a texture that may still be loading. Until it is resident the
+ * handle hands out a fallback sampler, the generation changes whenever the
+ * sampler does so users know to rewrite their descriptors.
+ */
+class RenderTexture
+{
+public:
+    explicit RenderTexture(std::shared_ptr<GraphicsImageSampler> sampler, bool resident = true)
+        : sampler(sampler), resident(resident), generation(0) {}
+
+    std::shared_ptr<GraphicsImageSampler> get_sampler() const { return sampler; }
+    bool is_resident() const { return resident; }
+    uint32_t get_generation() const { return generation; }
+
+    void make_resident(std::shared_ptr<GraphicsImageSampler> sampler)
+    {
+        this->sampler = sampler;
+        this->resident = true;
+        this->generation++;
+    }
+
+private:
+    std::shared_ptr<GraphicsImageSampler> sampler;
+    bool resident;
+    uint32_t generation;
+};
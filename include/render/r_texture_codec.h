@@ -0,0 +1,57 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+/*
+ * Number of levels in a full mip chain down to 1x1
+ */
+uint32_t get_texture_mip_count(uint32_t width, uint32_t height);
+
+/*
+ * 2x2 box filter an RGBA8 level into the next one, odd edges clamp onto the
+ * last row/column so non power of two images keep their borders
+ */
+void downsample_rgba8(const uint8_t *src, uint32_t src_width, uint32_t src_height, uint8_t *dest);
+
+/*
+ * Bytes per 4x4 block of a block compressed format, 0 for anything else
+ */
+uint32_t get_texture_block_size(vk::Format format);
+
+/*
+ * Size of one level of a texture in the given format, only RGBA8 and the
+ * BCn formats are known
+ */
+size_t get_texture_level_size(vk::Format format, uint32_t width, uint32_t height);
+
+/*
+ * Encode RGBA8 pixels into BC1 (colour only), BC3 (colour + alpha) or BC5
+ * (red + green, for normal maps). Endpoints come from the principal axis of
+ * each block, good enough for cooking but not a replacement for an offline
+ * compressor. BC7 is not supported.
+ */
+std::vector<uint8_t> compress_texture(vk::Format format, const uint8_t *rgba, uint32_t width, uint32_t height);
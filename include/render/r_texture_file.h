@@ -0,0 +1,78 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "u_io.h"
+
+#define TEXTURE_FILE_EXTENSION ".dds"
+
+struct TextureFileLevel
+{
+    uint64_t offset;    /* from the start of the file */
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+/*
+ * Pre-compressed 2D texture in a DDS or KTX2 container. Only single layer,
+ * non supercompressed files in RGBA8 or BC1/3/5/7 are accepted.
+ */
+class TextureFile
+{
+public:
+    TextureFile();
+    TextureFile(const TextureFile &) = delete;
+    ~TextureFile();
+
+    /* Map a texture by asset name, the container is detected from its magic */
+    bool open(const std::string& path);
+
+    /* As open, but parse a file already read into memory, taking ownership of data */
+    bool open(const std::string& path, file_data *data);
+
+    vk::Format get_format() const { return format; }
+    uint32_t get_level_count() const { return (uint32_t) levels.size(); }
+    const TextureFileLevel& get_level(uint32_t level) const { return levels[level]; }
+    const void *get_data() const { return mapping.data; }
+
+    /* Write levels, largest first, as a DDS file with a DX10 header */
+    static bool write(const std::string& path, vk::Format format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels);
+
+private:
+    /* Views either the mapped file or buffer, when it was read into memory */
+    file_mapping mapping;
+    file_data buffer;
+    vk::Format format;
+    std::vector<TextureFileLevel> levels;
+
+    bool parse_dds();
+    bool parse_ktx2();
+    bool validate() const;
+    bool parse(const std::string& path);
+    void close();
+};
@@ -0,0 +1,111 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "u_io.h"
+
+#define ASSET_PACK_MAGIC 0x4b415056 /* VPAK */
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_NAME "assets.pak"
+
+enum AssetPackCompression
+{
+	ASSET_PACK_COMPRESSION_NONE = 0,
+	ASSET_PACK_COMPRESSION_LZ4 = 1,
+};
+
+/*
+ * Pack file layout, written by tools/pack-assets.py. Entry data is 16 byte
+ * aligned, the table of contents is sorted by the FNV-1a hash of each name.
+ *
+ *   AssetPackHeader
+ *   entry data
+ *   AssetPackEntry[entry_count]
+ *   char[] name string table
+ */
+struct AssetPackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_count;
+	uint32_t reserved;
+	uint64_t toc_offset;
+	uint64_t string_table_offset;
+	uint64_t string_table_size;
+};
+
+struct AssetPackEntry
+{
+	uint64_t hash;
+	uint64_t offset;
+	uint64_t size;              /* bytes stored in the pack */
+	uint64_t uncompressed_size;
+	int64_t mtime;              /* of the source file, so cooked asset stamps still match */
+	uint32_t name_offset;
+	uint32_t name_length;
+	uint32_t compression;
+	uint32_t reserved;
+};
+
+class AssetPack
+{
+public:
+	AssetPack();
+	AssetPack(const AssetPack &) = delete;
+	~AssetPack();
+
+	/* Map a pack by asset name, failing if it is missing or corrupt */
+	bool open(const std::string& path);
+
+	const AssetPackEntry *find(const std::string& name) const;
+	size_t get_entry_count() const { return header ? header->entry_count : 0; }
+
+	/*
+	 * Map an entry as if by map_file, stored entries point into the pack and
+	 * compressed ones are decompressed into a buffer freed by unmap_file
+	 */
+	bool map_entry(const AssetPackEntry *entry, file_mapping *mapping) const;
+
+	/* Release a mapping made by map_entry, false if it did not come from a pack */
+	static bool unmap_entry(file_mapping *mapping);
+
+	static uint64_t hash_name(const std::string& name);
+
+private:
+	file_mapping mapping;
+	const AssetPackHeader *header;
+	const AssetPackEntry *entries;
+
+	/* The mapping must already be known to hold the whole header */
+	bool validate() const;
+};
+
+/*
+ * Serve u_io lookups from a pack before falling back to loose files. Mount
+ * before any loader threads start, the pack stays mapped until unmounted.
+ */
+bool mount_asset_pack(const std::string& path);
+void unmount_asset_pack();
+const AssetPack *get_asset_pack();
@@ -22,7 +22,9 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #define ASSET_PATH "./resources/"
 #define FILENAME_TO_PATH(name) (ASSET_PATH + name)
@@ -33,4 +35,71 @@ struct file_data
 	void *data;
 };
 
+struct file_stamp
+{
+	uint64_t size;
+	int64_t mtime;
+};
+
+/*
+ * Read only mapping of a whole file, released with unmap_file
+ */
+struct file_mapping
+{
+	size_t size;
+	const void *data;
+	void *handle;
+};
+
+/*
+ * Read a whole file into a buffer owned by the caller, released with free_file
+ */
 bool read_file(std::string path, file_data *data);
+void free_file(file_data *data);
+
+struct file_read_request
+{
+	std::string path;
+	file_data data;
+	bool result;
+};
+
+/*
+ * Read a batch of files with every read in flight at once, through io_uring
+ * when built with ENABLE_IO_URING and one after another otherwise. Each
+ * request records its own result, returns true if all of them succeeded.
+ */
+bool read_files(std::vector<file_read_request>& requests);
+bool write_file(std::string path, const void *data, size_t size);
+bool get_file_stamp(std::string path, file_stamp *stamp);
+
+/*
+ * Resolve an asset name to an absolute path with links, "." and ".." removed,
+ * falling back to the unresolved path if the file does not exist
+ */
+std::string get_canonical_path(std::string path);
+
+bool map_file(std::string path, file_mapping *mapping);
+void unmap_file(file_mapping *mapping);
+
+/*
+ * Owning view over a mapped file, for large assets read without a copy
+ */
+class FileView
+{
+public:
+	FileView() : mapping{ 0, nullptr, nullptr } {}
+	FileView(const FileView &) = delete;
+	FileView(FileView&& other) : mapping(other.mapping) { other.mapping = { 0, nullptr, nullptr }; }
+	~FileView() { unmap_file(&mapping); }
+
+	FileView& operator=(const FileView &) = delete;
+
+	bool open(const std::string& path) { unmap_file(&mapping); return map_file(path, &mapping); }
+
+	const void *data() const { return mapping.data; }
+	size_t size() const { return mapping.size; }
+
+private:
+	file_mapping mapping;
+};
@@ -0,0 +1,69 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed size pool of worker threads running tasks in submission order.
+ * Tasks must not touch Vulkan objects owned by the main thread.
+ */
+class ThreadPool
+{
+public:
+    /* A thread count of 0 uses one thread less than the hardware supports */
+    explicit ThreadPool(uint32_t thread_count = 0);
+    ThreadPool(const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    template<typename F>
+    auto submit(F func) -> std::future<decltype(func())>
+    {
+        typedef decltype(func()) result_type;
+
+        auto task = std::make_shared<std::packaged_task<result_type()>>(std::move(func));
+        std::future<result_type> result = task->get_future();
+
+        this->enqueue([task]() { (*task)(); });
+        return result;
+    }
+
+    uint32_t get_thread_count() const { return (uint32_t) threads.size(); }
+
+private:
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+
+    void enqueue(std::function<void()> task);
+    void worker_main();
+};
@@ -12,6 +12,7 @@ layout(location = 3) in vec2 in_uv;
 layout(location = 0) out vec4 out_position;
 layout(location = 1) out vec4 out_normal;
 layout(location = 2) out vec2 out_uv;
+layout(location = 3) flat out uint out_material; /* Bindless material index for the frame, the draw's first instance */
 
 layout(binding = 0) uniform CameraData {
 	mat4 proj_view;
@@ -33,4 +34,5 @@ void main() {
     
     gl_Position = out_position;
     out_uv = in_uv;
+    out_material = uint(gl_InstanceIndex);
 }
@@ -0,0 +1,60 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable /* For the unsized texture array */
+
+/* Bindless variant of model.frag, see r_bindless.h */
+#define NO_TEXTURE 0xffffffffu
+
+struct MaterialData {
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+	float alpha;
+	uint ambient_texture;
+	uint diffuse_texture;
+	uint specular_texture;
+};
+
+layout(location = 0) in vec4 in_position;
+layout(location = 1) in vec4 in_normal;
+layout(location = 2) in vec2 in_uv;
+layout(location = 3) flat in uint in_material;
+
+layout(location = 0) out vec4 out_final;
+layout(location = 1) out vec4 out_color;
+layout(location = 2) out vec4 out_position;
+layout(location = 3) out vec4 out_normal;
+
+/* Set 0 holds the camera, which can't share an update after bind set */
+layout(std430, set = 1, binding = 1) readonly buffer MaterialBuffer {
+	MaterialData materials[];
+};
+
+/* Indexed by a value uniform across each draw, so no nonuniformEXT needed */
+layout(set = 1, binding = 2) uniform sampler2D textures[];
+
+layout (constant_id = 0) const float NEAR_PLANE = 0.1f;
+layout (constant_id = 1) const float FAR_PLANE = 256.0f;
+
+float linearDepth(float depth)
+{
+	float z = depth * 2.0f - 1.0f; 
+	return (2.0f * NEAR_PLANE * FAR_PLANE) / (FAR_PLANE + NEAR_PLANE - z * (FAR_PLANE - NEAR_PLANE));	
+}
+
+void main() {
+	MaterialData material = materials[in_material];
+
+	out_position = in_position;
+	out_position.a = linearDepth(gl_FragCoord.z);
+	out_normal = normalize(in_normal);
+
+	if (material.diffuse_texture != NO_TEXTURE)
+	{
+		out_color = texture(textures[material.diffuse_texture], in_uv);
+	}
+	else
+	{
+		out_color = material.diffuse;
+	}
+}
@@ -0,0 +1,48 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_KHR_vulkan_glsl : enable
+
+const int pcoffset = 0;
+
+/* PackedVertex, see g_shaderif.h */
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec2 packed_normal;
+layout(location = 3) in vec2 in_uv;
+
+layout(location = 0) out vec4 out_position;
+layout(location = 1) out vec4 out_normal;
+layout(location = 2) out vec2 out_uv;
+layout(location = 3) flat out uint out_material; /* Bindless material index for the frame, the draw's first instance */
+
+layout(binding = 0) uniform CameraData {
+	mat4 proj_view;
+} camera_data;
+
+layout(push_constant) uniform ModelData {
+	layout(offset=pcoffset) mat4 model;
+} model_data;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+vec3 decode_octahedral(vec2 e) {
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main() {
+    vec4 normal = vec4(decode_octahedral(packed_normal), 1.0);
+
+    out_position = camera_data.proj_view * model_data.model * vec4(position);
+    out_position.y = -out_position.y;
+
+    out_normal = transpose(inverse(model_data.model)) * normalize(normal);
+    
+    gl_Position = out_position;
+    out_uv = in_uv;
+    out_material = uint(gl_InstanceIndex);
+}
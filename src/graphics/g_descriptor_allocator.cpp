@@ -0,0 +1,252 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "g_descriptor_allocator.h"
+
+#include <algorithm>
+
+#include "g_device.h"
+#include "u_debug.h"
+
+#define DESCRIPTOR_POOL_MIN_SETS 32
+#define DESCRIPTOR_POOL_MAX_SETS 4096
+
+struct GraphicsDescriptorPoolChain
+{
+	std::mutex mutex;
+	std::vector<vk::DescriptorPool> pools;
+	size_t current = 0;
+	uint32_t sets_per_pool = DESCRIPTOR_POOL_MIN_SETS;
+	bool freeable = true;
+
+	/* Pools behind the current one that have had sets freed since they filled */
+	std::vector<vk::DescriptorPool> freed_pools;
+};
+
+GraphicsDescriptorAllocator::GraphicsDescriptorAllocator(GraphicsDevice *device)
+	: device(device), set_usage(0)
+{
+}
+
+GraphicsDescriptorAllocator::~GraphicsDescriptorAllocator()
+{
+	size_t pool_count = 0;
+
+	for (const auto & entry : thread_chains)
+	{
+		for (const auto & pool : entry.second->pools)
+		{
+			device->device.destroyDescriptorPool(pool);
+		}
+		pool_count += entry.second->pools.size();
+	}
+
+	for (const auto & chain : frame_chains)
+	{
+		for (const auto & pool : chain->pools)
+		{
+			device->device.destroyDescriptorPool(pool);
+		}
+		pool_count += chain->pools.size();
+	}
+
+	LOG_INFO("Allocated %llu descriptor sets from %zu pools", (unsigned long long) set_usage, pool_count);
+}
+
+GraphicsDescriptorSet GraphicsDescriptorAllocator::allocate(vk::DescriptorSetLayout layout)
+{
+	GraphicsDescriptorPoolChain& chain = this->get_thread_chain();
+	std::lock_guard<std::mutex> lock(chain.mutex);
+
+	GraphicsDescriptorSet set;
+	set.set = this->allocate_from_chain(chain, layout, &set.pool);
+	set.chain = &chain;
+
+	return set;
+}
+
+void GraphicsDescriptorAllocator::free(const GraphicsDescriptorSet& set)
+{
+	if (!set.set)
+	{
+		return;
+	}
+
+	GraphicsDescriptorPoolChain& chain = *set.chain;
+	std::lock_guard<std::mutex> lock(chain.mutex);
+	device->device.freeDescriptorSets(set.pool, set.set);
+
+	/* The current pool and those after it are scanned anyway */
+	bool behind_current = std::find(chain.pools.begin(), chain.pools.begin() + chain.current, set.pool) != chain.pools.begin() + chain.current;
+
+	if (behind_current && std::find(chain.freed_pools.begin(), chain.freed_pools.end(), set.pool) == chain.freed_pools.end())
+	{
+		chain.freed_pools.push_back(set.pool);
+	}
+}
+
+vk::DescriptorSet GraphicsDescriptorAllocator::allocate_transient(vk::DescriptorSetLayout layout, uint32_t frame)
+{
+	GraphicsDescriptorPoolChain& chain = this->get_frame_chain(frame);
+	std::lock_guard<std::mutex> lock(chain.mutex);
+
+	vk::DescriptorPool pool;
+	return this->allocate_from_chain(chain, layout, &pool);
+}
+
+void GraphicsDescriptorAllocator::reset_frame(uint32_t frame)
+{
+	GraphicsDescriptorPoolChain& chain = this->get_frame_chain(frame);
+	std::lock_guard<std::mutex> lock(chain.mutex);
+
+	/* Keep the pools, the next frame is likely to need as many */
+	for (const auto & pool : chain.pools)
+	{
+		device->device.resetDescriptorPool(pool);
+	}
+
+	chain.current = 0;
+}
+
+GraphicsDescriptorPoolChain& GraphicsDescriptorAllocator::get_thread_chain()
+{
+	std::lock_guard<std::mutex> lock(chains_mutex);
+
+	std::unique_ptr<GraphicsDescriptorPoolChain>& chain = thread_chains[std::this_thread::get_id()];
+	if (!chain)
+	{
+		chain = std::make_unique<GraphicsDescriptorPoolChain>();
+	}
+
+	return *chain;
+}
+
+GraphicsDescriptorPoolChain& GraphicsDescriptorAllocator::get_frame_chain(uint32_t frame)
+{
+	std::lock_guard<std::mutex> lock(chains_mutex);
+
+	while (frame_chains.size() <= frame)
+	{
+		frame_chains.push_back(std::make_unique<GraphicsDescriptorPoolChain>());
+		frame_chains.back()->freeable = false;
+	}
+
+	return *frame_chains[frame];
+}
+
+vk::DescriptorSet GraphicsDescriptorAllocator::allocate_from_chain(GraphicsDescriptorPoolChain& chain, vk::DescriptorSetLayout layout, vk::DescriptorPool *pool)
+{
+	std::vector<vk::DescriptorSetLayoutBinding> bindings = device->layout_cache->get_descriptor_set_bindings(layout);
+	this->record_usage(bindings);
+
+	vk::DescriptorSet set;
+
+	/* Reuse space freed in older pools before growing the chain */
+	while (!chain.freed_pools.empty())
+	{
+		vk::DescriptorSetAllocateInfo alloc_info(chain.freed_pools.back(), 1, &layout);
+		if (device->device.allocateDescriptorSets(&alloc_info, &set) == vk::Result::eSuccess)
+		{
+			*pool = chain.freed_pools.back();
+			return set;
+		}
+
+		/* Full or too fragmented for this layout, it comes back on its next free */
+		chain.freed_pools.pop_back();
+	}
+
+	/* Pools before the current one are full or fragmented */
+	for (; chain.current < chain.pools.size(); chain.current++)
+	{
+		vk::DescriptorSetAllocateInfo alloc_info(chain.pools[chain.current], 1, &layout);
+		if (device->device.allocateDescriptorSets(&alloc_info, &set) == vk::Result::eSuccess)
+		{
+			*pool = chain.pools[chain.current];
+			return set;
+		}
+	}
+
+	if (!chain.pools.empty())
+	{
+		chain.sets_per_pool = std::min(chain.sets_per_pool * 2, (uint32_t) DESCRIPTOR_POOL_MAX_SETS);
+	}
+
+	chain.pools.push_back(this->create_pool(bindings, chain.sets_per_pool, chain.freeable));
+	chain.current = chain.pools.size() - 1;
+
+	vk::DescriptorSetAllocateInfo alloc_info(chain.pools[chain.current], 1, &layout);
+	if (device->device.allocateDescriptorSets(&alloc_info, &set) != vk::Result::eSuccess)
+	{
+		throw std::exception("Error allocating descriptor set");
+	}
+
+	*pool = chain.pools[chain.current];
+	return set;
+}
+
+vk::DescriptorPool GraphicsDescriptorAllocator::create_pool(const std::vector<vk::DescriptorSetLayoutBinding>& bindings, uint32_t set_count, bool freeable)
+{
+	std::unordered_map<uint32_t, uint32_t> counts;
+
+	{
+		std::lock_guard<std::mutex> lock(usage_mutex);
+
+		for (const auto & usage : descriptor_usage)
+		{
+			counts[usage.first] = (uint32_t) ((usage.second * set_count + set_usage - 1) / set_usage);
+		}
+	}
+
+	/* Always room for at least one of the sets being allocated */
+	for (const auto & binding : bindings)
+	{
+		uint32_t& count = counts[(uint32_t) binding.descriptorType];
+		count = std::max(count, binding.descriptorCount);
+	}
+
+	std::vector<vk::DescriptorPoolSize> pool_sizes;
+	for (const auto & count : counts)
+	{
+		pool_sizes.push_back(vk::DescriptorPoolSize((vk::DescriptorType) count.first, count.second));
+	}
+
+	vk::DescriptorPoolCreateInfo create_info(
+		freeable ? vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet : vk::DescriptorPoolCreateFlags(0),
+		set_count,
+		(uint32_t)pool_sizes.size(), pool_sizes.data()
+	);
+
+	LOG_INFO("Creating descriptor pool for %u sets", set_count);
+
+	return device->device.createDescriptorPool(create_info);
+}
+
+void GraphicsDescriptorAllocator::record_usage(const std::vector<vk::DescriptorSetLayoutBinding>& bindings)
+{
+	std::lock_guard<std::mutex> lock(usage_mutex);
+
+	for (const auto & binding : bindings)
+	{
+		descriptor_usage[(uint32_t) binding.descriptorType] += binding.descriptorCount;
+	}
+
+	set_usage++;
+}
@@ -21,6 +21,8 @@
 ******************************************************************************/
 #include "g_device.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <set>
 
@@ -87,7 +89,11 @@ GraphicsDevice::GraphicsDevice(std::shared_ptr<GraphicsWindow>& window)
 		VK_MAKE_VERSION(0, 1, 0),
 		"Vulkan Basics",
 		VK_MAKE_VERSION(0, 1, 0),
+#ifdef ENABLE_BINDLESS_TEXTURES
+        VK_API_VERSION_1_1 /* For querying descriptor indexing support */
+#else
         VK_API_VERSION_1_0
+#endif
 	);
 
 	std::vector<const char *> instance_layers;
@@ -151,9 +157,33 @@ GraphicsDevice::GraphicsDevice(std::shared_ptr<GraphicsWindow>& window)
 
 	vk::PhysicalDeviceFeatures physical_device_feature;
 	physical_device_feature.setIndependentBlend(VK_TRUE);
+	physical_device_feature.setTextureCompressionBC(physical_deivce.getFeatures().textureCompressionBC);
 
 	device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+	/* Only what the bindless table uses, enabled if all of it is there */
+	vk::PhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features;
+	bindless_texture_limit = 0;
+
+#ifdef ENABLE_BINDLESS_TEXTURES
+	bindless_texture_limit = query_bindless_texture_limit(physical_deivce);
+
+	if (bindless_texture_limit > 0)
+	{
+		device_extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		physical_device_feature.setShaderSampledImageArrayDynamicIndexing(VK_TRUE);
+
+		indexing_features.runtimeDescriptorArray = VK_TRUE;
+		indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+		indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		indexing_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	}
+	else
+	{
+		LOG_WARN("Descriptor indexing unsupported, bindless textures disabled");
+	}
+#endif
+
 	queue_priorities[0] = 1.0f;
 
 	for (const auto & index : queue_indicies)
@@ -173,6 +203,11 @@ GraphicsDevice::GraphicsDevice(std::shared_ptr<GraphicsWindow>& window)
 		&physical_device_feature
 	);
 
+	if (bindless_texture_limit > 0)
+	{
+		device_create_info.pNext = &indexing_features;
+	}
+
 	device = physical_deivce.createDevice(device_create_info, nullptr);
 
     graphics_queue = std::make_shared<GraphicsQueue>(this, queue_data.graphics_queue);
@@ -180,10 +215,21 @@ GraphicsDevice::GraphicsDevice(std::shared_ptr<GraphicsWindow>& window)
     transfer_queue = std::make_shared<GraphicsQueue>(this, queue_data.graphics_queue);
 
     transfer_context = std::make_unique<GraphicsTransferContext>(this);
+    shader_cache = std::make_unique<GraphicsShaderCache>(this);
+    layout_cache = std::make_unique<GraphicsLayoutCache>(this);
+    descriptor_allocator = std::make_unique<GraphicsDescriptorAllocator>(this);
+    retire_queue = std::make_unique<GraphicsRetireQueue>(this);
 }
 
 GraphicsDevice::~GraphicsDevice()
 {
+	/* Retired resources may still free descriptor sets */
+	retire_queue.reset();
+	descriptor_allocator.reset();
+	layout_cache.reset();
+	shader_cache.reset();
+	transfer_context.reset();
+
 	device.destroy();
 
 	instance.destroyDebugUtilsMessengerEXT(debug_report_callback);
@@ -197,6 +243,66 @@ vk::Semaphore GraphicsDevice::create_semaphore() const
 	));
 }
 
+bool GraphicsDevice::supports_linear_blit(vk::Format format) const
+{
+    vk::FormatFeatureFlags required = vk::FormatFeatureFlagBits::eBlitSrc
+        | vk::FormatFeatureFlagBits::eBlitDst
+        | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+
+    vk::FormatProperties properties = physical_deivce.getFormatProperties(format);
+    return (properties.optimalTilingFeatures & required) == required;
+}
+
+bool GraphicsDevice::supports_sampled_format(vk::Format format) const
+{
+    vk::FormatProperties properties = physical_deivce.getFormatProperties(format);
+    return (bool) (properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage);
+}
+
+uint32_t GraphicsDevice::query_bindless_texture_limit(vk::PhysicalDevice physical_device)
+{
+	bool has_extension = false;
+
+	for (const auto & extension : physical_device.enumerateDeviceExtensionProperties())
+	{
+		if (strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0)
+		{
+			has_extension = true;
+		}
+	}
+
+	if (!has_extension || !physical_device.getFeatures().shaderSampledImageArrayDynamicIndexing)
+	{
+		return 0;
+	}
+
+	vk::PhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features;
+	vk::PhysicalDeviceFeatures2 features;
+	features.pNext = &indexing_features;
+	physical_device.getFeatures2(&features);
+
+	if (!indexing_features.runtimeDescriptorArray ||
+		!indexing_features.descriptorBindingPartiallyBound ||
+		!indexing_features.descriptorBindingSampledImageUpdateAfterBind ||
+		!indexing_features.descriptorBindingUpdateUnusedWhilePending)
+	{
+		return 0;
+	}
+
+	/* Combined image samplers count against both the sampler and image limits */
+	vk::PhysicalDeviceDescriptorIndexingPropertiesEXT indexing_properties;
+	vk::PhysicalDeviceProperties2 properties;
+	properties.pNext = &indexing_properties;
+	physical_device.getProperties2(&properties);
+
+	return std::min({
+		indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+		indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		indexing_properties.maxDescriptorSetUpdateAfterBindSamplers,
+		indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages,
+	});
+}
+
 bool GraphicsDevice::is_device_suitable(vk::PhysicalDevice physical_device, vk::SurfaceKHR surface, QueueFamilyIndicies & queue_data)
 {
 	auto properties = physical_device.getProperties();
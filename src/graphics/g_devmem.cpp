@@ -22,6 +22,8 @@
 
 #include "g_devmem.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 #define VMA_IMPLEMENTATION
@@ -29,6 +31,11 @@
 #include "u_defines.h"
 #include "vk_mem_alloc.h"
 
+#define DIRECT_WRITE_HEAP_FRACTION 2
+
+static const VkMemoryPropertyFlags direct_write_flags =
+	VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
 static std::string format_memory_flags(vk::MemoryPropertyFlags flags)
 {
 	std::string output;
@@ -64,33 +71,35 @@ static std::string format_memory_flags(vk::MemoryPropertyFlags flags)
 GraphicsDevmemBuffer::GraphicsDevmemBuffer(
     std::shared_ptr<GraphicsDevice> device, VmaAllocator allocator, 
     VkBuffer buffer, VmaAllocation allocation, VmaAllocationInfo alloc_info,
-    VkBuffer staging_buffer, VmaAllocation staging_allocation, VmaAllocationInfo staging_alloc_info)
+    std::atomic<VkDeviceSize> *direct_write_usage)
 	: buffer(buffer), device(device), allocator(allocator), 
-        allocation(allocation), alloc_info(alloc_info), 
-        staging_buffer(staging_buffer), staging_allocation(staging_allocation), staging_alloc_info(staging_alloc_info)
+        allocation(allocation), alloc_info(alloc_info), direct_write_usage(direct_write_usage)
 {
 }
 
 GraphicsDevmemBuffer::~GraphicsDevmemBuffer()
 {
-	vmaDestroyBuffer(allocator, (VkBuffer)buffer, allocation);
+	VmaAllocator allocator = this->allocator;
+	VkBuffer buffer = (VkBuffer) this->buffer;
+	VmaAllocation allocation = this->allocation;
+	VkDeviceSize size = alloc_info.size;
+	std::atomic<VkDeviceSize> *direct_write_usage = this->direct_write_usage;
+
+	device->retire_queue->retire([allocator, buffer, allocation, size, direct_write_usage]() {
+		vmaDestroyBuffer(allocator, buffer, allocation);
+
+		if (direct_write_usage != nullptr)
+		{
+			*direct_write_usage -= size;
+		}
+	});
 }
 
 void GraphicsDevmemBuffer::map_memory(void **data) const
 {
 	DEBUG_ASSERT(this->is_visible());
 
-    VkResult result;
-
-    if (staging_buffer == vk::Buffer())
-    {
-        result = vmaMapMemory(allocator, allocation, data);
-    }
-    else
-    {
-        result = vmaMapMemory(allocator, staging_allocation, data);
-    }
-
+	VkResult result = vmaMapMemory(allocator, allocation, data);
 	if (result != VK_SUCCESS)
 	{
 		vk::throwResultException((vk::Result) result, "vmaMapMemory");
@@ -101,32 +110,36 @@ void GraphicsDevmemBuffer::unmap_memory() const
 {
 	DEBUG_ASSERT(this->is_visible());
 
-    if (staging_buffer == vk::Buffer())
-    {
-        vmaUnmapMemory(allocator, allocation);
-    }
-    else
+	vmaUnmapMemory(allocator, allocation);
+}
+
+void GraphicsDevmemBuffer::upload(const void *data, VkDeviceSize size, VkDeviceSize offset) const
+{
+    if (this->is_visible())
     {
-        vmaUnmapMemory(allocator, staging_allocation);
+        void *mapped;
+        this->map_memory(&mapped);
+        memcpy((uint8_t *) mapped + offset, data, (size_t) size);
+        this->unmap_memory();
+        return;
     }
 
+    auto batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eTransfer);
+    this->record_upload(*batch, data, size, offset);
+    device->transfer_context->end_batch(std::move(batch), true);
 }
 
-void GraphicsDevmemBuffer::commit_memory() const
+void GraphicsDevmemBuffer::record_upload(GraphicsTransferBatch& batch, const void *data, VkDeviceSize size, VkDeviceSize offset) const
 {
-    if (staging_buffer == vk::Buffer())
+    DEBUG_ASSERT(offset + size <= this->alloc_info.size);
+
+    if (this->is_visible())
     {
+        this->upload(data, size, offset);
         return;
     }
 
-    /*
-     * Queue transfer from staging buffer to live buffer
-     */
-    LOG_INFO("Queue transfer from staging buffer to live buffer");
-
-    auto batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eTransfer);
-    batch->blit_buffer_to_buffer(staging_buffer, buffer, { vk::BufferCopy(0, 0, this->alloc_info.size) });
-    device->transfer_context->end_batch(std::move(batch), true);
+    batch.stage_buffer(data, size, buffer, offset);
 }
 
 vk::BufferView GraphicsDevmemBuffer::create_buffer_view(vk::BufferViewCreateInfo& create_info) const
@@ -139,7 +152,7 @@ bool GraphicsDevmemBuffer::is_visible() const
 {
 	VkMemoryPropertyFlags memFlags;
 	vmaGetMemoryTypeProperties(allocator, alloc_info.memoryType, &memFlags);
-	return BITMASK_HAS(memFlags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) || staging_buffer != vk::Buffer();
+	return BITMASK_HAS(memFlags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 }
 
 GraphicsDevmemImage::GraphicsDevmemImage(
@@ -149,15 +162,23 @@ GraphicsDevmemImage::GraphicsDevmemImage(
     VmaAllocation allocation,
     VmaAllocationInfo alloc_info,
     vk::ImageLayout layout,
-    vk::Format format
+    vk::Format format,
+    vk::Extent3D extent,
+    uint32_t mip_levels
 )
-	: image(image), device(device), allocator(allocator), allocation(allocation), alloc_info(alloc_info), layout(layout), format(format)
+	: image(image), device(device), allocator(allocator), allocation(allocation), alloc_info(alloc_info), layout(layout), format(format), extent(extent), mip_levels(mip_levels)
 {
 }
 
 GraphicsDevmemImage::~GraphicsDevmemImage()
 {
-	vmaDestroyImage(allocator, (VkImage) image, allocation);
+	VmaAllocator allocator = this->allocator;
+	VkImage image = (VkImage) this->image;
+	VmaAllocation allocation = this->allocation;
+
+	device->retire_queue->retire([allocator, image, allocation]() {
+		vmaDestroyImage(allocator, image, allocation);
+	});
 }
 
 void GraphicsDevmemImage::map_memory(void** data) const
@@ -212,6 +233,18 @@ static bool has_stencil_bits(vk::Format format)
 
 
 void GraphicsDevmemImage::transition_layout(vk::ImageLayout dest)
+{
+    if (dest == layout)
+    {
+        return;
+    }
+
+    auto batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eGraphics);
+    this->record_transition_layout(*batch, dest);
+    device->transfer_context->end_batch(std::move(batch), false);
+}
+
+void GraphicsDevmemImage::record_transition_layout(const GraphicsTransferBatch& batch, vk::ImageLayout dest)
 {
     vk::ImageLayout src = layout;
     vk::ImageMemoryBarrier barrier;
@@ -241,7 +274,7 @@ void GraphicsDevmemImage::transition_layout(vk::ImageLayout dest)
     }
 
     barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.levelCount = mip_levels;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
 
@@ -279,15 +312,28 @@ void GraphicsDevmemImage::transition_layout(vk::ImageLayout dest)
 
     LOG_INFO("Transitioned image %p to from layout %d to layout %d", image, layout, dest);
 
-    auto batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eGraphics);
-    batch->pipeline_barrier(source_stage, dest_stage, { barrier });
-    device->transfer_context->end_batch(std::move(batch), false);
+    batch.pipeline_barrier(source_stage, dest_stage, { barrier });
 
     layout = dest;
 }
 
+void GraphicsDevmemImage::record_generate_mipmaps(const GraphicsTransferBatch& batch)
+{
+    DEBUG_ASSERT(layout == vk::ImageLayout::eTransferDstOptimal);
+
+    if (mip_levels == 1)
+    {
+        this->record_transition_layout(batch, vk::ImageLayout::eShaderReadOnlyOptimal);
+        return;
+    }
+
+    batch.generate_mipmaps(image, mip_levels, vk::Rect2D({ 0, 0 }, { extent.width, extent.height }));
+
+    layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+}
+
 GraphicsDevmem::GraphicsDevmem(std::shared_ptr<GraphicsDevice>& device)
-	: device(device)
+	: device(device), direct_write_budget(0), direct_write_usage(0)
 {
 	VmaAllocatorCreateInfo create_info {};
 	create_info.flags = VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;
@@ -299,10 +345,33 @@ GraphicsDevmem::GraphicsDevmem(std::shared_ptr<GraphicsDevice>& device)
 	{
 		vk::throwResultException((vk::Result) result, "vmaCreateAllocator");
 	}
+
+	const VkPhysicalDeviceMemoryProperties *properties;
+	vmaGetMemoryProperties(allocator, &properties);
+
+	for (uint32_t i = 0; i < properties->memoryTypeCount; i++)
+	{
+		if ((properties->memoryTypes[i].propertyFlags & direct_write_flags) == direct_write_flags)
+		{
+			VkDeviceSize heap_size = properties->memoryHeaps[properties->memoryTypes[i].heapIndex].size;
+			direct_write_budget = std::max(direct_write_budget, heap_size / DIRECT_WRITE_HEAP_FRACTION);
+		}
+	}
+
+	if (direct_write_budget > 0)
+	{
+		LOG_INFO("Host visible device memory found, writing up to %llu bytes directly", (unsigned long long) direct_write_budget);
+	}
+
+	uniform_ring = std::make_unique<GraphicsUniformRing>(*this, UNIFORM_RING_FRAMES, UNIFORM_RING_FRAME_SIZE);
 }
 
 GraphicsDevmem::~GraphicsDevmem()
 {
+	uniform_ring.reset();
+
+	/* Retired buffers and images must go before the allocator */
+	device->retire_queue->flush();
 	vmaDestroyAllocator(allocator);
 }
 
@@ -314,33 +383,26 @@ std::unique_ptr<GraphicsDevmemBuffer> GraphicsDevmem::create_buffer(vk::BufferCr
 	VkBufferCreateInfo create_info = (VkBufferCreateInfo)buffer_create_info;
     create_info.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
+	if (alloc_create_info.usage == VMA_MEMORY_USAGE_GPU_ONLY && direct_write_usage + create_info.size <= direct_write_budget)
+	{
+		VmaAllocationCreateInfo direct_create_info = alloc_create_info;
+		direct_create_info.requiredFlags |= direct_write_flags;
+
+		/* The heap may be full even under budget, then take the staged path */
+		if (vmaCreateBuffer(allocator, &create_info, &direct_create_info, &buffer, &allocation, &alloc_info) == VK_SUCCESS)
+		{
+			direct_write_usage += alloc_info.size;
+			return std::make_unique<GraphicsDevmemBuffer>(device, allocator, buffer, allocation, alloc_info, &direct_write_usage);
+		}
+	}
+
 	VkResult result = vmaCreateBuffer(allocator, &create_info, &alloc_create_info, &buffer, &allocation, &alloc_info);
 	if (result != VK_SUCCESS)
 	{
 		vk::throwResultException((vk::Result) result, "vmaCreateBuffer");
 	}
 
-    /* Create staging buffers for gpu only allocations */
-    VkBuffer staging_buffer = VK_NULL_HANDLE;
-    VmaAllocation staging_allocatin = VK_NULL_HANDLE;
-    VmaAllocationInfo staging_alloc_info;
-
-    if (alloc_create_info.usage == VMA_MEMORY_USAGE_GPU_ONLY && !BITMASK_HAS(alloc_create_info.flags, VMA_ALLOCATION_CREATE_EXT_DONT_CREATE_STAGING_BUFFER))
-    {
-        LOG_INFO("Allocating staging buffer");
-
-        /* Update create info structs for staging buffer values */
-        alloc_create_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
-        create_info.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-
-        result = vmaCreateBuffer(allocator, &create_info, &alloc_create_info, &staging_buffer, &staging_allocatin, &staging_alloc_info);
-        if (result != VK_SUCCESS)
-        {
-            vk::throwResultException((vk::Result) result, "vmaCreateBuffer");
-        }
-    }
-    
-	return std::make_unique<GraphicsDevmemBuffer>(device, allocator, buffer, allocation, alloc_info, staging_buffer, staging_allocatin, staging_alloc_info);
+	return std::make_unique<GraphicsDevmemBuffer>(device, allocator, buffer, allocation, alloc_info);
 }
 
 std::unique_ptr<GraphicsDevmemImage> GraphicsDevmem::create_image(vk::ImageCreateInfo image_create_info, VmaAllocationCreateInfo alloc_create_info) const
@@ -356,5 +418,5 @@ std::unique_ptr<GraphicsDevmemImage> GraphicsDevmem::create_image(vk::ImageCreat
 		vk::throwResultException((vk::Result) result, "vmaCreateImage");
 	}
 
-    return std::make_unique<GraphicsDevmemImage>(device, allocator, image, allocation, alloc_info, image_create_info.initialLayout, image_create_info.format);
+    return std::make_unique<GraphicsDevmemImage>(device, allocator, image, allocation, alloc_info, image_create_info.initialLayout, image_create_info.format, image_create_info.extent, image_create_info.mipLevels);
 }
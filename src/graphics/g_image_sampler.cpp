@@ -47,7 +47,7 @@ GraphicsImageSampler::GraphicsImageSampler(
         ),
         vk::ImageSubresourceRange(
             vk::ImageAspectFlagBits::eColor,
-            0, 1,
+            0, image->get_mip_levels(),
             0, 1
         )
     );
@@ -65,7 +65,7 @@ GraphicsImageSampler::GraphicsImageSampler(
         0,
         VK_FALSE, 0,
         VK_FALSE, vk::CompareOp::eNever,
-        0, 0,
+        0, (float) image->get_mip_levels(),
         border_color,
         VK_FALSE
     );
@@ -75,8 +75,15 @@ GraphicsImageSampler::GraphicsImageSampler(
 
 GraphicsImageSampler::~GraphicsImageSampler()
 {
-    device->device.destroySampler(sampler);
-    device->device.destroyImageView(image_view);
+    vk::Device vk_device = device->device;
+    vk::Sampler sampler = this->sampler;
+    vk::ImageView image_view = this->image_view;
+
+    /* Retired before the image, which is released after this body runs */
+    device->retire_queue->retire([vk_device, sampler, image_view]() {
+        vk_device.destroySampler(sampler);
+        vk_device.destroyImageView(image_view);
+    });
 }
 
 vk::DescriptorImageInfo GraphicsImageSampler::get_image_info() const
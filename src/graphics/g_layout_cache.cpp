@@ -0,0 +1,147 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "g_layout_cache.h"
+
+#include "g_device.h"
+#include "u_debug.h"
+#include "u_hash.h"
+
+static size_t hash_bindings(const std::vector<vk::DescriptorSetLayoutBinding>& bindings)
+{
+	size_t seed = 0;
+
+	for (const auto & binding : bindings)
+	{
+		hash_combine(seed, binding.binding);
+		hash_combine(seed, (uint32_t) binding.descriptorType);
+		hash_combine(seed, binding.descriptorCount);
+		hash_combine(seed, (VkFlags) binding.stageFlags);
+	}
+
+	return seed;
+}
+
+static size_t hash_pipeline_layout(vk::DescriptorSetLayout set_layout, const std::vector<vk::PushConstantRange>& push_constant_ranges)
+{
+	size_t seed = 0;
+	hash_handle(seed, set_layout);
+
+	for (const auto & range : push_constant_ranges)
+	{
+		hash_combine(seed, (VkFlags) range.stageFlags);
+		hash_combine(seed, range.offset);
+		hash_combine(seed, range.size);
+	}
+
+	return seed;
+}
+
+GraphicsLayoutCache::GraphicsLayoutCache(GraphicsDevice *device)
+	: device(device), created_count(0), reused_count(0)
+{
+}
+
+GraphicsLayoutCache::~GraphicsLayoutCache()
+{
+	LOG_INFO("Created %u layouts, reused %u", created_count, reused_count);
+
+	for (const auto & entry : pipeline_layouts)
+	{
+		device->device.destroyPipelineLayout(entry.second.layout);
+	}
+
+	for (const auto & entry : set_layouts)
+	{
+		device->device.destroyDescriptorSetLayout(entry.second.layout);
+	}
+}
+
+vk::DescriptorSetLayout GraphicsLayoutCache::get_descriptor_set_layout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t hash = hash_bindings(bindings);
+
+	auto range = set_layouts.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.bindings == bindings)
+		{
+			reused_count++;
+			return it->second.layout;
+		}
+	}
+
+	vk::DescriptorSetLayoutCreateInfo create_info(
+		vk::DescriptorSetLayoutCreateFlags(0),
+		(uint32_t)bindings.size(), bindings.data()
+	);
+
+	vk::DescriptorSetLayout layout = device->device.createDescriptorSetLayout(create_info);
+	auto entry = set_layouts.emplace(hash, SetLayout{ bindings, layout });
+	set_layouts_by_handle[(VkDescriptorSetLayout) layout] = &entry->second;
+	created_count++;
+
+	return layout;
+}
+
+std::vector<vk::DescriptorSetLayoutBinding> GraphicsLayoutCache::get_descriptor_set_bindings(vk::DescriptorSetLayout layout)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = set_layouts_by_handle.find((VkDescriptorSetLayout) layout);
+	if (it == set_layouts_by_handle.end())
+	{
+		throw std::exception("Descriptor set layout not from the layout cache");
+	}
+
+	return it->second->bindings;
+}
+
+vk::PipelineLayout GraphicsLayoutCache::get_pipeline_layout(vk::DescriptorSetLayout set_layout, const std::vector<vk::PushConstantRange>& push_constant_ranges)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t hash = hash_pipeline_layout(set_layout, push_constant_ranges);
+
+	auto range = pipeline_layouts.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.set_layout == set_layout && it->second.push_constant_ranges == push_constant_ranges)
+		{
+			reused_count++;
+			return it->second.layout;
+		}
+	}
+
+	vk::PipelineLayoutCreateInfo create_info(
+		vk::PipelineLayoutCreateFlags(0),
+		1, &set_layout,
+		(uint32_t)push_constant_ranges.size(), push_constant_ranges.data()
+	);
+
+	vk::PipelineLayout layout = device->device.createPipelineLayout(create_info);
+	pipeline_layouts.emplace(hash, PipelineLayout{ set_layout, push_constant_ranges, layout });
+	created_count++;
+
+	return layout;
+}
@@ -1,4 +1,4 @@
-/******************************************************************************
+﻿/******************************************************************************
 * Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
 *                                                                            *
 * Permission is hereby granted, free of charge, to any person obtaining a    *
@@ -22,32 +22,98 @@
 
 #include "g_pipeline.h"
 
+#include <chrono>
+
 #include "u_debug.h"
 #include "u_defines.h"
 
 // #define IGNORE_PIPELINE_CACHE 1
 
-GraphicsPipeline::GraphicsPipeline(std::shared_ptr<GraphicsDevice>& device, vk::PipelineCache cache, vk::GraphicsPipelineCreateInfo create_info, vk::PipelineLayout pipeline_layout, vk::DescriptorSet descriptor_set, vk::DescriptorSetLayout descriptor_set_layout)
-	:  device(device), pipeline_layout(pipeline_layout), descriptor_set(descriptor_set), descriptor_set_layout(descriptor_set_layout)
+GraphicsPipeline::GraphicsPipeline(std::shared_ptr<GraphicsDevice>& device, vk::Pipeline pipeline, vk::PipelineLayout pipeline_layout, vk::DescriptorSet descriptor_set, vk::DescriptorSetLayout descriptor_set_layout)
+	:  device(device), pipeline(pipeline), pipeline_layout(pipeline_layout), descriptor_set(descriptor_set), descriptor_set_layout(descriptor_set_layout)
+{
+}
+
+GraphicsPipeline::GraphicsPipeline(std::shared_ptr<GraphicsDevice>& device, std::shared_future<vk::Pipeline> pending, std::shared_ptr<GraphicsPipeline> fallback, vk::PipelineLayout pipeline_layout, vk::DescriptorSet descriptor_set, vk::DescriptorSetLayout descriptor_set_layout)
+	:  device(device), pending(pending), fallback(fallback), pipeline_layout(pipeline_layout), descriptor_set(descriptor_set), descriptor_set_layout(descriptor_set_layout)
+{
+	DEBUG_ASSERT(fallback && fallback->is_ready());
+}
+
+GraphicsPipeline::~GraphicsPipeline()
+{
+	/* The compile job may still be using the layout */
+	this->wait();
+
+	if (pending.valid())
+	{
+		pipeline = pending.get();
+	}
+
+	/* Layouts belong to the device's layout cache */
+	vk::Device vk_device = device->device;
+	vk::Pipeline pipeline = this->pipeline;
+
+	device->retire_queue->retire([vk_device, pipeline]() {
+		vk_device.destroyPipeline(pipeline);
+	});
+}
+
+vk::Pipeline GraphicsPipeline::compile(vk::Device device, vk::PipelineCache cache, const vk::GraphicsPipelineCreateInfo& create_info)
 {
 #ifndef IGNORE_PIPELINE_CACHE
-	pipeline = device->device.createGraphicsPipeline(cache, create_info);
+	return device.createGraphicsPipeline(cache, create_info);
 #else
-	pipeline = device->device.createGraphicsPipeline(vk::PipelineCache(), create_info);
+	return device.createGraphicsPipeline(vk::PipelineCache(), create_info);
 #endif
 }
 
-GraphicsPipeline::~GraphicsPipeline()
+bool GraphicsPipeline::is_ready() const
+{
+	if (!pending.valid())
+	{
+		return true;
+	}
+
+	if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		return false;
+	}
+
+	pipeline = pending.get();
+	pending = std::shared_future<vk::Pipeline>();
+	return true;
+}
+
+void GraphicsPipeline::wait() const
 {
-	device->device.destroyPipeline(pipeline);
-	device->device.destroyPipelineLayout(pipeline_layout);
-	device->device.destroyDescriptorSetLayout(descriptor_set_layout);
+	if (pending.valid())
+	{
+		pending.wait();
+	}
+}
+
+void GraphicsPipeline::bind_pipeline(vk::CommandBuffer cmd, const std::vector<uint32_t>& dynamic_offsets) const
+{
+	if (this->is_ready() && pipeline)
+	{
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+	}
+	else
+	{
+		/* Still compiling or failed to, the fallback is always ready */
+		fallback->bind_pipeline(cmd, dynamic_offsets);
+	}
+
+	if (descriptor_set)
+	{
+		this->bind_descriptor_set(cmd, descriptor_set, dynamic_offsets);
+	}
 }
 
-void GraphicsPipeline::bind_pipeline(vk::CommandBuffer cmd) const
+void GraphicsPipeline::bind_descriptor_set(vk::CommandBuffer cmd, vk::DescriptorSet set, const std::vector<uint32_t>& dynamic_offsets) const
 {
-	cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, 1, &set, (uint32_t) dynamic_offsets.size(), dynamic_offsets.data());
 }
 
 void GraphicsPipeline::push_shader_data(vk::CommandBuffer cmd, int offset, vk::ShaderStageFlagBits stage, size_t size, void* data) const
@@ -55,11 +121,11 @@ void GraphicsPipeline::push_shader_data(vk::CommandBuffer cmd, int offset, vk::S
 	cmd.pushConstants(pipeline_layout, stage, offset, (uint32_t)size, data);
 }
 
-void GraphicsPipeline::update_descriptor_sets(std::vector<vk::WriteDescriptorSet> writes) const
+void GraphicsPipeline::update_descriptor_sets(std::vector<vk::WriteDescriptorSet> writes, vk::DescriptorSet set) const
 {
 	for (auto &write : writes)
 	{
-		write.dstSet = descriptor_set;
+		write.dstSet = set ? set : descriptor_set;
         LOG_INFO("Updating descriptor %d:%d (type = %d)", write.dstSet, write.dstBinding, write.descriptorType);
 	}
 
@@ -24,9 +24,10 @@
 #include "g_shader.h"
 #include "g_shaderif.h"
 #include "u_debug.h"
+#include "u_hash.h"
 
-GraphicsPipelineBuilder::GraphicsPipelineBuilder(std::shared_ptr<GraphicsDevice>& device, vk::DescriptorPool descriptor_pool)
-	: device(device), descriptor_pool(descriptor_pool)
+GraphicsPipelineBuilder::GraphicsPipelineBuilder(std::shared_ptr<GraphicsDevice>& device)
+	: device(device)
 {
 }
 
@@ -34,12 +35,141 @@ GraphicsPipelineBuilder::~GraphicsPipelineBuilder()
 {
 }
 
-std::unique_ptr<GraphicsPipeline> GraphicsPipelineBuilder::create_pipeline(vk::PipelineCache cache, std::unique_ptr<GraphicsPipelineCreateInfo> create_info, vk::RenderPass renderpass)
+std::size_t GraphicsPipelineCreateInfo::hash() const
 {
-    LOG_INFO("Creating new pipeline (vertex_shader=%s,fragment_shader=%s)", create_info->vertex_shader.get_shader_name().c_str(), create_info->fragment_shader.get_shader_name().c_str());
+    std::size_t seed = 0;
 
-    std::vector<vk::VertexInputBindingDescription> vertex_input_bindings = Vertex::get_vertex_input_bindings();
-    std::vector<vk::VertexInputAttributeDescription> vertex_input_attributes = Vertex::get_vertex_input_attributes();
+    hash_combine(seed, vertex_shader.get_shader_name());
+    hash_combine(seed, fragment_shader.get_shader_name());
+    hash_combine(seed, (uint32_t) vertex_format);
+    hash_combine(seed, (uint32_t) primitive_topology);
+    hash_combine(seed, (VkFlags) dynamic_states);
+
+    for (const auto & viewport : viewports)
+    {
+        hash_combine(seed, viewport.x);
+        hash_combine(seed, viewport.y);
+        hash_combine(seed, viewport.width);
+        hash_combine(seed, viewport.height);
+        hash_combine(seed, viewport.minDepth);
+        hash_combine(seed, viewport.maxDepth);
+    }
+
+    for (const auto & scissor : scissors)
+    {
+        hash_combine(seed, scissor.offset.x);
+        hash_combine(seed, scissor.offset.y);
+        hash_combine(seed, scissor.extent.width);
+        hash_combine(seed, scissor.extent.height);
+    }
+
+    hash_handle(seed, descriptor_set);
+    hash_handle(seed, descriptor_set_layout);
+    hash_handle(seed, pipeline_layout);
+
+    for (const auto & binding : set_bindings)
+    {
+        hash_combine(seed, binding.binding);
+        hash_combine(seed, (uint32_t) binding.descriptorType);
+        hash_combine(seed, binding.descriptorCount);
+        hash_combine(seed, (VkFlags) binding.stageFlags);
+    }
+
+    for (const auto & range : push_constant_ranges)
+    {
+        hash_combine(seed, (VkFlags) range.stageFlags);
+        hash_combine(seed, range.offset);
+        hash_combine(seed, range.size);
+    }
+
+    hash_combine(seed, depth_enable);
+    hash_handle(seed, renderpass);
+    hash_combine(seed, subpass);
+
+    for (const auto & attachment : color_attachments)
+    {
+        hash_combine(seed, (uint32_t) attachment.blendEnable);
+        hash_combine(seed, (uint32_t) attachment.srcColorBlendFactor);
+        hash_combine(seed, (uint32_t) attachment.dstColorBlendFactor);
+        hash_combine(seed, (uint32_t) attachment.colorBlendOp);
+        hash_combine(seed, (uint32_t) attachment.srcAlphaBlendFactor);
+        hash_combine(seed, (uint32_t) attachment.dstAlphaBlendFactor);
+        hash_combine(seed, (uint32_t) attachment.alphaBlendOp);
+        hash_combine(seed, (VkFlags) attachment.colorWriteMask);
+    }
+
+    return seed;
+}
+
+bool GraphicsPipelineCreateInfo::operator==(const GraphicsPipelineCreateInfo& other) const
+{
+    return vertex_shader.get_shader_name() == other.vertex_shader.get_shader_name() &&
+        fragment_shader.get_shader_name() == other.fragment_shader.get_shader_name() &&
+        vertex_format == other.vertex_format &&
+        primitive_topology == other.primitive_topology &&
+        dynamic_states == other.dynamic_states &&
+        viewports == other.viewports &&
+        scissors == other.scissors &&
+        descriptor_set == other.descriptor_set &&
+        descriptor_set_layout == other.descriptor_set_layout &&
+        pipeline_layout == other.pipeline_layout &&
+        set_bindings == other.set_bindings &&
+        push_constant_ranges == other.push_constant_ranges &&
+        depth_enable == other.depth_enable &&
+        renderpass == other.renderpass &&
+        subpass == other.subpass &&
+        color_attachments == other.color_attachments;
+}
+
+bool GraphicsPipelineCreateInfo::is_interface_compatible(const GraphicsPipelineCreateInfo& other) const
+{
+    /* Layouts given by the caller can't be compared by definition */
+    return !pipeline_layout && !other.pipeline_layout &&
+        vertex_format == other.vertex_format &&
+        primitive_topology == other.primitive_topology &&
+        dynamic_states == other.dynamic_states &&
+        set_bindings == other.set_bindings &&
+        push_constant_ranges == other.push_constant_ranges &&
+        depth_enable == other.depth_enable &&
+        renderpass == other.renderpass &&
+        subpass == other.subpass &&
+        color_attachments.size() == other.color_attachments.size();
+}
+
+std::unique_ptr<GraphicsPipeline> GraphicsPipelineBuilder::create_pipeline(vk::PipelineCache cache, const GraphicsPipelineCreateInfo& create_info, vk::RenderPass renderpass)
+{
+    vk::DescriptorSetLayout descriptor_set_layout;
+    vk::PipelineLayout pipeline_layout;
+
+    this->create_layouts(create_info, &descriptor_set_layout, &pipeline_layout);
+
+    vk::Pipeline pipeline = compile_pipeline(device->device, cache, create_info, pipeline_layout);
+
+	return std::make_unique<GraphicsPipeline>(device, pipeline, pipeline_layout, create_info.descriptor_set, descriptor_set_layout);
+}
+
+void GraphicsPipelineBuilder::create_layouts(const GraphicsPipelineCreateInfo& create_info, vk::DescriptorSetLayout *descriptor_set_layout, vk::PipelineLayout *pipeline_layout) const
+{
+    *descriptor_set_layout = create_info.descriptor_set_layout;
+    *pipeline_layout = create_info.pipeline_layout;
+
+    if (!*descriptor_set_layout)
+    {
+        *descriptor_set_layout = device->layout_cache->get_descriptor_set_layout(create_info.set_bindings);
+    }
+
+    if (!*pipeline_layout)
+    {
+        *pipeline_layout = device->layout_cache->get_pipeline_layout(*descriptor_set_layout, create_info.push_constant_ranges);
+    }
+}
+
+vk::Pipeline GraphicsPipelineBuilder::compile_pipeline(vk::Device device, vk::PipelineCache cache, const GraphicsPipelineCreateInfo& create_info, vk::PipelineLayout pipeline_layout)
+{
+    LOG_INFO("Creating new pipeline (vertex_shader=%s,fragment_shader=%s)", create_info.vertex_shader.get_shader_name().c_str(), create_info.fragment_shader.get_shader_name().c_str());
+
+    std::vector<vk::VertexInputBindingDescription> vertex_input_bindings = get_vertex_input_bindings(create_info.vertex_format);
+    std::vector<vk::VertexInputAttributeDescription> vertex_input_attributes = get_vertex_input_attributes(create_info.vertex_format);
 
     vk::PipelineVertexInputStateCreateInfo vertex_input(
         vk::PipelineVertexInputStateCreateFlags(0),
@@ -49,14 +179,14 @@ std::unique_ptr<GraphicsPipeline> GraphicsPipelineBuilder::create_pipeline(vk::P
 
     vk::PipelineInputAssemblyStateCreateInfo input_assembly(
         vk::PipelineInputAssemblyStateCreateFlags(0),
-        create_info->primitive_topology,
+        create_info.primitive_topology,
         false
     );
 
     vk::PipelineShaderStageCreateInfo vertex_stage(
         vk::PipelineShaderStageCreateFlags(0),
         vk::ShaderStageFlagBits::eVertex,
-        (vk::ShaderModule) create_info->vertex_shader,
+        (vk::ShaderModule) create_info.vertex_shader,
         "main"
     );
 
@@ -66,8 +196,8 @@ std::unique_ptr<GraphicsPipeline> GraphicsPipelineBuilder::create_pipeline(vk::P
     );
 
     // Will be dynamically set
-    std::vector<vk::Viewport> viewports = create_info->viewports;
-    std::vector<vk::Rect2D> scissors = create_info->scissors;
+    std::vector<vk::Viewport> viewports = create_info.viewports;
+    std::vector<vk::Rect2D> scissors = create_info.scissors;
 
     vk::PipelineViewportStateCreateInfo viewport(
         vk::PipelineViewportStateCreateFlags(0),
@@ -94,7 +224,7 @@ std::unique_ptr<GraphicsPipeline> GraphicsPipelineBuilder::create_pipeline(vk::P
     vk::PipelineShaderStageCreateInfo frag_stage(
         vk::PipelineShaderStageCreateFlags(0),
         vk::ShaderStageFlagBits::eFragment,
-        (vk::ShaderModule) create_info->fragment_shader,
+        (vk::ShaderModule) create_info.fragment_shader,
         "main"
     );
 
@@ -110,13 +240,13 @@ std::unique_ptr<GraphicsPipeline> GraphicsPipelineBuilder::create_pipeline(vk::P
     vk::PipelineColorBlendStateCreateInfo color_blend(
         vk::PipelineColorBlendStateCreateFlags(0),
         false, vk::LogicOp::eClear,
-        (uint32_t)create_info->color_attachments.size(), create_info->color_attachments.data(),
+        (uint32_t)create_info.color_attachments.size(), create_info.color_attachments.data(),
         std::array<float, 4>{}
     );
 
     std::vector<vk::PipelineShaderStageCreateInfo> shader_stages = { vertex_stage, frag_stage };
 
-    std::vector<vk::DynamicState> dynamic_states = GraphicsPipeline::get_dynamic_states(create_info->dynamic_states);
+    std::vector<vk::DynamicState> dynamic_states = GraphicsPipeline::get_dynamic_states(create_info.dynamic_states);
     vk::PipelineDynamicStateCreateInfo dynamic_state(
         vk::PipelineDynamicStateCreateFlags(0),
         (uint32_t)dynamic_states.size(), dynamic_states.data()
@@ -138,7 +268,7 @@ std::unique_ptr<GraphicsPipeline> GraphicsPipelineBuilder::create_pipeline(vk::P
     vk_create_info.pColorBlendState = &color_blend;
     vk_create_info.pDynamicState = dynamic_states.size() > 0 ? &dynamic_state : nullptr;
 
-    if (create_info->depth_enable)
+    if (create_info.depth_enable)
     {
         vk_create_info.pDepthStencilState = &depth_stencil;
     }
@@ -147,11 +277,11 @@ std::unique_ptr<GraphicsPipeline> GraphicsPipelineBuilder::create_pipeline(vk::P
         vk_create_info.pDepthStencilState = nullptr;
     }
 
-    vk_create_info.layout = create_info->pipeline_layout;
+    vk_create_info.layout = pipeline_layout;
 
-    vk_create_info.renderPass = create_info->renderpass;
-    vk_create_info.subpass = create_info->subpass;
+    vk_create_info.renderPass = create_info.renderpass;
+    vk_create_info.subpass = create_info.subpass;
     vk_create_info.basePipelineHandle = vk::Pipeline();
 
-	return std::make_unique<GraphicsPipeline>(device, cache, vk_create_info, create_info->pipeline_layout, create_info->descriptor_set, create_info->descriptor_set_layout);
+    return GraphicsPipeline::compile(device, cache, vk_create_info);
 }
@@ -21,32 +21,327 @@
 ******************************************************************************/
 
 #include "g_pipeline_cache.h"
+#include "u_debug.h"
 #include "u_defines.h"
+#include "u_io.h"
 
+#include <chrono>
+#include <cstring>
+#include <iostream>
 
-GraphicsPipelineCache::GraphicsPipelineCache(std::shared_ptr<GraphicsDevice> device, vk::DescriptorPool descriptor_pool)
-	: device(device), pipeline_builder(device, descriptor_pool)
+#define PIPELINE_CACHE_STATS_MAGIC 0x53435050 /* "PPCS" */
+
+/* Matches VkPipelineCacheHeaderVersionOne, which every cache blob starts with */
+struct PipelineCacheHeader
+{
+	uint32_t header_size;
+	uint32_t header_version;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint8_t uuid[VK_UUID_SIZE];
+};
+
+struct PipelineCacheStats
 {
+	uint32_t magic;
+	uint32_t pipeline_count;
+	uint64_t compile_microseconds;
+};
+
+GraphicsPipelineCache::GraphicsPipelineCache(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<ThreadPool> thread_pool)
+	: device(device), pipeline_builder(device), thread_pool(thread_pool), loaded_from_disk(false), pipeline_count(0), reused_count(0), compile_microseconds(0),
+	  cold_pipeline_count(0), cold_compile_microseconds(0)
+{
+	file_data cache_data = { 0, nullptr };
+
+	if (read_file(PIPELINE_CACHE_FILE, &cache_data))
+	{
+		loaded_from_disk = this->is_cache_compatible(cache_data.data, cache_data.size);
+
+		if (!loaded_from_disk)
+		{
+			LOG_WARN("Discarding pipeline cache from a different device or driver");
+		}
+	}
+
 	vk::PipelineCacheCreateInfo create_info(
 		vk::PipelineCacheCreateFlags(0),
-		0, nullptr
+		loaded_from_disk ? cache_data.size : 0,
+		loaded_from_disk ? cache_data.data : nullptr
 	);
 
 	pipeline_cache = device->device.createPipelineCache(create_info);
+
+	if (loaded_from_disk)
+	{
+		LOG_INFO("Loaded pipeline cache (%zu bytes)", cache_data.size);
+	}
+
+	free_file(&cache_data);
+
+	file_data stats_data = { 0, nullptr };
+
+	if (loaded_from_disk && read_file(PIPELINE_CACHE_STATS_FILE, &stats_data))
+	{
+		PipelineCacheStats stats;
+
+		if (stats_data.size == sizeof(stats))
+		{
+			memcpy(&stats, stats_data.data, sizeof(stats));
+
+			if (stats.magic == PIPELINE_CACHE_STATS_MAGIC)
+			{
+				cold_pipeline_count = stats.pipeline_count;
+				cold_compile_microseconds = stats.compile_microseconds;
+			}
+		}
+
+		free_file(&stats_data);
+	}
 }
 
 GraphicsPipelineCache::~GraphicsPipelineCache()
 {
+	/* Compile jobs use the driver cache and report their time here */
+	this->wait_compiling_pipelines();
+
+	this->report_compile_time();
+	this->save();
+
 	device->device.destroyPipelineCache(pipeline_cache);
 }
 
-std::unique_ptr<GraphicsPipeline> GraphicsPipelineCache::create_pipeline(std::unique_ptr<GraphicsPipelineCreateInfo> create_info, vk::RenderPass renderpass)
+void GraphicsPipelineCache::save() const
+{
+	std::vector<uint8_t> data = device->device.getPipelineCacheData(pipeline_cache);
+
+	if (data.empty())
+	{
+		return;
+	}
+
+	/* write_file goes through a temporary, an interrupted save keeps the old cache */
+	if (!write_file(PIPELINE_CACHE_FILE, data.data(), data.size()))
+	{
+		LOG_WARN("Failed to save pipeline cache");
+	}
+}
+
+void GraphicsPipelineCache::report_compile_time() const
+{
+	double compile_ms = compile_microseconds / 1000.0;
+
+	if (!loaded_from_disk)
+	{
+		/* Kept for the next, warm, run to compare against */
+		PipelineCacheStats stats = { PIPELINE_CACHE_STATS_MAGIC, pipeline_count, compile_microseconds };
+
+		if (pipeline_count > 0 && !write_file(PIPELINE_CACHE_STATS_FILE, &stats, sizeof(stats)))
+		{
+			LOG_WARN("Failed to save pipeline cache stats");
+		}
+
+		std::cerr << "Pipeline cache: " << pipeline_count << " pipelines compiled cold in "
+			<< compile_ms << " ms, reused " << reused_count << std::endl;
+		return;
+	}
+
+	std::cerr << "Pipeline cache: " << pipeline_count << " pipelines compiled warm in " << compile_ms << " ms";
+
+	if (cold_pipeline_count > 0)
+	{
+		double cold_ms = cold_compile_microseconds / 1000.0;
+
+		std::cerr << ", " << cold_pipeline_count << " took " << cold_ms << " ms cold, saving "
+			<< cold_ms - compile_ms << " ms";
+	}
+
+	std::cerr << ", reused " << reused_count << std::endl;
+}
+
+bool GraphicsPipelineCache::is_cache_compatible(const void *data, size_t size) const
+{
+	PipelineCacheHeader header;
+
+	if (size < sizeof(header))
+	{
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+
+	vk::PhysicalDeviceProperties properties = device->physical_deivce.getProperties();
+
+	return header.header_size >= sizeof(header) &&
+		header.header_version == (uint32_t) VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header.vendor_id == properties.vendorID &&
+		header.device_id == properties.deviceID &&
+		memcmp(header.uuid, &properties.pipelineCacheUUID[0], VK_UUID_SIZE) == 0;
+}
+
+std::shared_ptr<GraphicsPipeline> GraphicsPipelineCache::create_pipeline(std::unique_ptr<GraphicsPipelineCreateInfo> create_info, vk::RenderPass renderpass)
+{
+	std::size_t hash = this->hash_pipeline_info(*create_info);
+
+	std::shared_ptr<GraphicsPipeline> pipeline = this->find_pipeline(*create_info, hash);
+	if (pipeline)
+	{
+		return pipeline;
+	}
+
+	this->prune_pipelines();
+
+	auto start = std::chrono::steady_clock::now();
+
+	pipeline = pipeline_builder.create_pipeline(pipeline_cache, *create_info, renderpass);
+
+	pipeline_count++;
+	compile_microseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+	pipelines.emplace(hash, CachedPipeline{ std::move(create_info), pipeline });
+
+	return pipeline;
+}
+
+std::shared_ptr<GraphicsPipeline> GraphicsPipelineCache::create_pipeline_async(std::unique_ptr<GraphicsPipelineCreateInfo> create_info, vk::RenderPass renderpass)
+{
+	std::size_t hash = this->hash_pipeline_info(*create_info);
+
+	std::shared_ptr<GraphicsPipeline> pipeline = this->find_pipeline(*create_info, hash);
+	if (pipeline)
+	{
+		return pipeline;
+	}
+
+	std::shared_ptr<GraphicsPipeline> fallback = this->find_fallback(*create_info);
+	if (!fallback)
+	{
+		return this->create_pipeline(std::move(create_info), renderpass);
+	}
+
+	this->prune_pipelines();
+
+	/* Layouts are cheap and needed now, callers allocate descriptor sets against them */
+	vk::DescriptorSetLayout descriptor_set_layout;
+	vk::PipelineLayout pipeline_layout;
+	pipeline_builder.create_layouts(*create_info, &descriptor_set_layout, &pipeline_layout);
+
+	std::shared_ptr<GraphicsPipelineCreateInfo> shared_info = std::move(create_info);
+	vk::Device vk_device = device->device;
+	vk::PipelineCache cache = pipeline_cache;
+
+	std::shared_future<vk::Pipeline> pending = thread_pool->submit([this, vk_device, cache, shared_info, pipeline_layout]() {
+		auto start = std::chrono::steady_clock::now();
+		vk::Pipeline compiled;
+
+		try
+		{
+			compiled = GraphicsPipelineBuilder::compile_pipeline(vk_device, cache, *shared_info, pipeline_layout);
+		}
+		catch (const std::exception& e)
+		{
+			LOG_ERROR("Pipeline compile failed, keeping the fallback: %s", e.what());
+		}
+
+		compile_microseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		return compiled;
+	}).share();
+
+	pipeline = std::make_shared<GraphicsPipeline>(device, pending, fallback, pipeline_layout, shared_info->descriptor_set, descriptor_set_layout);
+
+	pipeline_count++;
+	compiling_pipelines.push_back(pipeline);
+	pipelines.emplace(hash, CachedPipeline{ shared_info, pipeline });
+
+	return pipeline;
+}
+
+uint32_t GraphicsPipelineCache::process_compiled_pipelines()
 {
-	return pipeline_builder.create_pipeline(pipeline_cache, std::move(create_info), renderpass);
+	uint32_t compiled = 0;
+
+	for (auto it = compiling_pipelines.begin(); it != compiling_pipelines.end();)
+	{
+		std::shared_ptr<GraphicsPipeline> pipeline = it->lock();
+
+		if (!pipeline || pipeline->is_ready())
+		{
+			compiled += pipeline ? 1 : 0;
+			it = compiling_pipelines.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	return compiled;
 }
 
-std::size_t GraphicsPipelineCache::hash_pipeline_info(GraphicsPipelineCreateInfo create_info)
+std::shared_ptr<GraphicsPipeline> GraphicsPipelineCache::find_pipeline(const GraphicsPipelineCreateInfo& create_info, std::size_t hash)
+{
+	auto range = pipelines.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		std::shared_ptr<GraphicsPipeline> pipeline = it->second.pipeline.lock();
+
+		if (pipeline && *it->second.create_info == create_info)
+		{
+			reused_count++;
+			return pipeline;
+		}
+	}
+
+	return nullptr;
+}
+
+std::shared_ptr<GraphicsPipeline> GraphicsPipelineCache::find_fallback(const GraphicsPipelineCreateInfo& create_info) const
+{
+	for (const auto & entry : pipelines)
+	{
+		std::shared_ptr<GraphicsPipeline> pipeline = entry.second.pipeline.lock();
+
+		if (pipeline && pipeline->is_ready() && entry.second.create_info->is_interface_compatible(create_info))
+		{
+			return pipeline;
+		}
+	}
+
+	return nullptr;
+}
+
+void GraphicsPipelineCache::wait_compiling_pipelines()
+{
+	for (const auto & entry : compiling_pipelines)
+	{
+		std::shared_ptr<GraphicsPipeline> pipeline = entry.lock();
+
+		if (pipeline)
+		{
+			pipeline->wait();
+		}
+	}
+
+	compiling_pipelines.clear();
+}
+
+std::size_t GraphicsPipelineCache::hash_pipeline_info(const GraphicsPipelineCreateInfo& create_info) const
 {
 	return std::hash<GraphicsPipelineCreateInfo>{}(create_info);
 }
 
+void GraphicsPipelineCache::prune_pipelines()
+{
+	for (auto it = pipelines.begin(); it != pipelines.end();)
+	{
+		if (it->second.pipeline.expired())
+		{
+			it = pipelines.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
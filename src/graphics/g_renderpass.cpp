@@ -27,14 +27,12 @@
 #include "g_shaderif.h"
 #include "u_debug.h"
 
-GraphicsRenderpass::GraphicsRenderpass(std::shared_ptr<GraphicsDevice>& device, vk::DescriptorPool descriptor_pool) : created(false), device(device), pipeline_cache(device, descriptor_pool)
+GraphicsRenderpass::GraphicsRenderpass(std::shared_ptr<GraphicsDevice>& device, std::shared_ptr<ThreadPool> thread_pool) : created(false), device(device), pipeline_cache(device, thread_pool)
 {
 }
 
 GraphicsRenderpass::~GraphicsRenderpass()
 {
-    parent.destroyDescriptorPool(descriptor_pool);
-
 	if (created)
 	{
 		parent.destroyRenderPass(renderpass);
@@ -112,7 +110,7 @@ void GraphicsRenderpass::end_renderpass(vk::CommandBuffer command_buffer) const
 	command_buffer.endRenderPass();
 }
 
-std::unique_ptr<GraphicsPipeline> GraphicsRenderpass::create_pipeline(std::unique_ptr<GraphicsPipelineCreateInfo> create_info)
+std::shared_ptr<GraphicsPipeline> GraphicsRenderpass::create_pipeline(std::unique_ptr<GraphicsPipelineCreateInfo> create_info)
 {
     create_info->renderpass = renderpass;
 	return pipeline_cache.create_pipeline(
@@ -120,3 +118,17 @@ std::unique_ptr<GraphicsPipeline> GraphicsRenderpass::create_pipeline(std::uniqu
         renderpass
 	);
 }
+
+std::shared_ptr<GraphicsPipeline> GraphicsRenderpass::create_pipeline_async(std::unique_ptr<GraphicsPipelineCreateInfo> create_info)
+{
+    create_info->renderpass = renderpass;
+	return pipeline_cache.create_pipeline_async(
+		std::move(create_info),
+        renderpass
+	);
+}
+
+uint32_t GraphicsRenderpass::process_compiled_pipelines()
+{
+	return pipeline_cache.process_compiled_pipelines();
+}
@@ -0,0 +1,104 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "g_retire_queue.h"
+
+#include <algorithm>
+
+#include "g_device.h"
+#include "u_debug.h"
+
+GraphicsRetireQueue::GraphicsRetireQueue(GraphicsDevice *device)
+	: device(device), serial(0)
+{
+}
+
+GraphicsRetireQueue::~GraphicsRetireQueue()
+{
+	this->flush();
+}
+
+void GraphicsRetireQueue::retire(std::function<void()> destroy)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	retired.push_back({ serial, std::move(destroy) });
+}
+
+void GraphicsRetireQueue::begin_frame(uint32_t frame)
+{
+	std::vector<std::function<void()>> expired;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (frame >= frame_serials.size())
+		{
+			frame_serials.resize(frame + 1, 0);
+		}
+
+		/* The slot's previous frame is done, this one is now in flight */
+		frame_serials[frame] = ++serial;
+
+		uint64_t oldest = serial;
+		for (uint64_t frame_serial : frame_serials)
+		{
+			if (frame_serial != 0)
+			{
+				oldest = std::min(oldest, frame_serial);
+			}
+		}
+
+		/* Anything retired while an older frame was recorded is no longer in use */
+		while (!retired.empty() && retired.front().serial < oldest)
+		{
+			expired.push_back(std::move(retired.front().destroy));
+			retired.pop_front();
+		}
+	}
+
+	/* Outside the lock, destroying may retire more */
+	for (const auto & destroy : expired)
+	{
+		destroy();
+	}
+}
+
+void GraphicsRetireQueue::flush()
+{
+	device->device.waitIdle();
+
+	std::deque<RetiredResource> expired;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		expired.swap(retired);
+	}
+
+	for (const auto & resource : expired)
+	{
+		resource.destroy();
+	}
+
+	if (!expired.empty())
+	{
+		LOG_INFO("Destroyed %zu retired resources", expired.size());
+	}
+}
@@ -22,27 +22,18 @@
 
 #include "g_shader.h"
 
-#include "u_io.h"
+#include "g_shader_cache.h"
 
 GraphicsShader::GraphicsShader(std::shared_ptr<GraphicsDevice>& device, std::string shader_file)
-	: device(device), shader_file(shader_file)
+	: shader_file(shader_file)
 {
-	file_data data;
-	if (!read_file(shader_file + ".spv", &data))
-	{
-		throw std::exception("Error creating shader");
-	}
+	/* The module is owned by the device's cache and shared between shaders */
+	const GraphicsShaderCache::Module& module = device->shader_cache->get_module(shader_file);
 
-	vk::ShaderModuleCreateInfo create_info(
-		vk::ShaderModuleCreateFlags(0),
-		data.size,
-		(uint32_t *)data.data
-	);
-
-	shader = device->device.createShaderModule(create_info);
+	shader = module.module;
+	reflection = &module.reflection;
 }
 
 GraphicsShader::~GraphicsShader()
 {
-	device->device.destroyShaderModule(shader);
 }
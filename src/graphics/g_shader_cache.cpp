@@ -0,0 +1,224 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "g_shader_cache.h"
+
+#include <cstring>
+#include <vector>
+
+#include "g_device.h"
+#include "u_debug.h"
+#include "u_io.h"
+
+#ifdef ENABLE_EMBEDDED_SHADERS
+#include "shaders/model.vert.spv.h"
+#include "shaders/model_packed.vert.spv.h"
+#include "shaders/model.frag.spv.h"
+#include "shaders/model_bindless.frag.spv.h"
+#include "shaders/standard.vert.spv.h"
+#include "shaders/standard.frag.spv.h"
+#include "shaders/deferred.vert.spv.h"
+#include "shaders/deferred.frag.spv.h"
+
+struct EmbeddedShader
+{
+	const char *name;
+	const uint8_t *code;
+	size_t size;
+};
+
+/* Names and prefixes must match resource_shader() in resources/CMakeLists.txt */
+static const EmbeddedShader embedded_shaders[] = {
+	{ "shaders/model.vert", g_shader_model_vert_code, g_shader_model_vert_size },
+	{ "shaders/model_packed.vert", g_shader_model_packed_vert_code, g_shader_model_packed_vert_size },
+	{ "shaders/model.frag", g_shader_model_frag_code, g_shader_model_frag_size },
+	{ "shaders/model_bindless.frag", g_shader_model_bindless_frag_code, g_shader_model_bindless_frag_size },
+	{ "shaders/standard.vert", g_shader_standard_vert_code, g_shader_standard_vert_size },
+	{ "shaders/standard.frag", g_shader_standard_frag_code, g_shader_standard_frag_size },
+	{ "shaders/deferred.vert", g_shader_deffered_vert_code, g_shader_deffered_vert_size },
+	{ "shaders/deferred.frag", g_shader_deffered_frag_code, g_shader_deffered_frag_size },
+};
+#endif
+
+bool find_embedded_shader(const std::string& name, const uint8_t **code, size_t *size)
+{
+#ifdef ENABLE_EMBEDDED_SHADERS
+	for (const auto & shader : embedded_shaders)
+	{
+		if (name == shader.name)
+		{
+			*code = shader.code;
+			*size = shader.size;
+			return true;
+		}
+	}
+#endif
+
+	return false;
+}
+
+static uint64_t hash_code(const void *code, size_t size)
+{
+	const uint8_t *bytes = (const uint8_t *) code;
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+GraphicsShaderCache::GraphicsShaderCache(GraphicsDevice *device)
+	: device(device), created_count(0), reused_count(0)
+{
+}
+
+GraphicsShaderCache::~GraphicsShaderCache()
+{
+	LOG_INFO("Created %u shader modules, reused %u", created_count, reused_count);
+
+	for (const auto & entry : modules_by_hash)
+	{
+		device->device.destroyShaderModule(entry.second.module);
+	}
+}
+
+const GraphicsShaderCache::Module& GraphicsShaderCache::get_module(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = modules_by_name.find(name);
+	if (it != modules_by_name.end())
+	{
+		reused_count++;
+		return *it->second;
+	}
+
+	this->load_modules_locked({ name });
+	return *modules_by_name[name];
+}
+
+void GraphicsShaderCache::load_modules(const std::vector<std::string>& names)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	this->load_modules_locked(names);
+}
+
+void GraphicsShaderCache::load_modules_locked(const std::vector<std::string>& names)
+{
+	std::vector<std::string> read_names;
+	std::vector<file_read_request> requests;
+
+	for (const auto & name : names)
+	{
+		if (modules_by_name.count(name) != 0)
+		{
+			continue;
+		}
+
+		const uint8_t *code;
+		size_t size;
+
+		if (find_embedded_shader(name, &code, &size))
+		{
+			modules_by_name[name] = &this->create_module(name, code, size);
+			continue;
+		}
+
+		read_names.push_back(name);
+		requests.push_back({ name + ".spv", { 0, nullptr }, false });
+	}
+
+	if (requests.empty())
+	{
+		return;
+	}
+
+	bool result = read_files(requests);
+
+	try
+	{
+		if (!result)
+		{
+			throw std::exception("Error creating shader");
+		}
+
+		for (size_t i = 0; i < requests.size(); i++)
+		{
+			if (modules_by_name.count(read_names[i]) == 0)
+			{
+				modules_by_name[read_names[i]] = &this->create_module(read_names[i], requests[i].data.data, requests[i].data.size);
+			}
+		}
+	}
+	catch (...)
+	{
+		for (auto & request : requests)
+		{
+			free_file(&request.data);
+		}
+
+		throw;
+	}
+
+	for (auto & request : requests)
+	{
+		free_file(&request.data);
+	}
+}
+
+const GraphicsShaderCache::Module& GraphicsShaderCache::create_module(const std::string& name, const void *code, size_t size)
+{
+	uint64_t hash = hash_code(code, size);
+
+	auto it = modules_by_hash.find(hash);
+	if (it != modules_by_hash.end())
+	{
+		reused_count++;
+		return it->second;
+	}
+
+	/* Embedded arrays are only byte aligned, Vulkan wants whole words */
+	std::vector<uint32_t> words((size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+	memcpy(words.data(), code, size);
+
+	Module module;
+	if (!reflect_shader(words.data(), size, &module.reflection))
+	{
+		throw std::exception("Error reflecting shader");
+	}
+
+	vk::ShaderModuleCreateInfo create_info(
+		vk::ShaderModuleCreateFlags(0),
+		size,
+		words.data()
+	);
+
+	LOG_INFO("Creating shader module %s", name.c_str());
+
+	module.module = device->device.createShaderModule(create_info);
+	created_count++;
+
+	return modules_by_hash[hash] = module;
+}
@@ -0,0 +1,493 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "g_shader_reflect.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "u_debug.h"
+
+#define SPIRV_MAGIC 0x07230203
+#define SPIRV_HEADER_WORDS 5
+
+/* The subset of the SPIR-V spec needed to find resources */
+enum SpirvOp
+{
+	SpirvOpEntryPoint = 15,
+	SpirvOpTypeInt = 21,
+	SpirvOpTypeFloat = 22,
+	SpirvOpTypeVector = 23,
+	SpirvOpTypeMatrix = 24,
+	SpirvOpTypeImage = 25,
+	SpirvOpTypeSampler = 26,
+	SpirvOpTypeSampledImage = 27,
+	SpirvOpTypeArray = 28,
+	SpirvOpTypeRuntimeArray = 29,
+	SpirvOpTypeStruct = 30,
+	SpirvOpTypePointer = 32,
+	SpirvOpConstant = 43,
+	SpirvOpVariable = 59,
+	SpirvOpDecorate = 71,
+	SpirvOpMemberDecorate = 72,
+};
+
+enum SpirvDecoration
+{
+	SpirvDecorationBufferBlock = 3,
+	SpirvDecorationArrayStride = 6,
+	SpirvDecorationMatrixStride = 7,
+	SpirvDecorationBinding = 33,
+	SpirvDecorationDescriptorSet = 34,
+	SpirvDecorationOffset = 35,
+};
+
+enum SpirvStorageClass
+{
+	SpirvStorageClassUniformConstant = 0,
+	SpirvStorageClassUniform = 2,
+	SpirvStorageClassPushConstant = 9,
+	SpirvStorageClassStorageBuffer = 12,
+};
+
+#define SPIRV_DIM_BUFFER 5
+#define SPIRV_DIM_SUBPASS_DATA 6
+
+struct SpirvId
+{
+	uint32_t opcode = 0;
+	std::vector<uint32_t> operands;
+
+	int32_t binding = -1;
+	int32_t set = -1;
+	uint32_t array_stride = 0;
+	bool buffer_block = false;
+
+	/* Per struct member */
+	std::vector<uint32_t> member_offsets;
+	std::vector<uint32_t> member_matrix_strides;
+};
+
+static vk::ShaderStageFlagBits get_execution_stage(uint32_t execution_model)
+{
+	switch (execution_model)
+	{
+	case 0: return vk::ShaderStageFlagBits::eVertex;
+	case 1: return vk::ShaderStageFlagBits::eTessellationControl;
+	case 2: return vk::ShaderStageFlagBits::eTessellationEvaluation;
+	case 3: return vk::ShaderStageFlagBits::eGeometry;
+	case 4: return vk::ShaderStageFlagBits::eFragment;
+	default: return vk::ShaderStageFlagBits::eCompute;
+	}
+}
+
+static bool is_recorded(const std::vector<SpirvId>& ids, uint32_t id)
+{
+	return id < ids.size() && ids[id].opcode != 0;
+}
+
+/*
+ * Every id a recorded type or value refers to must be in the module and
+ * recorded too, with the operands read from it, so the walks below never
+ * index past the table
+ */
+static bool validate_ids(const std::vector<SpirvId>& ids)
+{
+	for (const auto & id : ids)
+	{
+		switch (id.opcode)
+		{
+		case SpirvOpTypeInt:
+		case SpirvOpTypeFloat:
+			if (id.operands.size() < 1)
+			{
+				return false;
+			}
+			break;
+		case SpirvOpTypeVector:
+		case SpirvOpTypeMatrix:
+			if (id.operands.size() < 2 || !is_recorded(ids, id.operands[0]))
+			{
+				return false;
+			}
+			break;
+		case SpirvOpTypeImage:
+			if (id.operands.size() < 6)
+			{
+				return false;
+			}
+			break;
+		case SpirvOpTypeSampledImage:
+		case SpirvOpTypeRuntimeArray:
+			if (id.operands.size() < 1 || !is_recorded(ids, id.operands[0]))
+			{
+				return false;
+			}
+			break;
+		case SpirvOpTypeArray:
+			/* The length is the value of a constant */
+			if (id.operands.size() < 2 || !is_recorded(ids, id.operands[0]) ||
+				!is_recorded(ids, id.operands[1]) || ids[id.operands[1]].opcode != SpirvOpConstant)
+			{
+				return false;
+			}
+			break;
+		case SpirvOpTypeStruct:
+			for (uint32_t member : id.operands)
+			{
+				if (!is_recorded(ids, member))
+				{
+					return false;
+				}
+			}
+			break;
+		case SpirvOpTypePointer:
+			if (id.operands.size() < 2 || !is_recorded(ids, id.operands[1]))
+			{
+				return false;
+			}
+			break;
+		case SpirvOpConstant:
+		case SpirvOpVariable:
+			if (!is_recorded(ids, id.operands[0]))
+			{
+				return false;
+			}
+			break;
+		}
+	}
+
+	return true;
+}
+
+static uint32_t get_type_size(const std::vector<SpirvId>& ids, uint32_t type, uint32_t matrix_stride)
+{
+	const SpirvId& id = ids[type];
+
+	switch (id.opcode)
+	{
+	case SpirvOpTypeInt:
+	case SpirvOpTypeFloat:
+		return id.operands[0] / 8;
+	case SpirvOpTypeVector:
+		return get_type_size(ids, id.operands[0], 0) * id.operands[1];
+	case SpirvOpTypeMatrix:
+		return (matrix_stride ? matrix_stride : get_type_size(ids, id.operands[0], 0)) * id.operands[1];
+	case SpirvOpTypeArray:
+	{
+		uint32_t length = ids[id.operands[1]].operands[1];
+		uint32_t stride = id.array_stride ? id.array_stride : get_type_size(ids, id.operands[0], matrix_stride);
+		return stride * length;
+	}
+	case SpirvOpTypeStruct:
+	{
+		uint32_t size = 0;
+
+		for (size_t i = 0; i < id.operands.size(); i++)
+		{
+			uint32_t offset = i < id.member_offsets.size() ? id.member_offsets[i] : 0;
+			uint32_t stride = i < id.member_matrix_strides.size() ? id.member_matrix_strides[i] : 0;
+			size = std::max(size, offset + get_type_size(ids, id.operands[i], stride));
+		}
+
+		return size;
+	}
+	default:
+		return 0;
+	}
+}
+
+static bool get_descriptor_type(const std::vector<SpirvId>& ids, uint32_t type, uint32_t storage_class, vk::DescriptorType *descriptor_type)
+{
+	const SpirvId& id = ids[type];
+
+	switch (id.opcode)
+	{
+	case SpirvOpTypeSampledImage:
+		*descriptor_type = vk::DescriptorType::eCombinedImageSampler;
+		return true;
+	case SpirvOpTypeSampler:
+		*descriptor_type = vk::DescriptorType::eSampler;
+		return true;
+	case SpirvOpTypeImage:
+	{
+		uint32_t dim = id.operands[1];
+		bool storage = id.operands[5] == 2;
+
+		if (dim == SPIRV_DIM_SUBPASS_DATA)
+		{
+			*descriptor_type = vk::DescriptorType::eInputAttachment;
+		}
+		else if (dim == SPIRV_DIM_BUFFER)
+		{
+			*descriptor_type = storage ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+		}
+		else
+		{
+			*descriptor_type = storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+		}
+		return true;
+	}
+	case SpirvOpTypeStruct:
+		if (storage_class == SpirvStorageClassStorageBuffer || id.buffer_block)
+		{
+			*descriptor_type = vk::DescriptorType::eStorageBuffer;
+		}
+		else
+		{
+			/* Uniform blocks are all bound from the uniform ring */
+			*descriptor_type = vk::DescriptorType::eUniformBufferDynamic;
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool reflect_shader(const uint32_t *code, size_t size, ShaderReflection *reflection)
+{
+	size_t word_count = size / sizeof(uint32_t);
+
+	if (word_count < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC)
+	{
+		return false;
+	}
+
+	uint32_t bound = code[3];
+	std::vector<SpirvId> ids(bound);
+	std::vector<uint32_t> variables;
+	vk::ShaderStageFlagBits stage = vk::ShaderStageFlagBits::eVertex;
+
+	for (size_t i = SPIRV_HEADER_WORDS; i < word_count;)
+	{
+		uint32_t opcode = code[i] & 0xffff;
+		uint32_t length = code[i] >> 16;
+
+		if (length == 0 || i + length > word_count)
+		{
+			return false;
+		}
+
+		const uint32_t *operands = &code[i + 1];
+		uint32_t operand_count = length - 1;
+		i += length;
+
+		switch (opcode)
+		{
+		case SpirvOpEntryPoint:
+			if (operand_count >= 1)
+			{
+				stage = get_execution_stage(operands[0]);
+			}
+			break;
+		case SpirvOpTypeInt:
+		case SpirvOpTypeFloat:
+		case SpirvOpTypeVector:
+		case SpirvOpTypeMatrix:
+		case SpirvOpTypeImage:
+		case SpirvOpTypeSampler:
+		case SpirvOpTypeSampledImage:
+		case SpirvOpTypeArray:
+		case SpirvOpTypeRuntimeArray:
+		case SpirvOpTypeStruct:
+		case SpirvOpTypePointer:
+			if (operand_count < 1 || operands[0] >= bound)
+			{
+				return false;
+			}
+			ids[operands[0]].opcode = opcode;
+			ids[operands[0]].operands.assign(operands + 1, operands + operand_count);
+			break;
+		case SpirvOpConstant:
+		case SpirvOpVariable:
+			if (operand_count < 3 || operands[1] >= bound)
+			{
+				return false;
+			}
+			/* Kept as result type then value or storage class */
+			ids[operands[1]].opcode = opcode;
+			ids[operands[1]].operands = { operands[0], operands[2] };
+			if (opcode == SpirvOpVariable)
+			{
+				variables.push_back(operands[1]);
+			}
+			break;
+		case SpirvOpDecorate:
+			if (operand_count < 2 || operands[0] >= bound)
+			{
+				return false;
+			}
+			switch (operands[1])
+			{
+			case SpirvDecorationBinding:
+				ids[operands[0]].binding = operand_count > 2 ? (int32_t) operands[2] : -1;
+				break;
+			case SpirvDecorationDescriptorSet:
+				ids[operands[0]].set = operand_count > 2 ? (int32_t) operands[2] : -1;
+				break;
+			case SpirvDecorationArrayStride:
+				ids[operands[0]].array_stride = operand_count > 2 ? operands[2] : 0;
+				break;
+			case SpirvDecorationBufferBlock:
+				ids[operands[0]].buffer_block = true;
+				break;
+			}
+			break;
+		case SpirvOpMemberDecorate:
+			if (operand_count < 4 || operands[0] >= bound || operands[1] > 0xffff)
+			{
+				break;
+			}
+			if (operands[2] == SpirvDecorationOffset)
+			{
+				std::vector<uint32_t>& offsets = ids[operands[0]].member_offsets;
+				offsets.resize(std::max<size_t>(offsets.size(), operands[1] + 1));
+				offsets[operands[1]] = operands[3];
+			}
+			else if (operands[2] == SpirvDecorationMatrixStride)
+			{
+				std::vector<uint32_t>& strides = ids[operands[0]].member_matrix_strides;
+				strides.resize(std::max<size_t>(strides.size(), operands[1] + 1));
+				strides[operands[1]] = operands[3];
+			}
+			break;
+		}
+	}
+
+	if (!validate_ids(ids))
+	{
+		return false;
+	}
+
+	reflection->stages = stage;
+	reflection->set_bindings.clear();
+	reflection->push_constant_ranges.clear();
+
+	for (uint32_t variable : variables)
+	{
+		const SpirvId& id = ids[variable];
+		uint32_t storage_class = id.operands[1];
+
+		const SpirvId& pointer = ids[id.operands[0]];
+		if (pointer.opcode != SpirvOpTypePointer || pointer.operands.size() < 2)
+		{
+			continue;
+		}
+
+		uint32_t type = pointer.operands[1];
+
+		if (storage_class == SpirvStorageClassPushConstant)
+		{
+			const SpirvId& block = ids[type];
+			uint32_t offset = block.member_offsets.empty() ? 0 : *std::min_element(block.member_offsets.begin(), block.member_offsets.end());
+			uint32_t block_size = get_type_size(ids, type, 0);
+
+			reflection->push_constant_ranges.push_back(vk::PushConstantRange(stage, offset, block_size - offset));
+			continue;
+		}
+
+		if (storage_class != SpirvStorageClassUniformConstant &&
+			storage_class != SpirvStorageClassUniform &&
+			storage_class != SpirvStorageClassStorageBuffer)
+		{
+			continue;
+		}
+
+		if (id.set > 0)
+		{
+			LOG_WARN("Ignoring shader resource in descriptor set %d", id.set);
+			continue;
+		}
+
+		/* Unsized arrays are left with a count of zero, the caller knows how many it binds */
+		uint32_t count = 1;
+		if (ids[type].opcode == SpirvOpTypeArray)
+		{
+			count = ids[ids[type].operands[1]].operands[1];
+			type = ids[type].operands[0];
+		}
+		else if (ids[type].opcode == SpirvOpTypeRuntimeArray)
+		{
+			count = 0;
+			type = ids[type].operands[0];
+		}
+
+		vk::DescriptorType descriptor_type;
+		if (id.binding < 0 || !get_descriptor_type(ids, type, storage_class, &descriptor_type))
+		{
+			continue;
+		}
+
+		reflection->set_bindings.push_back(vk::DescriptorSetLayoutBinding((uint32_t) id.binding, descriptor_type, count, stage));
+	}
+
+	std::sort(reflection->set_bindings.begin(), reflection->set_bindings.end(), [](const vk::DescriptorSetLayoutBinding& a, const vk::DescriptorSetLayoutBinding& b) {
+		return a.binding < b.binding;
+	});
+
+	return true;
+}
+
+void ShaderReflection::merge(const ShaderReflection& other)
+{
+	stages |= other.stages;
+
+	for (const auto & binding : other.set_bindings)
+	{
+		auto it = std::find_if(set_bindings.begin(), set_bindings.end(), [&](const vk::DescriptorSetLayoutBinding& b) {
+			return b.binding == binding.binding;
+		});
+
+		if (it == set_bindings.end())
+		{
+			set_bindings.push_back(binding);
+		}
+		else if (it->descriptorType == binding.descriptorType && it->descriptorCount == binding.descriptorCount)
+		{
+			it->stageFlags |= binding.stageFlags;
+		}
+		else
+		{
+			throw std::exception("Shader stages disagree on a descriptor binding");
+		}
+	}
+
+	/* Stages sharing a block get one range, as Vulkan allows a stage in a single range only */
+	for (const auto & range : other.push_constant_ranges)
+	{
+		auto it = std::find_if(push_constant_ranges.begin(), push_constant_ranges.end(), [&](const vk::PushConstantRange& r) {
+			return r.offset == range.offset && r.size == range.size;
+		});
+
+		if (it == push_constant_ranges.end())
+		{
+			push_constant_ranges.push_back(range);
+		}
+		else
+		{
+			it->stageFlags |= range.stageFlags;
+		}
+	}
+
+	std::sort(set_bindings.begin(), set_bindings.end(), [](const vk::DescriptorSetLayoutBinding& a, const vk::DescriptorSetLayoutBinding& b) {
+		return a.binding < b.binding;
+	});
+}
@@ -0,0 +1,121 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "g_staging_ring.h"
+
+#include "g_device.h"
+#include "u_debug.h"
+#include "u_defines.h"
+
+static uint32_t find_host_memory_type(vk::PhysicalDevice physical_device, uint32_t type_bits)
+{
+    vk::MemoryPropertyFlags required = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    vk::PhysicalDeviceMemoryProperties properties = physical_device.getMemoryProperties();
+
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++)
+    {
+        if ((type_bits & (1 << i)) && (properties.memoryTypes[i].propertyFlags & required) == required)
+        {
+            return i;
+        }
+    }
+
+    throw std::exception("No host coherent memory for the staging ring.");
+}
+
+GraphicsStagingRing::GraphicsStagingRing(GraphicsDevice *device, VkDeviceSize size)
+    : device(device), size(size), head(0)
+{
+    buffer = device->device.createBuffer(vk::BufferCreateInfo(
+        vk::BufferCreateFlags(0),
+        size,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::SharingMode::eExclusive
+    ));
+
+    vk::MemoryRequirements requirements = device->device.getBufferMemoryRequirements(buffer);
+    memory = device->device.allocateMemory(vk::MemoryAllocateInfo(
+        requirements.size,
+        find_host_memory_type(device->physical_deivce, requirements.memoryTypeBits)
+    ));
+
+    device->device.bindBufferMemory(buffer, memory, 0);
+    mapped = (uint8_t *) device->device.mapMemory(memory, 0, size);
+
+    LOG_INFO("Allocated %llu byte staging ring", (unsigned long long) size);
+}
+
+GraphicsStagingRing::~GraphicsStagingRing()
+{
+    device->device.unmapMemory(memory);
+    device->device.destroyBuffer(buffer);
+    device->device.freeMemory(memory);
+}
+
+bool GraphicsStagingRing::allocate(VkDeviceSize region_size, VkDeviceSize alignment, GraphicsTransferTicket ticket, GraphicsStagingRegion *region)
+{
+    DEBUG_ASSERT(region_size <= size);
+
+    if (in_flight.empty())
+    {
+        head = 0;
+    }
+
+    VkDeviceSize tail = in_flight.empty() ? 0 : in_flight.front().begin;
+    VkDeviceSize offset = (head + alignment - 1) / alignment * alignment;
+
+    if (in_flight.empty() || head > tail)
+    {
+        /* Free space runs to the end, then wraps round to the oldest region */
+        if (offset + region_size > size)
+        {
+            offset = 0;
+
+            if (!in_flight.empty() && region_size > tail)
+            {
+                return false;
+            }
+        }
+    }
+    else if (offset + region_size > tail)
+    {
+        return false;
+    }
+
+    head = offset + region_size;
+
+    /* Consecutive regions of one batch retire together */
+    if (!in_flight.empty() && in_flight.back().ticket == ticket && in_flight.back().end <= offset)
+    {
+        in_flight.back().end = head;
+    }
+    else
+    {
+        in_flight.push_back({ ticket, offset, head });
+    }
+
+    region->buffer = buffer;
+    region->offset = offset;
+    region->size = region_size;
+    region->data = mapped + offset;
+
+    return true;
+}
@@ -22,36 +22,148 @@
 
 #include "g_transfer_context.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "g_device.h"
+#include "u_debug.h"
 
 void GraphicsTransferBatch::pipeline_barrier(vk::PipelineStageFlags source_stage, vk::PipelineStageFlags dest_stage, vk::ArrayProxy<const vk::ImageMemoryBarrier> memory_barriers) const
 {
+    this->empty = false;
     this->cmd.pipelineBarrier(source_stage, dest_stage, vk::DependencyFlags(), {}, {}, memory_barriers);
 }
 
+void GraphicsTransferBatch::generate_mipmaps(vk::Image src, uint32_t mip_count, vk::Rect2D size) const
+{
+    this->empty = false;
+
+    vk::ImageMemoryBarrier barrier;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = src;
+    barrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+    int32_t width = (int32_t) size.extent.width;
+    int32_t height = (int32_t) size.extent.height;
+
+    for (uint32_t level = 1; level < mip_count; level++)
+    {
+        int32_t next_width = width > 1 ? width / 2 : 1;
+        int32_t next_height = height > 1 ? height / 2 : 1;
+
+        /* Wait for the previous level's copy or blit before reading from it */
+        barrier.subresourceRange.baseMipLevel = level - 1;
+        barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+        barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+
+        this->pipeline_barrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, { barrier });
+
+        vk::ImageBlit blit(
+            vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level - 1, 0, 1),
+            { { vk::Offset3D(size.offset.x, size.offset.y, 0), vk::Offset3D(size.offset.x + width, size.offset.y + height, 1) } },
+            vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, 0, 1),
+            { { vk::Offset3D(size.offset.x, size.offset.y, 0), vk::Offset3D(size.offset.x + next_width, size.offset.y + next_height, 1) } }
+        );
+
+        this->cmd.blitImage(
+            src, vk::ImageLayout::eTransferSrcOptimal,
+            src, vk::ImageLayout::eTransferDstOptimal,
+            { blit },
+            vk::Filter::eLinear
+        );
+
+        /* The source level is finished with, hand it to the fragment shader */
+        barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+        barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+        this->pipeline_barrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, { barrier });
+
+        width = next_width;
+        height = next_height;
+    }
+
+    /* The last level is only ever written to */
+    barrier.subresourceRange.baseMipLevel = mip_count - 1;
+    barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+    this->pipeline_barrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, { barrier });
+}
+
 void GraphicsTransferBatch::blit_buffer_to_buffer(vk::Buffer src, vk::Buffer dest, vk::ArrayProxy<const vk::BufferCopy> regions) const
 {
+    this->empty = false;
     this->cmd.copyBuffer(src, dest, regions);
 }
 
 void GraphicsTransferBatch::blit_image_to_image(vk::Image src, vk::ImageLayout src_layout, vk::Image dest, vk::ImageLayout dest_layout, vk::ArrayProxy<const vk::ImageCopy> regions) const
 {
+    this->empty = false;
     this->cmd.copyImage(src, src_layout, dest, dest_layout, regions);
 }
 
 void GraphicsTransferBatch::blit_buffer_to_image(vk::Buffer src, vk::Image dest, vk::ImageLayout dest_layout, vk::ArrayProxy<const vk::BufferImageCopy> regions) const
 {
+    this->empty = false;
     this->cmd.copyBufferToImage(src, dest, dest_layout, regions);
 }
 
 void GraphicsTransferBatch::blit_image_to_buffer(vk::Image src, vk::ImageLayout src_layout, vk::Buffer dest, vk::ArrayProxy<const vk::BufferImageCopy> regions) const
 {
+    this->empty = false;
     this->cmd.copyImageToBuffer(src, src_layout, dest, regions);
 }
 
+GraphicsStagingRegion GraphicsTransferBatch::stage(VkDeviceSize size, VkDeviceSize alignment)
+{
+    return this->context->allocate_staging(*this, size, alignment);
+}
+
+void GraphicsTransferBatch::stage_buffer(const void *data, VkDeviceSize size, vk::Buffer dest, VkDeviceSize dest_offset)
+{
+    VkDeviceSize chunk_size = this->get_staging_chunk_size();
+
+    for (VkDeviceSize offset = 0; offset < size; offset += chunk_size)
+    {
+        GraphicsStagingRegion region = this->stage(std::min(chunk_size, size - offset));
+        memcpy(region.data, (const uint8_t *) data + offset, (size_t) region.size);
+
+        this->blit_buffer_to_buffer(region.buffer, dest, { vk::BufferCopy(region.offset, dest_offset + offset, region.size) });
+    }
+}
+
+VkDeviceSize GraphicsTransferBatch::get_staging_chunk_size() const
+{
+    /* Half the ring, so one batch can fill a chunk while the previous one is read */
+    return this->context->staging_ring->get_size() / 2;
+}
+
 GraphicsTransferContext::GraphicsTransferContext(GraphicsDevice *device)
-    : device(device), queue(device->transfer_queue)
+    : device(device), queue(device->transfer_queue), next_ticket(1)
 {
+    staging_ring = std::make_unique<GraphicsStagingRing>(device, STAGING_RING_SIZE);
+}
+
+GraphicsTransferContext::~GraphicsTransferContext()
+{
+    /* Nothing may still be reading the ring or the command buffers */
+    device->device.waitIdle();
+
+    for (const auto & list : { &frame_syncs, &deffer_free_list })
+    {
+        for (const auto & submission : *list)
+        {
+            device->device.destroyFence(submission.fence);
+            this->get_hw_queue(submission.hw_dest)->free_command_buffers(submission.buffer);
+        }
+    }
 }
 
 std::shared_ptr<GraphicsQueue> GraphicsTransferContext::get_hw_queue(GraphicsTransferHardwareDest dest) const
@@ -67,19 +179,53 @@ std::shared_ptr<GraphicsQueue> GraphicsTransferContext::get_hw_queue(GraphicsTra
     }
 }
 
-std::unique_ptr<GraphicsTransferBatch> GraphicsTransferContext::start_batch(GraphicsTransferHardwareDest dest) const
+std::unique_ptr<GraphicsTransferBatch> GraphicsTransferContext::start_batch(GraphicsTransferHardwareDest dest)
 {
     std::shared_ptr<GraphicsQueue> queue = this->get_hw_queue(dest);
 
     vk::CommandBuffer buffer = queue->allocate_command_buffer(vk::CommandBufferLevel::ePrimary);
     buffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit, nullptr });
-    return std::make_unique<GraphicsTransferBatch>(dest, buffer);
+
+    /* Tickets are known up front so staging regions can be tagged while recording */
+    GraphicsTransferTicket ticket = next_ticket++;
+    open_tickets.push_back(ticket);
+
+    return std::make_unique<GraphicsTransferBatch>(this, dest, buffer, ticket);
 }
 
-void GraphicsTransferContext::end_batch(std::unique_ptr<GraphicsTransferBatch> batch, bool sync_frame)
+vk::Fence GraphicsTransferContext::submit(GraphicsTransferHardwareDest dest, vk::CommandBuffer buffer, const std::vector<vk::Semaphore>& signal_semaphores) const
 {
-    std::vector<vk::Semaphore> update_semaphores;
     vk::Fence fence = device->device.createFence({});
+    std::vector<vk::CommandBuffer> commands{ buffer };
+
+    vk::SubmitInfo submit_info (
+        0, nullptr, nullptr,
+        (uint32_t)commands.size(), commands.data(),
+        (uint32_t)signal_semaphores.size(), signal_semaphores.data()
+    );
+
+    std::array<vk::SubmitInfo, 1> submits = { submit_info };
+
+    this->get_hw_queue(dest)->queue.submit((uint32_t)submits.size(), submits.data(), fence);
+
+    return fence;
+}
+
+GraphicsTransferTicket GraphicsTransferContext::end_batch(std::unique_ptr<GraphicsTransferBatch> batch, bool sync_frame)
+{
+    GraphicsTransferTicket ticket = batch->ticket;
+
+    open_tickets.erase(std::remove(open_tickets.begin(), open_tickets.end(), ticket), open_tickets.end());
+
+    /* Uploads written straight into device memory leave nothing to submit */
+    if (batch->empty)
+    {
+        batch->cmd.end();
+        this->get_hw_queue(batch->dest)->free_command_buffers(batch->cmd);
+        return ticket;
+    }
+
+    std::vector<vk::Semaphore> update_semaphores;
 
     if (sync_frame)
     {
@@ -92,22 +238,98 @@ void GraphicsTransferContext::end_batch(std::unique_ptr<GraphicsTransferBatch> b
         }
     }
 
-    vk::CommandBuffer buffer = (vk::CommandBuffer) *batch;
-    buffer.end();
+    batch->cmd.end();
 
-    std::shared_ptr<GraphicsQueue> queue = this->get_hw_queue(batch->dest);
-    std::vector<vk::CommandBuffer> commands{ buffer };
+    vk::Fence fence = this->submit(batch->dest, batch->cmd, update_semaphores);
+    frame_syncs.push_back(BatchSubmissionInfo(batch->dest, fence, update_semaphores, batch->cmd, ticket));
 
-    vk::SubmitInfo submit_info (
-        0, nullptr, nullptr,
-        (uint32_t)commands.size(), commands.data(),
-        (uint32_t)update_semaphores.size(), update_semaphores.data()
-    );
+    return ticket;
+}
 
-    std::array<vk::SubmitInfo, 1> submits = { submit_info };
+void GraphicsTransferContext::flush_batch(GraphicsTransferBatch& batch)
+{
+    /*
+     * Later submissions on the queue are ordered after this one, so a wait
+     * on the batch's final ticket still covers everything it recorded
+     */
+    batch.cmd.end();
+
+    vk::Fence fence = this->submit(batch.dest, batch.cmd, {});
+    frame_syncs.push_back(BatchSubmissionInfo(batch.dest, fence, {}, batch.cmd, batch.ticket));
+
+    GraphicsTransferTicket ticket = next_ticket++;
+    std::replace(open_tickets.begin(), open_tickets.end(), batch.ticket, ticket);
+
+    LOG_INFO("Flushed transfer batch %llu to free staging memory", (unsigned long long) batch.ticket);
+
+    batch.ticket = ticket;
+    batch.cmd = this->get_hw_queue(batch.dest)->allocate_command_buffer(vk::CommandBufferLevel::ePrimary);
+    batch.cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit, nullptr });
+}
+
+void GraphicsTransferContext::wait_for_batch(GraphicsTransferTicket ticket) const
+{
+    for (const auto & list : { &frame_syncs, &deffer_free_list })
+    {
+        for (const auto & submission : *list)
+        {
+            if (submission.ticket == ticket)
+            {
+                device->device.waitForFences({ submission.fence }, true, UINT64_MAX);
+                return;
+            }
+        }
+    }
+}
+
+GraphicsStagingRegion GraphicsTransferContext::allocate_staging(GraphicsTransferBatch& batch, VkDeviceSize size, VkDeviceSize alignment)
+{
+    GraphicsStagingRegion region;
+
+    while (true)
+    {
+        staging_ring->retire([this](GraphicsTransferTicket ticket) { return this->is_batch_complete(ticket); });
+
+        if (staging_ring->allocate(size, alignment, batch.ticket, &region))
+        {
+            return region;
+        }
+
+        /* The batch's own regions only free up once it has been submitted */
+        GraphicsTransferTicket oldest = staging_ring->get_oldest_ticket();
+        if (oldest == batch.ticket)
+        {
+            this->flush_batch(batch);
+        }
+        else if (std::find(open_tickets.begin(), open_tickets.end(), oldest) != open_tickets.end())
+        {
+            throw std::exception("Staging ring is held by another open batch.");
+        }
+
+        this->wait_for_batch(oldest);
+    }
+}
+
+bool GraphicsTransferContext::is_batch_complete(GraphicsTransferTicket ticket) const
+{
+    if (std::find(open_tickets.begin(), open_tickets.end(), ticket) != open_tickets.end())
+    {
+        return false;
+    }
+
+    for (const auto & list : { &frame_syncs, &deffer_free_list })
+    {
+        for (const auto & submission : *list)
+        {
+            if (submission.ticket == ticket)
+            {
+                return device->device.getFenceStatus(submission.fence) == vk::Result::eSuccess;
+            }
+        }
+    }
 
-    frame_syncs.push_back(BatchSubmissionInfo(batch->dest, fence, update_semaphores, (vk::CommandBuffer) *batch));
-    queue->queue.submit((uint32_t)submits.size(), submits.data(), fence);
+    /* Submissions are only forgotten once their fence has signalled */
+    return ticket < next_ticket;
 }
 
 std::vector<vk::Semaphore> GraphicsTransferContext::get_next_frame_sync()
@@ -0,0 +1,107 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "g_uniform_ring.h"
+
+#include <cstring>
+
+#include "g_devmem.h"
+#include "u_debug.h"
+#include "u_defines.h"
+
+GraphicsUniformRing::GraphicsUniformRing(const GraphicsDevmem& devmem, uint32_t frame_count, VkDeviceSize frame_size)
+    : frame_count(frame_count), used(0), shadow((size_t) frame_size, 0), generation(1), frame_generations(frame_count, 0)
+{
+    alignment = devmem.get_device()->physical_deivce.getProperties().limits.minUniformBufferOffsetAlignment;
+
+    /* Every frame's copy starts aligned, so block offsets are valid in all of them */
+    this->frame_size = (frame_size + alignment - 1) / alignment * alignment;
+
+    vk::BufferCreateInfo buffer_create_info(
+        vk::BufferCreateFlags(0),
+        this->frame_size * frame_count,
+        vk::BufferUsageFlagBits::eUniformBuffer,
+        vk::SharingMode::eExclusive
+    );
+
+    VmaAllocationCreateInfo alloc_create_info{};
+    alloc_create_info.flags = 0;
+    alloc_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    alloc_create_info.requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    alloc_create_info.pUserData = STRING_TO_DATA("Uniform Ring");
+
+    buffer = devmem.create_buffer(buffer_create_info, alloc_create_info);
+
+    void *data;
+    buffer->map_memory(&data);
+    mapped = (uint8_t *) data;
+}
+
+GraphicsUniformRing::~GraphicsUniformRing()
+{
+    buffer->unmap_memory();
+}
+
+GraphicsUniformBlock GraphicsUniformRing::allocate(VkDeviceSize size)
+{
+    VkDeviceSize offset = (used + alignment - 1) / alignment * alignment;
+
+    if (offset + size > frame_size)
+    {
+        throw std::exception("Uniform ring is full.");
+    }
+
+    used = offset + size;
+
+    return { (uint32_t) offset, (uint32_t) size };
+}
+
+void GraphicsUniformRing::write(const GraphicsUniformBlock& block, const void *data)
+{
+    memcpy(shadow.data() + block.offset, data, block.size);
+    generation++;
+}
+
+void GraphicsUniformRing::begin_frame(uint32_t frame)
+{
+    if (frame >= frame_count)
+    {
+        throw std::exception("More frames in flight than the uniform ring holds.");
+    }
+
+    if (frame_generations[frame] != generation)
+    {
+        memcpy(mapped + frame * frame_size, shadow.data(), (size_t) used);
+        frame_generations[frame] = generation;
+    }
+}
+
+uint32_t GraphicsUniformRing::get_dynamic_offset(const GraphicsUniformBlock& block, uint32_t frame) const
+{
+    DEBUG_ASSERT(frame < frame_count);
+
+    return (uint32_t) (frame * frame_size) + block.offset;
+}
+
+vk::DescriptorBufferInfo GraphicsUniformRing::get_buffer_info(const GraphicsUniformBlock& block) const
+{
+    return vk::DescriptorBufferInfo(buffer->buffer, 0, block.size);
+}
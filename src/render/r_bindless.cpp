@@ -0,0 +1,268 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "r_bindless.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "r_camera.h"
+#include "u_debug.h"
+#include "u_defines.h"
+
+BindlessTable::BindlessTable(std::shared_ptr<GraphicsDevice>& device, std::shared_ptr<GraphicsDevmem>& devmem, uint32_t frame_count)
+    : device(device), frame_count(frame_count), material_count(0)
+{
+    texture_limit = std::min(device->get_bindless_texture_limit(), (uint32_t) BINDLESS_TEXTURE_LIMIT);
+
+    /* Dynamic uniform buffers aren't allowed in an update after bind layout */
+    vk::DescriptorSetLayoutBinding camera_binding(0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex);
+
+    camera_set_layout = device->device.createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo(
+        vk::DescriptorSetLayoutCreateFlags(0),
+        1, &camera_binding
+    ));
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings = {
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment),
+        vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eCombinedImageSampler, texture_limit, vk::ShaderStageFlagBits::eFragment),
+    };
+
+    /* Unused slots are never read, textures are added and removed while frames using the set are pending */
+    std::vector<vk::DescriptorBindingFlagsEXT> binding_flags = {
+        vk::DescriptorBindingFlagsEXT(0),
+        vk::DescriptorBindingFlagBitsEXT::ePartiallyBound | vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind |
+            vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending,
+    };
+
+    vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_info(
+        (uint32_t)binding_flags.size(), binding_flags.data()
+    );
+
+    vk::DescriptorSetLayoutCreateInfo set_layout_create_info(
+        vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT,
+        (uint32_t)bindings.size(), bindings.data()
+    );
+    set_layout_create_info.pNext = &binding_flags_info;
+
+    set_layout = device->device.createDescriptorSetLayout(set_layout_create_info);
+
+    vk::PushConstantRange push_constant_range(vk::ShaderStageFlagBits::eVertex, 0, sizeof(VertexShaderData));
+
+    std::vector<vk::DescriptorSetLayout> set_layouts = { camera_set_layout, set_layout };
+
+    vk::PipelineLayoutCreateInfo pipeline_layout_create_info(
+        vk::PipelineLayoutCreateFlags(0),
+        (uint32_t)set_layouts.size(), set_layouts.data(),
+        1, &push_constant_range
+    );
+
+    pipeline_layout = device->device.createPipelineLayout(pipeline_layout_create_info);
+
+    std::vector<vk::DescriptorPoolSize> pool_sizes = {
+        vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1),
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 1),
+        vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, texture_limit),
+    };
+
+    vk::DescriptorPoolCreateInfo pool_create_info(
+        vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT,
+        (uint32_t)set_layouts.size(),
+        (uint32_t)pool_sizes.size(), pool_sizes.data()
+    );
+
+    descriptor_pool = device->device.createDescriptorPool(pool_create_info);
+
+    vk::DescriptorSetAllocateInfo alloc_info(descriptor_pool, (uint32_t)set_layouts.size(), set_layouts.data());
+    std::vector<vk::DescriptorSet> sets = device->device.allocateDescriptorSets(alloc_info);
+    camera_set = sets[0];
+    descriptor_set = sets[1];
+
+    vk::BufferCreateInfo buffer_create_info(
+        vk::BufferCreateFlags(0),
+        sizeof(BindlessMaterialData) * BINDLESS_MATERIAL_LIMIT * frame_count,
+        vk::BufferUsageFlagBits::eStorageBuffer
+    );
+
+    VmaAllocationCreateInfo alloc_create_info{};
+    alloc_create_info.flags = 0;
+    alloc_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    alloc_create_info.requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    alloc_create_info.pUserData = STRING_TO_DATA("Bindless Materials");
+
+    material_buffer = devmem->create_buffer(buffer_create_info, alloc_create_info);
+
+    void *data;
+    material_buffer->map_memory(&data);
+    material_data = (uint8_t *) data;
+
+    vk::DescriptorBufferInfo camera_buffer = Camera::get()->get_buffer_info();
+    vk::DescriptorBufferInfo material_buffer_info(material_buffer->buffer, 0, VK_WHOLE_SIZE);
+
+    std::vector<vk::WriteDescriptorSet> writes = {
+        vk::WriteDescriptorSet(camera_set, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &camera_buffer, nullptr),
+        vk::WriteDescriptorSet(descriptor_set, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &material_buffer_info, nullptr),
+    };
+
+    device->device.updateDescriptorSets(writes, {});
+
+    LOG_INFO("Created bindless table for %u textures, %u frames", texture_limit, frame_count);
+}
+
+BindlessTable::~BindlessTable()
+{
+    material_buffer->unmap_memory();
+
+    device->device.destroyDescriptorPool(descriptor_pool);
+    device->device.destroyPipelineLayout(pipeline_layout);
+    device->device.destroyDescriptorSetLayout(set_layout);
+    device->device.destroyDescriptorSetLayout(camera_set_layout);
+}
+
+uint32_t BindlessTable::add_material()
+{
+    if (!free_materials.empty())
+    {
+        uint32_t index = free_materials.back();
+        free_materials.pop_back();
+        return index;
+    }
+
+    if (material_count == BINDLESS_MATERIAL_LIMIT)
+    {
+        throw std::exception("Out of bindless material slots");
+    }
+
+    return material_count++;
+}
+
+void BindlessTable::remove_material(uint32_t index)
+{
+    free_materials.push_back(index);
+}
+
+void BindlessTable::write_material(
+    uint32_t index,
+    uint32_t frame,
+    const MaterialShaderData& shader_data,
+    const std::shared_ptr<RenderTexture>& ambient_texture,
+    const std::shared_ptr<RenderTexture>& diffuse_texture,
+    const std::shared_ptr<RenderTexture>& specular_texture)
+{
+    DEBUG_ASSERT(index < material_count);
+    DEBUG_ASSERT(frame < frame_count);
+
+    BindlessMaterialData material;
+    material.ambient = shader_data.ambient;
+    material.diffuse = shader_data.diffuse;
+    material.specular = shader_data.specular;
+    material.alpha = shader_data.alpha;
+    material.ambient_texture = this->get_texture_slot(ambient_texture);
+    material.diffuse_texture = this->get_texture_slot(diffuse_texture);
+    material.specular_texture = this->get_texture_slot(specular_texture);
+
+    memcpy(material_data + this->get_first_instance(index, frame) * sizeof(BindlessMaterialData), &material, sizeof(material));
+}
+
+void BindlessTable::bind(vk::CommandBuffer cmd, uint32_t frame) const
+{
+    std::vector<vk::DescriptorSet> sets = { camera_set, descriptor_set };
+    uint32_t camera_offset = Camera::get()->get_dynamic_offset(frame);
+
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, (uint32_t)sets.size(), sets.data(), 1, &camera_offset);
+}
+
+uint32_t BindlessTable::get_texture_slot(const std::shared_ptr<RenderTexture>& texture)
+{
+    if (!texture)
+    {
+        return BINDLESS_NO_TEXTURE;
+    }
+
+    std::shared_ptr<GraphicsImageSampler> sampler = texture->get_sampler();
+
+    auto it = texture_slots.find(sampler.get());
+    if (it != texture_slots.end())
+    {
+        /* A new sampler can be allocated where an expired one was */
+        if (textures[it->second].lock() == sampler)
+        {
+            return it->second;
+        }
+
+        this->retire_texture_slot(it->first, it->second);
+    }
+
+    this->release_expired_textures();
+
+    uint32_t slot;
+    if (!free_textures.empty())
+    {
+        slot = free_textures.back();
+        free_textures.pop_back();
+    }
+    else if (textures.size() < texture_limit)
+    {
+        slot = (uint32_t) textures.size();
+        textures.emplace_back();
+    }
+    else
+    {
+        LOG_WARN("Out of bindless texture slots");
+        return BINDLESS_NO_TEXTURE;
+    }
+
+    vk::DescriptorImageInfo image_info = sampler->get_image_info();
+
+    vk::WriteDescriptorSet write(descriptor_set, 2, slot, 1, vk::DescriptorType::eCombinedImageSampler, &image_info, nullptr, nullptr);
+    device->device.updateDescriptorSets(write, {});
+
+    texture_slots[sampler.get()] = slot;
+    textures[slot] = sampler;
+
+    return slot;
+}
+
+void BindlessTable::retire_texture_slot(const GraphicsImageSampler *sampler, uint32_t slot)
+{
+    texture_slots.erase(sampler);
+    textures[slot].reset();
+
+    /* Frames still in flight may have been recorded with the slot */
+    this->device->retire_queue->retire([this, slot]() {
+        free_textures.push_back(slot);
+    });
+}
+
+void BindlessTable::release_expired_textures()
+{
+    for (auto it = texture_slots.begin(); it != texture_slots.end();)
+    {
+        auto next = std::next(it);
+
+        if (textures[it->second].expired())
+        {
+            this->retire_texture_slot(it->first, it->second);
+        }
+
+        it = next;
+    }
+}
@@ -10,19 +10,9 @@ Camera::Camera(
     float fov, float aspect_ratio, float near, float far, 
     const glm::vec3& position, const glm::vec3& target, const glm::vec3& up)
     : fov(fov), aspect_ratio(aspect_ratio), near(near), far(far),
-      position(position), target(target), up(up),  shader_data(get_matrix())
+      position(position), target(target), up(up),  shader_data(get_matrix()), devmem(devmem)
 {
-	vk::BufferCreateInfo buffer_create_info(
-		vk::BufferCreateFlags(0),
-		sizeof(CameraShaderData),
-		vk::BufferUsageFlagBits::eUniformBuffer
-	);
-
-	VmaAllocationCreateInfo alloc_create_info{};
-	alloc_create_info.flags = 0;
-	alloc_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU; /* Try for both DEVICE_LOCAL and HOST_VISIBLE (AMD), if not fallback to HOST_VISIBLE */
-
-	shader_data_buffer = devmem->create_buffer(buffer_create_info, alloc_create_info);
+	shader_data_block = devmem->get_uniform_ring()->allocate(sizeof(CameraShaderData));
 
 	update_buffer();
 }
@@ -40,10 +30,12 @@ glm::mat4 Camera::get_matrix() const
 
 vk::DescriptorBufferInfo Camera::get_buffer_info() const
 {
-	return vk::DescriptorBufferInfo(
-		shader_data_buffer->buffer,
-		0, sizeof(CameraShaderData)
-	);
+	return devmem->get_uniform_ring()->get_buffer_info(shader_data_block);
+}
+
+uint32_t Camera::get_dynamic_offset(uint32_t frame) const
+{
+	return devmem->get_uniform_ring()->get_dynamic_offset(shader_data_block, frame);
 }
 
 void Camera::move(glm::vec3 vec)
@@ -65,10 +57,7 @@ void Camera::set(std::shared_ptr<Camera>& camera)
 
 void Camera::update_buffer() const
 {
-	glm::mat4 proj_view = get_matrix();
+	CameraShaderData data(get_matrix());
 
-	void *data;
-	shader_data_buffer->map_memory(&data);
-	memcpy(data, &proj_view, sizeof(proj_view));
-	shader_data_buffer->unmap_memory();
+	devmem->get_uniform_ring()->write(shader_data_block, &data);
 }
@@ -0,0 +1,184 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "r_geometry_arena.h"
+
+#include <iterator>
+
+#include "u_debug.h"
+#include "u_defines.h"
+
+GeometryFreeList::GeometryFreeList(VkDeviceSize size)
+    : free_size(size)
+{
+    blocks[0] = size;
+}
+
+bool GeometryFreeList::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+{
+    if (size == 0)
+    {
+        *offset = 0;
+        return true;
+    }
+
+    for (auto it = blocks.begin(); it != blocks.end(); ++it)
+    {
+        VkDeviceSize block_offset = it->first;
+        VkDeviceSize block_size = it->second;
+
+        /* Strides need not be powers of two */
+        VkDeviceSize aligned = (block_offset + alignment - 1) / alignment * alignment;
+        if (aligned + size > block_offset + block_size)
+        {
+            continue;
+        }
+
+        blocks.erase(it);
+
+        /* The padding and the remainder stay free */
+        if (aligned > block_offset)
+        {
+            blocks[block_offset] = aligned - block_offset;
+        }
+
+        if (aligned + size < block_offset + block_size)
+        {
+            blocks[aligned + size] = block_offset + block_size - (aligned + size);
+        }
+
+        free_size -= size;
+        *offset = aligned;
+        return true;
+    }
+
+    return false;
+}
+
+void GeometryFreeList::free(VkDeviceSize offset, VkDeviceSize size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    free_size += size;
+
+    auto next = blocks.lower_bound(offset);
+
+    if (next != blocks.end() && offset + size == next->first)
+    {
+        size += next->second;
+        next = blocks.erase(next);
+    }
+
+    if (next != blocks.begin())
+    {
+        auto prev = std::prev(next);
+
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += size;
+            return;
+        }
+    }
+
+    blocks[offset] = size;
+}
+
+GeometryArena::GeometryArena(std::shared_ptr<GraphicsDevmem>& devmem)
+    : vertex_blocks(GEOMETRY_ARENA_VERTEX_SIZE), index_blocks(GEOMETRY_ARENA_INDEX_SIZE)
+{
+    vk::BufferCreateInfo vbuf_create_info(
+        vk::BufferCreateFlags(0),
+        GEOMETRY_ARENA_VERTEX_SIZE,
+        vk::BufferUsageFlagBits::eVertexBuffer,
+        vk::SharingMode::eExclusive
+    );
+
+    VmaAllocationCreateInfo vbuf_alloc_info{};
+    vbuf_alloc_info.flags = 0;
+    vbuf_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    vbuf_alloc_info.pUserData = STRING_TO_DATA("Geometry Arena Verticies");
+
+    vertex_buffer = devmem->create_buffer(vbuf_create_info, vbuf_alloc_info);
+
+    vk::BufferCreateInfo ibuf_create_info(
+        vk::BufferCreateFlags(0),
+        GEOMETRY_ARENA_INDEX_SIZE,
+        vk::BufferUsageFlagBits::eIndexBuffer,
+        vk::SharingMode::eExclusive
+    );
+
+    VmaAllocationCreateInfo ibuf_alloc_info{};
+    ibuf_alloc_info.flags = 0;
+    ibuf_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    ibuf_alloc_info.pUserData = STRING_TO_DATA("Geometry Arena Indicies");
+
+    index_buffer = devmem->create_buffer(ibuf_create_info, ibuf_alloc_info);
+}
+
+GeometryArena::~GeometryArena()
+{
+    LOG_INFO("Geometry arena: %llu vertex bytes, %llu index bytes still allocated",
+        (unsigned long long) (GEOMETRY_ARENA_VERTEX_SIZE - vertex_blocks.get_free_size()),
+        (unsigned long long) (GEOMETRY_ARENA_INDEX_SIZE - index_blocks.get_free_size()));
+}
+
+GeometryRange GeometryArena::allocate(VertexFormat vertex_format, uint32_t vertex_count, uint32_t index_count)
+{
+    VkDeviceSize stride = get_vertex_stride(vertex_format);
+    GeometryRange range;
+
+    range.vertex_size = vertex_count * stride;
+    range.index_size = index_count * sizeof(uint32_t);
+
+    if (!vertex_blocks.allocate(range.vertex_size, stride, &range.vertex_offset))
+    {
+        throw std::exception("Geometry arena is out of vertex space.");
+    }
+
+    if (!index_blocks.allocate(range.index_size, sizeof(uint32_t), &range.index_offset))
+    {
+        vertex_blocks.free(range.vertex_offset, range.vertex_size);
+        throw std::exception("Geometry arena is out of index space.");
+    }
+
+    range.base_vertex = (int32_t) (range.vertex_offset / stride);
+    range.first_index = (uint32_t) (range.index_offset / sizeof(uint32_t));
+
+    return range;
+}
+
+void GeometryArena::free(const GeometryRange& range)
+{
+    vertex_blocks.free(range.vertex_offset, range.vertex_size);
+    index_blocks.free(range.index_offset, range.index_size);
+}
+
+void GeometryArena::bind(vk::CommandBuffer cmd) const
+{
+    std::vector<vk::Buffer> vbufs{ vertex_buffer->buffer };
+    std::vector<VkDeviceSize> voffsets{ 0 };
+
+    cmd.bindVertexBuffers(0, (uint32_t)vbufs.size(), vbufs.data(), voffsets.data());
+    cmd.bindIndexBuffer(index_buffer->buffer, 0, vk::IndexType::eUint32);
+}
@@ -21,58 +21,451 @@
 ******************************************************************************/
 #include "r_image_loader.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "r_texture_codec.h"
+#include "r_texture_file.h"
 #include "u_defines.h"
 #include "u_debug.h"
+#include "u_io.h"
+
+/* Block compressed formats a cooked or shipped texture file may use */
+static const vk::Format compressed_formats[] = {
+    vk::Format::eBc1RgbaUnormBlock,
+    vk::Format::eBc1RgbaSrgbBlock,
+    vk::Format::eBc3UnormBlock,
+    vk::Format::eBc3SrgbBlock,
+    vk::Format::eBc5UnormBlock,
+    vk::Format::eBc5SnormBlock,
+    vk::Format::eBc7UnormBlock,
+    vk::Format::eBc7SrgbBlock,
+};
+
+RenderImageLoader::RenderImageLoader(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<GraphicsDevmem> devmem, std::shared_ptr<ThreadPool> thread_pool)
+    : device(device), devmem(devmem), thread_pool(thread_pool), stats{ 0, 0, 0 }
+{
+    decode_options.cpu_mipmaps = !device->supports_linear_blit(vk::Format::eR8G8B8A8Unorm);
+
+    for (vk::Format format : compressed_formats)
+    {
+        if (device->supports_sampled_format(format))
+        {
+            decode_options.compressed_formats.push_back(format);
+        }
+    }
+}
+
+RenderImageLoader::~RenderImageLoader()
+{
+    LOG_INFO("Texture cache: %llu hits, %llu misses, %llu bytes saved",
+        (unsigned long long) stats.hits, (unsigned long long) stats.misses, (unsigned long long) stats.bytes_saved);
+}
+
+std::shared_ptr<RenderTexture> RenderImageLoader::load_texture(const std::string& file)
+{
+    std::string key = get_canonical_path(file);
+    TextureCacheEntry& entry = texture_cache[key];
+
+    std::shared_ptr<RenderTexture> texture = entry.texture.lock();
+    if (texture)
+    {
+        stats.hits++;
+        stats.bytes_saved += entry.size;
+        return texture;
+    }
+
+    stats.misses++;
+
+    std::shared_ptr<GraphicsDevmemImage> image = this->load_image(file, &entry.size);
+    texture = std::make_shared<RenderTexture>(this->create_texture(image));
+    entry.texture = texture;
+
+    return texture;
+}
+
+std::shared_ptr<RenderTexture> RenderImageLoader::load_texture_async(const std::string& file, std::shared_ptr<GraphicsImageSampler> fallback)
+{
+    std::string key = get_canonical_path(file);
+    TextureCacheEntry& entry = texture_cache[key];
+
+    /* A texture still loading is shared too, it becomes resident for every user at once */
+    std::shared_ptr<RenderTexture> texture = entry.texture.lock();
+    if (texture)
+    {
+        stats.hits++;
+        stats.bytes_saved += entry.size;
+        return texture;
+    }
+
+    stats.misses++;
+
+    texture = std::make_shared<RenderTexture>(fallback, false);
+    entry.texture = texture;
+    entry.size = 0;
+
+    /* The file is read with the rest of the frame's requests in submit_reads */
+    pending_textures.push_back({ key, file, texture, std::future<DecodedImage>() });
+
+    return texture;
+}
+
+void RenderImageLoader::submit_reads()
+{
+    std::vector<PendingTexture *> textures;
+    std::vector<file_read_request> requests;
+
+    for (auto & pending : pending_textures)
+    {
+        if (pending.decoded.valid())
+        {
+            continue;
+        }
+
+        std::string path = get_texture_path(pending.file);
+
+        textures.push_back(&pending);
+        requests.push_back({ path.empty() ? pending.file : path, { 0, nullptr }, false });
+    }
+
+    if (requests.empty())
+    {
+        return;
+    }
+
+    /* Failed reads are retried by the decode job, which reports the error */
+    read_files(requests);
+
+    DecodeOptions options = decode_options;
+
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        std::string file = textures[i]->file;
+        std::string path = requests[i].path;
+        std::shared_ptr<file_data> data(new file_data(requests[i].data), [](file_data *data) {
+            free_file(data);
+            delete data;
+        });
+
+        textures[i]->decoded = thread_pool->submit([file, path, data, options]() { return decode_file_data(file, path, data, options); });
+    }
+
+    LOG_INFO("Read %u texture files in one batch", (uint32_t) requests.size());
+}
+
+uint32_t RenderImageLoader::process_uploads(bool wait)
+{
+    std::unique_ptr<GraphicsTransferBatch> batch;
+    uint32_t resident_count = 0;
+
+    this->submit_reads();
+
+    for (auto it = pending_textures.begin(); it != pending_textures.end();)
+    {
+        if (!wait && it->decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++it;
+            continue;
+        }
+
+        try
+        {
+            DecodedImage decoded = it->decoded.get();
+
+            if (!batch)
+            {
+                batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eGraphics);
+            }
+
+            std::shared_ptr<GraphicsDevmemImage> image = this->upload_image(*batch, decoded, it->file);
+
+            /*
+             * The batch transitions the image for shader reads, later frames
+             * on the graphics queue are ordered after it by that barrier
+             */
+            it->texture->make_resident(this->create_texture(image));
+            texture_cache[it->key].size = decoded.size;
+            resident_count++;
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("Failed to load texture %s: %s", it->file.c_str(), e.what());
+        }
+
+        it = pending_textures.erase(it);
+    }
+
+    if (batch)
+    {
+        device->transfer_context->end_batch(std::move(batch), false);
+
+        LOG_INFO("Uploaded %u textures in one batch", resident_count);
+    }
+
+    return resident_count;
+}
+
+std::shared_ptr<GraphicsImageSampler> RenderImageLoader::create_texture(std::shared_ptr<GraphicsDevmemImage> image)
+{
+    return std::make_shared<GraphicsImageSampler>(
+        device,
+        image,
+        vk::SamplerAddressMode::eClampToBorder,
+        vk::SamplerAddressMode::eClampToBorder,
+        vk::SamplerAddressMode::eClampToBorder,
+        vk::BorderColor::eFloatOpaqueWhite
+    );
+}
+
+void RenderImageLoader::evict(const std::string& file)
+{
+    texture_cache.erase(get_canonical_path(file));
+}
+
+size_t RenderImageLoader::evict_unused()
+{
+    size_t evicted = 0;
+
+    for (auto it = texture_cache.begin(); it != texture_cache.end();)
+    {
+        if (it->second.texture.expired())
+        {
+            it = texture_cache.erase(it);
+            evicted++;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    return evicted;
+}
+
+std::shared_ptr<GraphicsDevmemImage> RenderImageLoader::load_image(std::string file, VkDeviceSize *out_image_size) const
+{
+    DecodedImage decoded = decode_image(file, decode_options);
+
+    auto batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eGraphics);
+    std::shared_ptr<GraphicsDevmemImage> image = this->upload_image(*batch, decoded, file);
+    GraphicsTransferTicket ticket = device->transfer_context->end_batch(std::move(batch), false);
+
+    /* Only the upload needs to land, frames in flight carry on */
+    device->transfer_context->wait_for_batch(ticket);
+
+    if (out_image_size != nullptr)
+    {
+        *out_image_size = decoded.size;
+    }
+
+    return image;
+}
 
-std::shared_ptr<GraphicsDevmemImage> RenderImageLoader::load_image(std::string file) const
+static bool has_extension(const std::string& file, const char *extension)
 {
+    size_t length = strlen(extension);
+    return file.size() >= length && file.compare(file.size() - length, length, extension) == 0;
+}
+
+static bool is_texture_container(const std::string& file)
+{
+    return has_extension(file, ".dds") || has_extension(file, ".ktx2");
+}
+
+std::string RenderImageLoader::get_texture_path(const std::string& file)
+{
+    if (is_texture_container(file))
+    {
+        return file;
+    }
+
+    std::string path = file + TEXTURE_FILE_EXTENSION;
+    file_stamp source_stamp;
+    file_stamp cooked_stamp;
+
+    if (!get_file_stamp(path, &cooked_stamp) ||
+        (get_file_stamp(file, &source_stamp) && cooked_stamp.mtime < source_stamp.mtime))
+    {
+        return std::string();
+    }
+
+    return path;
+}
+
+bool RenderImageLoader::decode_texture_file(std::shared_ptr<TextureFile> texture_file, const std::string& path, const DecodeOptions& options, DecodedImage *decoded)
+{
+    vk::Format format = texture_file->get_format();
+    if (get_texture_block_size(format) != 0 &&
+        std::find(options.compressed_formats.begin(), options.compressed_formats.end(), format) == options.compressed_formats.end())
+    {
+        LOG_WARN("Device can't sample the format of %s", path.c_str());
+        return false;
+    }
+
+    /* KTX2 stores the smallest level first, copy the whole span in one go */
+    uint64_t start = UINT64_MAX;
+    uint64_t end = 0;
+
+    for (uint32_t level = 0; level < texture_file->get_level_count(); level++)
+    {
+        start = std::min(start, texture_file->get_level(level).offset);
+        end = std::max(end, texture_file->get_level(level).offset + texture_file->get_level(level).size);
+    }
+
+    decoded->width = texture_file->get_level(0).width;
+    decoded->height = texture_file->get_level(0).height;
+    decoded->format = format;
+    decoded->mip_levels = texture_file->get_level_count();
+    decoded->size = end - start;
+
+    for (uint32_t level = 0; level < texture_file->get_level_count(); level++)
+    {
+        decoded->level_offsets.push_back(texture_file->get_level(level).offset - start);
+    }
+
+    /* The pixels point into the file, which lives as long as they do */
+    decoded->pixels = std::shared_ptr<uint8_t>(texture_file, (uint8_t *) texture_file->get_data() + start);
+
+    LOG_INFO("Loaded texture file %s", path.c_str());
+    return true;
+}
+
+DecodedImage RenderImageLoader::decode_image(const std::string& file, const DecodeOptions& options)
+{
+    DecodedImage decoded;
+    std::string path = get_texture_path(file);
+
+    if (!path.empty())
+    {
+        std::shared_ptr<TextureFile> texture_file = std::make_shared<TextureFile>();
+        if (texture_file->open(path) && decode_texture_file(texture_file, path, options, &decoded))
+        {
+            return decoded;
+        }
+    }
+
+    if (is_texture_container(file))
+    {
+        throw std::runtime_error("failed to load texture file!");
+    }
+
+    /* Decode straight out of the page cache rather than through stdio buffers */
+    FileView view;
+    if (!view.open(file))
+    {
+        throw std::runtime_error("failed to load texture image!");
+    }
+
+    return decode_pixels(file, view.data(), view.size(), options);
+}
+
+DecodedImage RenderImageLoader::decode_file_data(const std::string& file, const std::string& path, std::shared_ptr<file_data> data, const DecodeOptions& options)
+{
+    /* A failed read gets a second chance through the mapped path */
+    if (!data->data)
+    {
+        return decode_image(file, options);
+    }
+
+    if (path == file && !is_texture_container(file))
+    {
+        return decode_pixels(file, data->data, data->size, options);
+    }
+
+    DecodedImage decoded;
+    std::shared_ptr<TextureFile> texture_file = std::make_shared<TextureFile>();
+    if (texture_file->open(path, data.get()) && decode_texture_file(texture_file, path, options, &decoded))
+    {
+        return decoded;
+    }
+
+    /* The cooked file can't be used, decode the source image instead */
+    return decode_image(file, options);
+}
+
+DecodedImage RenderImageLoader::decode_pixels(const std::string& file, const void *data, size_t size, const DecodeOptions& options)
+{
+    DecodedImage decoded;
+
     int texture_width, texture_height, texture_channels;
-    stbi_uc* pixels = stbi_load(file.c_str(), &texture_width, &texture_height, &texture_channels, STBI_rgb_alpha);
-    VkDeviceSize image_size = texture_width * texture_height * 4;
+    stbi_uc* pixels = stbi_load_from_memory((const stbi_uc *) data, (int) size, &texture_width, &texture_height, &texture_channels, STBI_rgb_alpha);
 
-    LOG_INFO("Loading image %s", file.c_str());
+    LOG_INFO("Decoded image %s", file.c_str());
 
     if (!pixels) 
     {
         throw std::runtime_error("failed to load texture image!");
     }
 
-    vk::BufferCreateInfo staging_buffer_create_info(
-        vk::BufferCreateFlags(),
-        image_size,
-        vk::BufferUsageFlagBits::eTransferSrc,
-        vk::SharingMode::eExclusive,
-        0,
-        nullptr
-    );
+    decoded.width = (uint32_t) texture_width;
+    decoded.height = (uint32_t) texture_height;
+    decoded.format = vk::Format::eR8G8B8A8Unorm;
+    decoded.mip_levels = get_texture_mip_count(decoded.width, decoded.height);
+    decoded.level_offsets.push_back(0);
+    decoded.size = get_texture_level_size(decoded.format, decoded.width, decoded.height);
+    decoded.pixels = std::shared_ptr<uint8_t>(pixels, stbi_image_free);
+
+    if (!options.cpu_mipmaps)
+    {
+        return decoded;
+    }
+
+    VkDeviceSize chain_size = 0;
+    for (uint32_t level = 0; level < decoded.mip_levels; level++)
+    {
+        if (level > 0)
+        {
+            decoded.level_offsets.push_back(chain_size);
+        }
+
+        chain_size += get_texture_level_size(decoded.format, std::max(decoded.width >> level, 1u), std::max(decoded.height >> level, 1u));
+    }
 
-    VmaAllocationCreateInfo staging_buffer_alloc_info{};
-    staging_buffer_alloc_info.flags = 0;
-    staging_buffer_alloc_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
-    staging_buffer_alloc_info.pUserData = STRING_TO_DATA("ImageStagingBuffer");
+    std::shared_ptr<uint8_t> chain(new uint8_t[(size_t) chain_size], std::default_delete<uint8_t[]>());
+    memcpy(chain.get(), pixels, (size_t) decoded.size);
 
-    std::unique_ptr<GraphicsDevmemBuffer> staging_buffer = devmem->create_buffer(staging_buffer_create_info, staging_buffer_alloc_info);
+    for (uint32_t level = 1; level < decoded.mip_levels; level++)
+    {
+        downsample_rgba8(
+            chain.get() + decoded.level_offsets[level - 1],
+            std::max(decoded.width >> (level - 1), 1u),
+            std::max(decoded.height >> (level - 1), 1u),
+            chain.get() + decoded.level_offsets[level]
+        );
+    }
 
-    void *data;
-    staging_buffer->map_memory(&data);
-    memcpy(data, pixels, image_size);
-    staging_buffer->unmap_memory();
+    decoded.size = chain_size;
+    decoded.pixels = chain;
+    return decoded;
+}
 
-    stbi_image_free(pixels);
+std::shared_ptr<GraphicsDevmemImage> RenderImageLoader::upload_image(
+    GraphicsTransferBatch& batch,
+    const DecodedImage& decoded,
+    const std::string& name
+) const
+{
+    /* Levels missing from the decoded image are blitted from level 0 */
+    vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+    if (decoded.level_offsets.size() < decoded.mip_levels)
+    {
+        usage |= vk::ImageUsageFlagBits::eTransferSrc;
+    }
 
     vk::ImageCreateInfo image_create_info(
         vk::ImageCreateFlags(),
         vk::ImageType::e2D,
-        vk::Format::eR8G8B8A8Unorm,
-        vk::Extent3D(texture_width, texture_height, 1),
-        1,
+        decoded.format,
+        vk::Extent3D(decoded.width, decoded.height, 1),
+        decoded.mip_levels,
         1,
         vk::SampleCountFlagBits::e1,
         vk::ImageTiling::eOptimal,
-        vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+        usage,
         vk::SharingMode::eExclusive,
         0,
         nullptr,
@@ -80,39 +473,72 @@ std::shared_ptr<GraphicsDevmemImage> RenderImageLoader::load_image(std::string f
     );
 
     VmaAllocationCreateInfo image_alloc_info{};
-    image_alloc_info.flags = VMA_ALLOCATION_CREATE_EXT_DONT_CREATE_STAGING_BUFFER;
+    image_alloc_info.flags = 0;
     image_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-    image_alloc_info.pUserData = STRING_TO_DATA(file.c_str());
-
-    std::unique_ptr<GraphicsDevmemImage> image = devmem->create_image(image_create_info, image_alloc_info);
-    image->transition_layout(vk::ImageLayout::eTransferDstOptimal);
-
-    vk::BufferImageCopy region(
-        0, 0,
-        0, 
-        vk::ImageSubresourceLayers(
-            vk::ImageAspectFlagBits::eColor,
-            0,
-            0,
-            1
-        ),
-        vk::Offset3D(
-            0,
-            0,
-            0
-        ),
-        vk::Extent3D(
-            texture_width,
-            texture_height,
-            1
-        )
-    );
+    image_alloc_info.pUserData = STRING_TO_DATA(name.c_str());
 
-    auto batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eGraphics);
-    batch->blit_buffer_to_image(staging_buffer->buffer, image->image, vk::ImageLayout::eTransferDstOptimal, region);
-    device->transfer_context->end_batch(std::move(batch), false);
+    std::shared_ptr<GraphicsDevmemImage> image = devmem->create_image(image_create_info, image_alloc_info);
+    image->record_transition_layout(batch, vk::ImageLayout::eTransferDstOptimal);
+
+    /*
+     * Each level already decoded is staged a band of rows at a time, so no
+     * image has to fit in the staging ring whole. Block compressed bands
+     * are whole rows of blocks.
+     */
+    uint32_t row_height = get_texture_block_size(decoded.format) != 0 ? 4 : 1;
 
-    device->device.waitIdle();
+    for (uint32_t level = 0; level < decoded.level_offsets.size(); level++)
+    {
+        uint32_t width = std::max(decoded.width >> level, 1u);
+        uint32_t height = std::max(decoded.height >> level, 1u);
+
+        VkDeviceSize row_size = get_texture_level_size(decoded.format, width, row_height);
+        uint32_t band_height = std::max((uint32_t) (batch.get_staging_chunk_size() / row_size), 1u) * row_height;
+
+        for (uint32_t y = 0; y < height; y += band_height)
+        {
+            uint32_t rows = std::min(band_height, height - y);
+            VkDeviceSize size = get_texture_level_size(decoded.format, width, rows);
+
+            GraphicsStagingRegion region = batch.stage(size);
+            memcpy(region.data, decoded.pixels.get() + decoded.level_offsets[level] + (y / row_height) * row_size, (size_t) size);
+
+            batch.blit_buffer_to_image(
+                region.buffer,
+                image->image,
+                vk::ImageLayout::eTransferDstOptimal,
+                vk::BufferImageCopy(
+                    region.offset, 0,
+                    0,
+                    vk::ImageSubresourceLayers(
+                        vk::ImageAspectFlagBits::eColor,
+                        level,
+                        0,
+                        1
+                    ),
+                    vk::Offset3D(
+                        0,
+                        (int32_t) y,
+                        0
+                    ),
+                    vk::Extent3D(
+                        width,
+                        rows,
+                        1
+                    )
+                )
+            );
+        }
+    }
+
+    if (decoded.level_offsets.size() < decoded.mip_levels)
+    {
+        image->record_generate_mipmaps(batch);
+    }
+    else
+    {
+        image->record_transition_layout(batch, vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
 
-    return std::move(image);
+    return image;
 }
@@ -24,75 +24,29 @@
 
 #include "g_shader.h"
 #include "r_camera.h"
-#include "r_scene.h"
 #include "u_debug.h"
 
-std::unique_ptr<GraphicsPipelineCreateInfo> Material::get_pipeline_create_info(std::shared_ptr<GraphicsDevice>& device)
+std::unique_ptr<GraphicsPipelineCreateInfo> Material::get_pipeline_create_info(std::shared_ptr<GraphicsDevice>& device, VertexFormat vertex_format, const BindlessTable *bindless)
 {
-    std::unique_ptr<GraphicsPipelineCreateInfo> create_info = std::make_unique<GraphicsPipelineCreateInfo>(device, "shaders/model.vert", "shaders/model.frag");
-    create_info->dynamic_states = GraphicsDynamicStateBits::ViewportBit | GraphicsDynamicStateBits::ScissorBit;
+    const char *vertex_shader = vertex_format == VertexFormat::Packed ? "shaders/model_packed.vert" : "shaders/model.vert";
+    const char *fragment_shader = bindless ? "shaders/model_bindless.frag" : "shaders/model.frag";
 
-    std::vector<vk::DescriptorPoolSize> pool_sizes{
-        vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 2),
-        vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 3)
-    };
+    std::unique_ptr<GraphicsPipelineCreateInfo> create_info = std::make_unique<GraphicsPipelineCreateInfo>(device, vertex_shader, fragment_shader);
+    create_info->vertex_format = vertex_format;
+    create_info->dynamic_states = GraphicsDynamicStateBits::ViewportBit | GraphicsDynamicStateBits::ScissorBit;
 
     /*
-     * TODO global descriptor pool allocator
+     * Layouts are reflected from the shaders and left to the pipeline
+     * builder, so materials with the same state share a pipeline and each
+     * material allocates its own set. Bindless materials all share the
+     * table's set instead, whose layout needs flags reflection can't know.
      */
-    vk::DescriptorPoolCreateInfo descriptor_pool_create_info(
-        vk::DescriptorPoolCreateFlags(0),
-        1,
-        (uint32_t)pool_sizes.size(), pool_sizes.data()
-    );
-
-    this->descriptor_pool = device->device.createDescriptorPool(descriptor_pool_create_info);
-
-    std::vector<vk::DescriptorSetLayoutBinding> set_bindings = {
-        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex),
-        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment),
-        vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment),
-        vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment),
-        vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment),
-    };
-
-    vk::DescriptorSetLayoutCreateInfo set_create_info(
-        vk::DescriptorSetLayoutCreateFlags(0),
-        (uint32_t)set_bindings.size(), set_bindings.data()
-    );
-
-    create_info->descriptor_set_layout = device->device.createDescriptorSetLayout(set_create_info);
-
-    vk::DescriptorSetAllocateInfo descriptor_set_alloc_info(
-        descriptor_pool,
-        1, &create_info->descriptor_set_layout
-    );
-
-    create_info->descriptor_set = device->device.allocateDescriptorSets(descriptor_set_alloc_info)[0];
-
-    std::vector<vk::DescriptorSetLayout> descriptor_sets{
-        create_info->descriptor_set_layout
-    };
-
-    std::vector<vk::PushConstantRange> push_constant_ranges{
-        vk::PushConstantRange(
-            vk::ShaderStageFlagBits::eVertex,
-            0, sizeof(VertexShaderData)
-        ),
-        vk::PushConstantRange(
-            vk::ShaderStageFlagBits::eFragment,
-            sizeof(VertexShaderData), sizeof(MaterialShaderData)
-        ),
-    };
-
-    vk::PipelineLayoutCreateInfo pipeline_layout_create_info(
-        vk::PipelineLayoutCreateFlags(0),
-        (uint32_t)descriptor_sets.size(), descriptor_sets.data(),
-        (uint32_t)push_constant_ranges.size(), push_constant_ranges.data()
-    );
+    if (bindless)
+    {
+        create_info->descriptor_set_layout = bindless->get_set_layout();
+        create_info->pipeline_layout = bindless->get_pipeline_layout();
+    }
 
-    create_info->pipeline_layout = device->device.createPipelineLayout(pipeline_layout_create_info);
-    
     create_info->color_attachments = {
         // Final Presented Image
         vk::PipelineColorBlendAttachmentState(
@@ -138,25 +92,92 @@ Material::Material(
     glm::vec4 diffuse,
     glm::vec4 specular,
     float alpha,
-    std::shared_ptr<GraphicsDevmemImage>& ambient_texture,
-    std::shared_ptr<GraphicsDevmemImage>& diffuse_texture,
-    std::shared_ptr<GraphicsDevmemImage>& specular_texture
+    std::shared_ptr<RenderTexture> ambient_texture,
+    std::shared_ptr<RenderTexture> diffuse_texture,
+    std::shared_ptr<RenderTexture> specular_texture,
+    VertexFormat vertex_format
 )
     : device(device),
       renderer(renderer),
-      pipeline(std::move(renderer->get_renderpass()->create_pipeline(std::move(this->get_pipeline_create_info(device))))),
+      bindless(renderer->get_bindless()),
+      pipeline(renderer->get_renderpass()->create_pipeline_async(get_pipeline_create_info(device, vertex_format, bindless))),
       ambient_texture(ambient_texture),
       diffuse_texture(diffuse_texture),
       specular_texture(specular_texture),
       shader_data(ambient, diffuse, specular, alpha)
 {
-    this->write_descriptor_update();
+    this->frames_stale.assign(renderer->get_frame_count(), false);
+
+    if (bindless)
+    {
+        this->bindless_index = bindless->add_material();
+    }
+    else
+    {
+        for (uint32_t i = 0; i < renderer->get_frame_count(); i++)
+        {
+            this->descriptor_sets.push_back(device->descriptor_allocator->allocate(this->pipeline->get_descriptor_set_layout()));
+        }
+    }
+
+    /* Nothing has drawn with the material yet, so every frame is written now */
+    this->texture_generation = this->get_texture_generation();
+    for (uint32_t i = 0; i < renderer->get_frame_count(); i++)
+    {
+        this->write_descriptor_update(i);
+    }
+}
+
+uint32_t Material::get_texture_generation() const
+{
+    uint32_t generation = 0;
+
+    for (const auto & texture : { &ambient_texture, &diffuse_texture, &specular_texture })
+    {
+        if (*texture)
+        {
+            generation += (*texture)->get_generation();
+        }
+    }
+
+    return generation;
+}
+
+bool Material::refresh_textures()
+{
+    uint32_t generation = this->get_texture_generation();
+
+    if (generation == this->texture_generation)
+    {
+        return false;
+    }
+
+    this->texture_generation = generation;
+    this->frames_stale.assign(this->frames_stale.size(), true);
+    return true;
 }
 
-void Material::write_descriptor_update()
+bool Material::update_frame(uint32_t frame)
 {
+    if (!this->frames_stale[frame])
+    {
+        return false;
+    }
+
+    this->write_descriptor_update(frame);
+    this->frames_stale[frame] = false;
+    return true;
+}
+
+void Material::write_descriptor_update(uint32_t frame)
+{
+    if (bindless)
+    {
+        bindless->write_material(bindless_index, frame, shader_data, ambient_texture, diffuse_texture, specular_texture);
+        return;
+    }
+
     vk::DescriptorBufferInfo camera_buffer = Camera::get()->get_buffer_info();
-    vk::DescriptorBufferInfo light_buffer = Scene::get()->get_light_data_info();
     vk::DescriptorImageInfo ambient_sampler_info;
     vk::DescriptorImageInfo diffuse_sampler_info;
     vk::DescriptorImageInfo specular_sampler_info;
@@ -167,34 +188,16 @@ void Material::write_descriptor_update()
             0,
             0,
             1,
-            vk::DescriptorType::eUniformBuffer,
+            vk::DescriptorType::eUniformBufferDynamic,
             nullptr,
             &camera_buffer,
             nullptr
-        ),
-        vk::WriteDescriptorSet(
-            vk::DescriptorSet(),
-            1,
-            0,
-            1,
-            vk::DescriptorType::eUniformBuffer,
-            nullptr,
-            &light_buffer,
-            nullptr
         )
     };
 
     if (this->ambient_texture)
     {
-        ambient_sampler = std::make_unique<GraphicsImageSampler>(
-            device, 
-            this->ambient_texture, 
-            vk::SamplerAddressMode::eClampToBorder,
-            vk::SamplerAddressMode::eClampToBorder,
-            vk::SamplerAddressMode::eClampToBorder,
-            vk::BorderColor::eFloatOpaqueWhite
-        );
-        ambient_sampler_info = ambient_sampler->get_image_info();
+        ambient_sampler_info = this->ambient_texture->get_sampler()->get_image_info();
 
         writes.push_back(
             vk::WriteDescriptorSet(
@@ -212,15 +215,7 @@ void Material::write_descriptor_update()
 
     if (this->diffuse_texture)
     {
-        diffuse_sampler = std::make_unique<GraphicsImageSampler>(
-            device, 
-            this->diffuse_texture,
-            vk::SamplerAddressMode::eClampToBorder,
-            vk::SamplerAddressMode::eClampToBorder,
-            vk::SamplerAddressMode::eClampToBorder,
-            vk::BorderColor::eFloatOpaqueWhite
-        );
-        diffuse_sampler_info = diffuse_sampler->get_image_info();
+        diffuse_sampler_info = this->diffuse_texture->get_sampler()->get_image_info();
 
         writes.push_back(
             vk::WriteDescriptorSet(
@@ -238,15 +233,7 @@ void Material::write_descriptor_update()
 
     if (this->specular_texture)
     {
-        specular_sampler = std::make_unique<GraphicsImageSampler>(
-            device, 
-            this->specular_texture,
-            vk::SamplerAddressMode::eClampToBorder,
-            vk::SamplerAddressMode::eClampToBorder,
-            vk::SamplerAddressMode::eClampToBorder,
-            vk::BorderColor::eFloatOpaqueWhite
-        );
-        specular_sampler_info = specular_sampler->get_image_info();
+        specular_sampler_info = this->specular_texture->get_sampler()->get_image_info();
 
         writes.push_back(
             vk::WriteDescriptorSet(
@@ -262,21 +249,51 @@ void Material::write_descriptor_update()
         );
     }
 
-	this->pipeline->update_descriptor_sets(writes);
+	this->pipeline->update_descriptor_sets(writes, descriptor_sets[frame].set);
 }
 
 Material::~Material()
 {
-    this->device->device.destroyDescriptorPool(descriptor_pool);
+    /* Frames in flight may still read the material's slot or set */
+    if (bindless)
+    {
+        BindlessTable *bindless = this->bindless;
+        uint32_t bindless_index = this->bindless_index;
+
+        this->device->retire_queue->retire([bindless, bindless_index]() {
+            bindless->remove_material(bindless_index);
+        });
+    }
+    else
+    {
+        GraphicsDevice *device = this->device.get();
+        std::vector<GraphicsDescriptorSet> descriptor_sets = this->descriptor_sets;
+
+        this->device->retire_queue->retire([device, descriptor_sets]() {
+            for (const auto & descriptor_set : descriptor_sets)
+            {
+                device->descriptor_allocator->free(descriptor_set);
+            }
+        });
+    }
 }
 
-void Material::bind_material(vk::CommandBuffer cmd) const
+void Material::bind_material(vk::CommandBuffer cmd, uint32_t frame) const
 {
 	cmd.setViewport(0, { vk::Viewport(0, 0, 800, 800) });
 	cmd.setScissor(0, { vk::Rect2D({ 0, 0 },{ 800, 800 }) });
 
 	pipeline->bind_pipeline(cmd);
 
+	/* Material parameters are read from the table by index */
+	if (bindless)
+	{
+		bindless->bind(cmd, frame);
+		return;
+	}
+
+	pipeline->bind_descriptor_set(cmd, descriptor_sets[frame].set, { Camera::get()->get_dynamic_offset(frame) });
+
 	this->pipeline->push_shader_data(cmd, sizeof(VertexShaderData), vk::ShaderStageFlagBits::eFragment, sizeof(MaterialShaderData), (void *)&shader_data);
 }
 
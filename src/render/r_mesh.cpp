@@ -0,0 +1,321 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "r_mesh.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <glm/gtc/packing.hpp>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include "u_debug.h"
+#include "u_io.h"
+
+static glm::vec4 get_vertex(const tinyobj::attrib_t& attrib, int index)
+{
+    if (index == -1)
+        return { 0, 0, 0, 0 };
+
+    return { attrib.vertices[3 * index], attrib.vertices[3 * index + 1], attrib.vertices[3 * index + 2], 1.0f };
+}
+
+static glm::vec4 get_normal(const tinyobj::attrib_t& attrib, int index)
+{
+    if (index == -1)
+        return { 0, 0, 0, 0 };
+
+    return { attrib.normals[3 * index], attrib.normals[3 * index + 1], attrib.normals[3 * index + 2], 1.0f };
+}
+
+static glm::vec2 get_uv(const tinyobj::attrib_t& attrib, int index)
+{
+    if (index == -1)
+        return { 0, 0 };
+
+    return { attrib.texcoords[2 * index], 1 - attrib.texcoords[2 * index + 1] };
+}
+
+/*
+ * A face corner is uniquely identified by its position, normal and uv indices
+ */
+struct ObjVertexKey
+{
+    int vertex_index;
+    int normal_index;
+    int texcoord_index;
+
+    bool operator==(const ObjVertexKey& other) const
+    {
+        return vertex_index == other.vertex_index && normal_index == other.normal_index && texcoord_index == other.texcoord_index;
+    }
+};
+
+struct ObjVertexKeyHash
+{
+    std::size_t operator()(const ObjVertexKey& key) const noexcept
+    {
+        std::size_t h = (std::size_t) key.vertex_index * 73856093u;
+        h ^= (std::size_t) key.normal_index * 19349663u;
+        h ^= (std::size_t) key.texcoord_index * 83492791u;
+        return h;
+    }
+};
+
+static glm::vec4 to_vec4(const float f[3])
+{
+    return glm::vec4(f[0], f[1], f[2], 1.0f);
+}
+
+MeshView MeshData::get_view() const
+{
+    MeshView view;
+    view.verticies = verticies.data();
+    view.vertex_count = (uint32_t) verticies.size();
+    view.indicies = indicies.data();
+    view.index_count = (uint32_t) indicies.size();
+    view.submeshes = submeshes;
+    view.lods = lods;
+    view.bounds = bounds;
+    view.vertex_format = vertex_format;
+    return view;
+}
+
+void MeshData::compute_bounds()
+{
+    if (verticies.empty())
+    {
+        bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+        return;
+    }
+
+    bounds.min = glm::vec3(verticies[0].position);
+    bounds.max = glm::vec3(verticies[0].position);
+
+    for (const auto & vertex : verticies)
+    {
+        bounds.min = glm::min(bounds.min, glm::vec3(vertex.position));
+        bounds.max = glm::max(bounds.max, glm::vec3(vertex.position));
+    }
+}
+
+MeshData load_obj_mesh(const std::string& path)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> obj_materials;
+    std::string err;
+
+    LOG_INFO("Parsing obj model %s", path.c_str());
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &obj_materials, &err, FILENAME_TO_PATH(path).c_str(), FILENAME_TO_PATH(std::string("models")).c_str()))
+    {
+        throw std::runtime_error(err);
+    }
+
+    if (err.length() > 0)
+    {
+        LOG_WARN("TinyObjLoading Output:\n%s", err.c_str());
+    }
+
+    MeshData mesh;
+    mesh.vertex_format = VertexFormat::Standard;
+
+    /* Material 0 is the default material, used by faces without a material */
+    mesh.materials.push_back({
+        glm::vec4(1, 1, 1, 1),
+        glm::vec4(1, 1, 1, 1),
+        glm::vec4(1, 1, 1, 1),
+        1.0f,
+        std::string()
+    });
+
+    for (const auto & material : obj_materials)
+    {
+        mesh.materials.push_back({
+            to_vec4(material.ambient),
+            to_vec4(material.diffuse),
+            to_vec4(material.specular),
+            material.dissolve,
+            material.diffuse_texname
+        });
+    }
+
+    std::vector<std::vector<uint32_t>> buckets(mesh.materials.size());
+    std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> unique_verticies;
+    size_t corner_count = 0;
+
+    unique_verticies.reserve(attrib.vertices.size() / 3);
+
+    for (const auto & shape : shapes)
+    {
+        size_t i = 0, m = 0;
+
+        for (auto num_vertices : shape.mesh.num_face_vertices)
+        {
+            for (int j = 0; j < num_vertices; i++, j++)
+            {
+                auto index = shape.mesh.indices[i];
+                ObjVertexKey key = { index.vertex_index, index.normal_index, index.texcoord_index };
+
+                /* Weld corners that share all attributes into a single vertex */
+                auto result = unique_verticies.emplace(key, (uint32_t) mesh.verticies.size());
+                if (result.second)
+                {
+                    mesh.verticies.push_back(
+                        Vertex(
+                            get_vertex(attrib, index.vertex_index),
+                            get_normal(attrib, index.normal_index),
+                            { 1.0f, 1.0f, 1.0f, 1.0f },
+                            get_uv(attrib, index.texcoord_index)
+                        )
+                    );
+                }
+
+                buckets[shape.mesh.material_ids[m] + 1].push_back(result.first->second);
+                corner_count++;
+            }
+
+            m++;
+        }
+    }
+
+    /* Flatten the per material buckets into a single index list */
+    for (uint32_t material = 0; material < buckets.size(); material++)
+    {
+        if (buckets[material].empty())
+        {
+            continue;
+        }
+
+        mesh.submeshes.push_back({ material, (uint32_t) mesh.indicies.size(), (uint32_t) buckets[material].size() });
+        mesh.indicies.insert(mesh.indicies.end(), buckets[material].begin(), buckets[material].end());
+    }
+
+    mesh.lods.push_back({ 0, (uint32_t) mesh.submeshes.size(), 0.0f });
+    mesh.compute_bounds();
+
+    LOG_INFO("Welded %s: %zu face corners to %zu verticies (%.2fx)",
+        path.c_str(), corner_count, mesh.verticies.size(),
+        mesh.verticies.empty() ? 0.0 : (double) corner_count / mesh.verticies.size());
+
+    return mesh;
+}
+
+/*
+ * fp16 keeps 11 significant bits, so a mesh far from its origin or with large
+ * tiling uvs loses precision and stays in the standard format
+ */
+#define PACKED_POSITION_TOLERANCE (1.0f / 2048.0f)
+#define PACKED_UV_TOLERANCE (1.0f / 2048.0f)
+
+static float half_round_trip(float f)
+{
+    return glm::unpackHalf1x16(glm::packHalf1x16(f));
+}
+
+VertexFormat choose_vertex_format(const MeshView& mesh)
+{
+    float position_tolerance = glm::length(mesh.bounds.max - mesh.bounds.min) * PACKED_POSITION_TOLERANCE;
+    float position_error = 0.0f;
+    float uv_error = 0.0f;
+
+    for (uint32_t i = 0; i < mesh.vertex_count; i++)
+    {
+        const Vertex& vertex = mesh.verticies[i];
+
+        for (int c = 0; c < 3; c++)
+        {
+            position_error = std::max(position_error, fabsf(half_round_trip(vertex.position[c]) - vertex.position[c]));
+        }
+
+        for (int c = 0; c < 2; c++)
+        {
+            uv_error = std::max(uv_error, fabsf(half_round_trip(vertex.uv[c]) - vertex.uv[c]));
+        }
+    }
+
+    /* NaN errors from out of range values fail both comparisons */
+    if (position_error <= position_tolerance && uv_error <= PACKED_UV_TOLERANCE)
+    {
+        return VertexFormat::Packed;
+    }
+
+    LOG_INFO("Mesh does not fit packed verticies (position error %f, uv error %f)", position_error, uv_error);
+    return VertexFormat::Standard;
+}
+
+static glm::vec2 encode_octahedral(glm::vec3 n)
+{
+    float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+
+    if (sum <= 0.0f)
+    {
+        return glm::vec2(0.0f, 0.0f);
+    }
+
+    n /= sum;
+
+    glm::vec2 e(n.x, n.y);
+
+    if (n.z < 0.0f)
+    {
+        e.x = (1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    return e;
+}
+
+PackedVertex pack_vertex(const Vertex& vertex)
+{
+    glm::vec2 normal = encode_octahedral(glm::vec3(vertex.normal));
+
+    PackedVertex packed;
+    packed.position[0] = glm::packHalf1x16(vertex.position.x);
+    packed.position[1] = glm::packHalf1x16(vertex.position.y);
+    packed.position[2] = glm::packHalf1x16(vertex.position.z);
+    packed.position[3] = glm::packHalf1x16(1.0f);
+    packed.normal[0] = glm::packSnorm1x16(normal.x);
+    packed.normal[1] = glm::packSnorm1x16(normal.y);
+    packed.uv[0] = glm::packHalf1x16(vertex.uv.x);
+    packed.uv[1] = glm::packHalf1x16(vertex.uv.y);
+    return packed;
+}
+
+void write_verticies(void *destination, const Vertex *verticies, uint32_t count, VertexFormat format)
+{
+    if (format == VertexFormat::Standard)
+    {
+        memcpy(destination, verticies, count * sizeof(Vertex));
+        return;
+    }
+
+    PackedVertex *packed = (PackedVertex *) destination;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        packed[i] = pack_vertex(verticies[i]);
+    }
+}
@@ -0,0 +1,260 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "r_mesh_file.h"
+
+#include <cstring>
+
+#include "u_debug.h"
+
+#define MESH_FILE_ALIGNMENT 16
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + MESH_FILE_ALIGNMENT - 1) & ~((uint64_t) MESH_FILE_ALIGNMENT - 1);
+}
+
+static bool section_in_bounds(uint64_t offset, uint64_t count, uint64_t stride, size_t size)
+{
+    return offset <= size && count <= (size - offset) / stride;
+}
+
+MeshFile::MeshFile()
+    : mapping{ 0, nullptr, nullptr }, header(nullptr)
+{
+}
+
+MeshFile::~MeshFile()
+{
+    unmap_file(&mapping);
+}
+
+bool MeshFile::open(const std::string& path, const file_stamp *source_stamp)
+{
+    DEBUG_ASSERT(header == nullptr);
+
+    if (!map_file(path, &mapping))
+    {
+        return false;
+    }
+
+    header = (const MeshFileHeader *) mapping.data;
+
+    if (!validate(source_stamp))
+    {
+        LOG_INFO("Cooked mesh %s is stale, ignoring", path.c_str());
+        unmap_file(&mapping);
+        header = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshFile::validate(const file_stamp *source_stamp) const
+{
+    if (mapping.size < sizeof(MeshFileHeader) ||
+        header->magic != MESH_FILE_MAGIC ||
+        header->version != MESH_FILE_VERSION ||
+        header->vertex_stride != sizeof(Vertex) ||
+        header->vertex_format > (uint32_t) VertexFormat::Packed)
+    {
+        return false;
+    }
+
+    /* Only check staleness when the source asset is available */
+    if (source_stamp != nullptr &&
+        (header->source_size != source_stamp->size || header->source_mtime != source_stamp->mtime))
+    {
+        return false;
+    }
+
+    bool sections_valid = section_in_bounds(header->vertex_offset, header->vertex_count, sizeof(Vertex), mapping.size) &&
+        section_in_bounds(header->index_offset, header->index_count, sizeof(uint32_t), mapping.size) &&
+        section_in_bounds(header->submesh_offset, header->submesh_count, sizeof(MeshFileSubmesh), mapping.size) &&
+        section_in_bounds(header->lod_offset, header->lod_count, sizeof(MeshFileLod), mapping.size) &&
+        section_in_bounds(header->material_offset, header->material_count, sizeof(MeshFileMaterial), mapping.size) &&
+        section_in_bounds(header->string_table_offset, header->string_table_size, 1, mapping.size);
+
+    if (!sections_valid || header->lod_count == 0)
+    {
+        return false;
+    }
+
+    const MeshFileLod *lods = get_section<MeshFileLod>(header->lod_offset);
+    for (uint32_t i = 0; i < header->lod_count; i++)
+    {
+        if ((uint64_t) lods[i].submesh_start + lods[i].submesh_count > header->submesh_count)
+        {
+            return false;
+        }
+    }
+
+    /* Submeshes index straight into the index buffer and material list when drawn */
+    const MeshFileSubmesh *submeshes = get_section<MeshFileSubmesh>(header->submesh_offset);
+    for (uint32_t i = 0; i < header->submesh_count; i++)
+    {
+        if ((uint64_t) submeshes[i].start_index + submeshes[i].index_count > header->index_count ||
+            submeshes[i].material >= header->material_count)
+        {
+            return false;
+        }
+    }
+
+    /* Draws offset indices by the mesh's base vertex in the shared arena, out of range ones read other meshes */
+    const uint32_t *indicies = get_section<uint32_t>(header->index_offset);
+    for (uint32_t i = 0; i < header->index_count; i++)
+    {
+        if (indicies[i] >= header->vertex_count)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+MeshView MeshFile::get_view() const
+{
+    DEBUG_ASSERT(header != nullptr);
+
+    MeshView view;
+    view.verticies = get_section<Vertex>(header->vertex_offset);
+    view.vertex_count = header->vertex_count;
+    view.indicies = get_section<uint32_t>(header->index_offset);
+    view.index_count = header->index_count;
+    view.vertex_format = (VertexFormat) header->vertex_format;
+    view.bounds.min = glm::vec3(header->bounds_min[0], header->bounds_min[1], header->bounds_min[2]);
+    view.bounds.max = glm::vec3(header->bounds_max[0], header->bounds_max[1], header->bounds_max[2]);
+
+    const MeshFileSubmesh *submeshes = get_section<MeshFileSubmesh>(header->submesh_offset);
+    for (uint32_t i = 0; i < header->submesh_count; i++)
+    {
+        view.submeshes.push_back({ submeshes[i].material, submeshes[i].start_index, submeshes[i].index_count });
+    }
+
+    const MeshFileLod *lods = get_section<MeshFileLod>(header->lod_offset);
+    for (uint32_t i = 0; i < header->lod_count; i++)
+    {
+        view.lods.push_back({ lods[i].submesh_start, lods[i].submesh_count, lods[i].error });
+    }
+
+    return view;
+}
+
+std::vector<MeshMaterialInfo> MeshFile::get_materials() const
+{
+    DEBUG_ASSERT(header != nullptr);
+
+    std::vector<MeshMaterialInfo> materials;
+    const MeshFileMaterial *file_materials = get_section<MeshFileMaterial>(header->material_offset);
+    const char *strings = get_section<char>(header->string_table_offset);
+
+    for (uint32_t i = 0; i < header->material_count; i++)
+    {
+        const MeshFileMaterial& material = file_materials[i];
+        std::string texture;
+
+        if (material.diffuse_texture_length > 0 &&
+            (uint64_t) material.diffuse_texture_offset + material.diffuse_texture_length <= header->string_table_size)
+        {
+            texture.assign(strings + material.diffuse_texture_offset, material.diffuse_texture_length);
+        }
+
+        materials.push_back({
+            glm::vec4(material.ambient[0], material.ambient[1], material.ambient[2], material.ambient[3]),
+            glm::vec4(material.diffuse[0], material.diffuse[1], material.diffuse[2], material.diffuse[3]),
+            glm::vec4(material.specular[0], material.specular[1], material.specular[2], material.specular[3]),
+            material.alpha,
+            texture
+        });
+    }
+
+    return materials;
+}
+
+bool MeshFile::write(const std::string& path, const MeshData& mesh, const file_stamp& source_stamp)
+{
+    std::vector<MeshFileSubmesh> submeshes;
+    std::vector<MeshFileLod> lods;
+    std::vector<MeshFileMaterial> materials;
+    std::string strings;
+
+    for (const auto & submesh : mesh.submeshes)
+    {
+        submeshes.push_back({ submesh.material, submesh.start_index, submesh.index_count, 0 });
+    }
+
+    for (const auto & lod : mesh.lods)
+    {
+        lods.push_back({ lod.submesh_start, lod.submesh_count, lod.error, 0 });
+    }
+
+    for (const auto & material : mesh.materials)
+    {
+        MeshFileMaterial file_material{};
+        memcpy(file_material.ambient, &material.ambient, sizeof(file_material.ambient));
+        memcpy(file_material.diffuse, &material.diffuse, sizeof(file_material.diffuse));
+        memcpy(file_material.specular, &material.specular, sizeof(file_material.specular));
+        file_material.alpha = material.alpha;
+        file_material.diffuse_texture_offset = (uint32_t) strings.size();
+        file_material.diffuse_texture_length = (uint32_t) material.diffuse_texture.size();
+        strings += material.diffuse_texture;
+
+        materials.push_back(file_material);
+    }
+
+    MeshFileHeader header{};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.source_size = source_stamp.size;
+    header.source_mtime = source_stamp.mtime;
+    header.vertex_count = (uint32_t) mesh.verticies.size();
+    header.vertex_stride = sizeof(Vertex);
+    header.index_count = (uint32_t) mesh.indicies.size();
+    header.submesh_count = (uint32_t) submeshes.size();
+    header.material_count = (uint32_t) materials.size();
+    header.string_table_size = (uint32_t) strings.size();
+    header.lod_count = (uint32_t) lods.size();
+    header.vertex_format = (uint32_t) mesh.vertex_format;
+    memcpy(header.bounds_min, &mesh.bounds.min, sizeof(header.bounds_min));
+    memcpy(header.bounds_max, &mesh.bounds.max, sizeof(header.bounds_max));
+
+    header.vertex_offset = align_offset(sizeof(MeshFileHeader));
+    header.index_offset = align_offset(header.vertex_offset + mesh.verticies.size() * sizeof(Vertex));
+    header.submesh_offset = align_offset(header.index_offset + mesh.indicies.size() * sizeof(uint32_t));
+    header.lod_offset = align_offset(header.submesh_offset + submeshes.size() * sizeof(MeshFileSubmesh));
+    header.material_offset = align_offset(header.lod_offset + lods.size() * sizeof(MeshFileLod));
+    header.string_table_offset = align_offset(header.material_offset + materials.size() * sizeof(MeshFileMaterial));
+
+    std::vector<char> data(header.string_table_offset + strings.size());
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + header.vertex_offset, mesh.verticies.data(), mesh.verticies.size() * sizeof(Vertex));
+    memcpy(data.data() + header.index_offset, mesh.indicies.data(), mesh.indicies.size() * sizeof(uint32_t));
+    memcpy(data.data() + header.submesh_offset, submeshes.data(), submeshes.size() * sizeof(MeshFileSubmesh));
+    memcpy(data.data() + header.lod_offset, lods.data(), lods.size() * sizeof(MeshFileLod));
+    memcpy(data.data() + header.material_offset, materials.data(), materials.size() * sizeof(MeshFileMaterial));
+    memcpy(data.data() + header.string_table_offset, strings.data(), strings.size());
+
+    LOG_INFO("Writing cooked mesh %s (%zu bytes)", path.c_str(), data.size());
+
+    return write_file(path, data.data(), data.size());
+}
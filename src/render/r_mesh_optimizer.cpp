@@ -0,0 +1,349 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "r_mesh_optimizer.h"
+
+#include <algorithm>
+
+#include "u_debug.h"
+
+MeshCacheStats analyze_vertex_cache(const uint32_t *indicies, size_t index_count, size_t vertex_count, uint32_t cache_size)
+{
+    std::vector<uint32_t> timestamps(vertex_count, 0);
+    std::vector<bool> referenced(vertex_count, false);
+    uint32_t timestamp = cache_size + 1;
+    size_t misses = 0;
+    size_t unique = 0;
+
+    for (size_t i = 0; i < index_count; i++)
+    {
+        uint32_t index = indicies[i];
+
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            unique++;
+        }
+
+        /* A vertex is still cached if fewer than cache_size misses happened since it was loaded */
+        if (timestamp - timestamps[index] > cache_size)
+        {
+            timestamps[index] = timestamp++;
+            misses++;
+        }
+    }
+
+    MeshCacheStats stats;
+    stats.acmr = index_count > 0 ? (float) misses / (index_count / 3) : 0.0f;
+    stats.atvr = unique > 0 ? (float) misses / unique : 0.0f;
+    return stats;
+}
+
+struct TipsifyState
+{
+    std::vector<uint32_t> adjacency_offsets;
+    std::vector<uint32_t> adjacency;
+    std::vector<uint32_t> live_triangles;
+    std::vector<uint32_t> cache_timestamps;
+    std::vector<uint32_t> dead_end;
+    std::vector<bool> emitted;
+};
+
+static int tipsify_skip_dead_end(TipsifyState& state, size_t vertex_count, size_t& cursor)
+{
+    while (!state.dead_end.empty())
+    {
+        uint32_t vertex = state.dead_end.back();
+        state.dead_end.pop_back();
+
+        if (state.live_triangles[vertex] > 0)
+        {
+            return (int) vertex;
+        }
+    }
+
+    while (cursor < vertex_count)
+    {
+        if (state.live_triangles[cursor] > 0)
+        {
+            return (int) cursor;
+        }
+
+        cursor++;
+    }
+
+    return -1;
+}
+
+static int tipsify_next_vertex(TipsifyState& state, const std::vector<uint32_t>& candidates, uint32_t timestamp, uint32_t cache_size)
+{
+    int best = -1;
+    int best_priority = -1;
+
+    for (uint32_t vertex : candidates)
+    {
+        if (state.live_triangles[vertex] == 0)
+        {
+            continue;
+        }
+
+        /* Prefer verticies that will still be in the cache once all their triangles are emitted */
+        int priority = 0;
+        if (timestamp - state.cache_timestamps[vertex] + 2 * state.live_triangles[vertex] <= cache_size)
+        {
+            priority = timestamp - state.cache_timestamps[vertex];
+        }
+
+        if (priority > best_priority)
+        {
+            best_priority = priority;
+            best = (int) vertex;
+        }
+    }
+
+    return best;
+}
+
+void optimize_vertex_cache(uint32_t *indicies, size_t index_count, size_t vertex_count, std::vector<uint32_t> *clusters, uint32_t cache_size)
+{
+    size_t triangle_count = index_count / 3;
+    TipsifyState state;
+
+    clusters->clear();
+
+    if (triangle_count == 0)
+    {
+        return;
+    }
+
+    /* Build vertex to triangle adjacency */
+    state.live_triangles.assign(vertex_count, 0);
+    for (size_t i = 0; i < index_count; i++)
+    {
+        state.live_triangles[indicies[i]]++;
+    }
+
+    state.adjacency_offsets.assign(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++)
+    {
+        state.adjacency_offsets[v + 1] = state.adjacency_offsets[v] + state.live_triangles[v];
+    }
+
+    std::vector<uint32_t> fill(state.adjacency_offsets.begin(), state.adjacency_offsets.end() - 1);
+    state.adjacency.resize(index_count);
+    for (size_t i = 0; i < index_count; i++)
+    {
+        state.adjacency[fill[indicies[i]]++] = (uint32_t) (i / 3);
+    }
+
+    state.cache_timestamps.assign(vertex_count, 0);
+    state.emitted.assign(triangle_count, false);
+
+    std::vector<uint32_t> output;
+    std::vector<uint32_t> candidates;
+    output.reserve(index_count);
+
+    uint32_t timestamp = cache_size + 1;
+    size_t cursor = 0;
+    int fanning = tipsify_skip_dead_end(state, vertex_count, cursor);
+
+    clusters->push_back(0);
+
+    while (fanning >= 0)
+    {
+        candidates.clear();
+
+        for (uint32_t a = state.adjacency_offsets[fanning]; a < state.adjacency_offsets[fanning + 1]; a++)
+        {
+            uint32_t triangle = state.adjacency[a];
+
+            if (state.emitted[triangle])
+            {
+                continue;
+            }
+
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                uint32_t vertex = indicies[triangle * 3 + c];
+
+                output.push_back(vertex);
+                state.dead_end.push_back(vertex);
+                candidates.push_back(vertex);
+                state.live_triangles[vertex]--;
+
+                if (timestamp - state.cache_timestamps[vertex] > cache_size)
+                {
+                    state.cache_timestamps[vertex] = timestamp++;
+                }
+            }
+
+            state.emitted[triangle] = true;
+        }
+
+        fanning = tipsify_next_vertex(state, candidates, timestamp, cache_size);
+
+        if (fanning < 0)
+        {
+            /* Jumping elsewhere in the mesh effectively flushes the cache, start a new cluster */
+            fanning = tipsify_skip_dead_end(state, vertex_count, cursor);
+
+            if (fanning >= 0 && output.size() / 3 != clusters->back())
+            {
+                clusters->push_back((uint32_t) (output.size() / 3));
+            }
+        }
+    }
+
+    DEBUG_ASSERT(output.size() == index_count);
+    std::copy(output.begin(), output.end(), indicies);
+}
+
+void optimize_overdraw(uint32_t *indicies, size_t index_count, const Vertex *verticies, const std::vector<uint32_t>& clusters)
+{
+    size_t triangle_count = index_count / 3;
+
+    if (clusters.size() < 2)
+    {
+        return;
+    }
+
+    struct ClusterSortKey
+    {
+        uint32_t start;
+        uint32_t end;
+        float sort_key;
+    };
+
+    std::vector<ClusterSortKey> keys;
+    glm::vec3 mesh_centroid(0.0f);
+    float mesh_area = 0.0f;
+
+    std::vector<glm::vec3> cluster_centroids(clusters.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> cluster_normals(clusters.size(), glm::vec3(0.0f));
+    std::vector<float> cluster_areas(clusters.size(), 0.0f);
+
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : (uint32_t) triangle_count;
+
+        for (uint32_t t = clusters[c]; t < end; t++)
+        {
+            glm::vec3 p0(verticies[indicies[t * 3 + 0]].position);
+            glm::vec3 p1(verticies[indicies[t * 3 + 1]].position);
+            glm::vec3 p2(verticies[indicies[t * 3 + 2]].position);
+
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal) * 0.5f;
+            glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+
+            cluster_centroids[c] += centroid * area;
+            cluster_normals[c] += normal;
+            cluster_areas[c] += area;
+        }
+
+        mesh_centroid += cluster_centroids[c];
+        mesh_area += cluster_areas[c];
+
+        keys.push_back({ clusters[c], end, 0.0f });
+    }
+
+    if (mesh_area <= 0.0f)
+    {
+        return;
+    }
+
+    mesh_centroid /= mesh_area;
+
+    /* Clusters facing away from the mesh centre are likely occluders, draw them first */
+    for (size_t c = 0; c < keys.size(); c++)
+    {
+        if (cluster_areas[c] <= 0.0f)
+        {
+            continue;
+        }
+
+        glm::vec3 centroid = cluster_centroids[c] / cluster_areas[c];
+        float normal_length = glm::length(cluster_normals[c]);
+        glm::vec3 normal = normal_length > 0.0f ? cluster_normals[c] / normal_length : glm::vec3(0.0f);
+
+        keys[c].sort_key = glm::dot(centroid - mesh_centroid, normal);
+    }
+
+    std::stable_sort(keys.begin(), keys.end(), [](const ClusterSortKey& a, const ClusterSortKey& b) {
+        return a.sort_key > b.sort_key;
+    });
+
+    std::vector<uint32_t> output;
+    output.reserve(index_count);
+
+    for (const auto & key : keys)
+    {
+        output.insert(output.end(), indicies + key.start * 3, indicies + key.end * 3);
+    }
+
+    std::copy(output.begin(), output.end(), indicies);
+}
+
+void optimize_vertex_fetch(MeshData *mesh)
+{
+    std::vector<uint32_t> remap(mesh->verticies.size(), UINT32_MAX);
+    std::vector<Vertex> verticies;
+    verticies.reserve(mesh->verticies.size());
+
+    for (auto & index : mesh->indicies)
+    {
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = (uint32_t) verticies.size();
+            verticies.push_back(mesh->verticies[index]);
+        }
+
+        index = remap[index];
+    }
+
+    mesh->verticies.swap(verticies);
+}
+
+void optimize_mesh(MeshData *mesh)
+{
+#ifdef ENABLE_DEBUG_LOGGING
+    /* Only worth the extra passes when it will be logged, mesh-bench reports it otherwise */
+    MeshCacheStats before = analyze_vertex_cache(mesh->indicies.data(), mesh->indicies.size(), mesh->verticies.size());
+#endif
+
+    std::vector<uint32_t> clusters;
+
+    for (const auto & submesh : mesh->submeshes)
+    {
+        uint32_t *indicies = mesh->indicies.data() + submesh.start_index;
+
+        optimize_vertex_cache(indicies, submesh.index_count, mesh->verticies.size(), &clusters);
+        optimize_overdraw(indicies, submesh.index_count, mesh->verticies.data(), clusters);
+    }
+
+    optimize_vertex_fetch(mesh);
+
+#ifdef ENABLE_DEBUG_LOGGING
+    MeshCacheStats after = analyze_vertex_cache(mesh->indicies.data(), mesh->indicies.size(), mesh->verticies.size());
+
+    LOG_INFO("Optimized mesh: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", before.acmr, after.acmr, before.atvr, after.atvr);
+#endif
+}
@@ -0,0 +1,431 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "r_mesh_simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "r_mesh_optimizer.h"
+#include "u_debug.h"
+
+#define FLIP_THRESHOLD 0.2f
+
+struct Quadric
+{
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+
+    Quadric& operator+=(const Quadric& q)
+    {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+        b2 += q.b2; bc += q.bc; bd += q.bd;
+        c2 += q.c2; cd += q.cd;
+        d2 += q.d2;
+        return *this;
+    }
+
+    static Quadric from_plane(double a, double b, double c, double d)
+    {
+        return { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+    }
+
+    /* Sum of squared distances from p to all planes in the quadric */
+    double evaluate(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double r = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                 + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                 + c2 * z * z + 2 * cd * z
+                 + d2;
+        return r < 0 ? 0 : r;
+    }
+};
+
+struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    double cost;
+};
+
+struct PositionHash
+{
+    std::size_t operator()(const glm::vec3& p) const noexcept
+    {
+        uint32_t bits[3];
+        memcpy(bits, &p, sizeof(bits));
+        return (std::size_t) bits[0] * 73856093u ^ (std::size_t) bits[1] * 19349663u ^ (std::size_t) bits[2] * 83492791u;
+    }
+};
+
+static uint64_t edge_key(uint32_t a, uint32_t b)
+{
+    return a < b ? ((uint64_t) a << 32) | b : ((uint64_t) b << 32) | a;
+}
+
+static glm::vec3 get_position(const Vertex *verticies, uint32_t index)
+{
+    return glm::vec3(verticies[index].position);
+}
+
+/*
+ * Moving from onto to must not flip or collapse any triangle that survives
+ */
+static bool collapse_flips(
+    const Vertex *verticies, const std::vector<uint32_t>& indicies,
+    const std::vector<uint32_t>& adjacency_offsets, const std::vector<uint32_t>& adjacency,
+    uint32_t from, uint32_t to)
+{
+    glm::vec3 target = get_position(verticies, to);
+
+    for (uint32_t a = adjacency_offsets[from]; a < adjacency_offsets[from + 1]; a++)
+    {
+        const uint32_t *triangle = &indicies[adjacency[a] * 3];
+
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+        {
+            continue;
+        }
+
+        glm::vec3 p[3];
+        glm::vec3 q[3];
+        for (int c = 0; c < 3; c++)
+        {
+            p[c] = get_position(verticies, triangle[c]);
+            q[c] = triangle[c] == from ? target : p[c];
+        }
+
+        glm::vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+        glm::vec3 n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+
+        if (glm::dot(n0, n1) <= FLIP_THRESHOLD * glm::length(n0) * glm::length(n1))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t simplify_mesh(
+    uint32_t *destination,
+    const uint32_t *indicies, size_t index_count,
+    const Vertex *verticies, size_t vertex_count,
+    const std::vector<bool>& vertex_locks,
+    size_t target_index_count, float *result_error)
+{
+    std::vector<uint32_t> result(indicies, indicies + index_count);
+    std::vector<bool> locked(vertex_locks);
+    std::vector<Quadric> quadrics(vertex_count, Quadric{});
+    double max_cost = 0.0;
+
+    DEBUG_ASSERT(locked.size() == vertex_count);
+
+    /* Verticies on open or non manifold edges would tear the surface if moved */
+    std::unordered_map<uint64_t, uint32_t> edge_counts;
+    for (size_t i = 0; i < index_count; i += 3)
+    {
+        for (int e = 0; e < 3; e++)
+        {
+            edge_counts[edge_key(result[i + e], result[i + (e + 1) % 3])]++;
+        }
+    }
+
+    for (const auto & edge : edge_counts)
+    {
+        if (edge.second != 2)
+        {
+            locked[(uint32_t) (edge.first >> 32)] = true;
+            locked[(uint32_t) (edge.first & 0xffffffff)] = true;
+        }
+    }
+
+    for (size_t i = 0; i < index_count; i += 3)
+    {
+        glm::vec3 p0 = get_position(verticies, result[i + 0]);
+        glm::vec3 p1 = get_position(verticies, result[i + 1]);
+        glm::vec3 p2 = get_position(verticies, result[i + 2]);
+
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+
+        if (length <= 0.0f)
+        {
+            continue;
+        }
+
+        normal /= length;
+        Quadric q = Quadric::from_plane(normal.x, normal.y, normal.z, -glm::dot(normal, p0));
+
+        quadrics[result[i + 0]] += q;
+        quadrics[result[i + 1]] += q;
+        quadrics[result[i + 2]] += q;
+    }
+
+    std::vector<uint32_t> adjacency_offsets;
+    std::vector<uint32_t> adjacency;
+    std::vector<uint32_t> remap(vertex_count);
+    std::vector<bool> touched(vertex_count);
+    std::vector<Collapse> collapses;
+
+    /*
+     * Each pass collapses the cheapest independent edges, then rebuilds the
+     * index list, until the target is reached or nothing can be collapsed
+     */
+    while (result.size() > target_index_count)
+    {
+        size_t triangle_count = result.size() / 3;
+
+        adjacency_offsets.assign(vertex_count + 1, 0);
+        for (uint32_t index : result)
+        {
+            adjacency_offsets[index + 1]++;
+        }
+        for (size_t v = 0; v < vertex_count; v++)
+        {
+            adjacency_offsets[v + 1] += adjacency_offsets[v];
+        }
+
+        std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        adjacency.resize(result.size());
+        for (size_t i = 0; i < result.size(); i++)
+        {
+            adjacency[fill[result[i]]++] = (uint32_t) (i / 3);
+        }
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                uint32_t a = result[i + e];
+                uint32_t b = result[i + (e + 1) % 3];
+
+                if (!locked[a])
+                {
+                    Quadric q = quadrics[a];
+                    q += quadrics[b];
+                    collapses.push_back({ a, b, q.evaluate(get_position(verticies, b)) });
+                }
+            }
+        }
+
+        if (collapses.empty())
+        {
+            break;
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.cost < b.cost;
+        });
+
+        for (size_t v = 0; v < vertex_count; v++)
+        {
+            remap[v] = (uint32_t) v;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t triangles_to_remove = (result.size() - target_index_count) / 3;
+        size_t triangles_removed = 0;
+        size_t collapse_count = 0;
+
+        for (const auto & collapse : collapses)
+        {
+            if (touched[collapse.from] || touched[collapse.to])
+            {
+                continue;
+            }
+
+            if (collapse_flips(verticies, result, adjacency_offsets, adjacency, collapse.from, collapse.to))
+            {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            max_cost = std::max(max_cost, collapse.cost);
+            collapse_count++;
+
+            /* Neighbours of a moved vertex must wait for the next pass so the flip checks stay valid */
+            for (uint32_t a = adjacency_offsets[collapse.from]; a < adjacency_offsets[collapse.from + 1]; a++)
+            {
+                const uint32_t *triangle = &result[adjacency[a] * 3];
+
+                touched[triangle[0]] = true;
+                touched[triangle[1]] = true;
+                touched[triangle[2]] = true;
+
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                {
+                    triangles_removed++;
+                }
+            }
+
+            if (triangles_removed >= triangles_to_remove)
+            {
+                break;
+            }
+        }
+
+        if (collapse_count == 0)
+        {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t t = 0; t < triangle_count; t++)
+        {
+            uint32_t a = remap[result[t * 3 + 0]];
+            uint32_t b = remap[result[t * 3 + 1]];
+            uint32_t c = remap[result[t * 3 + 2]];
+
+            if (a == b || b == c || c == a)
+            {
+                continue;
+            }
+
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+
+        result.resize(write);
+    }
+
+    if (result_error != nullptr)
+    {
+        *result_error = (float) std::sqrt(max_cost);
+    }
+
+    std::copy(result.begin(), result.end(), destination);
+    return result.size();
+}
+
+/*
+ * Verticies shared between submeshes, or sharing a position with another
+ * vertex (uv and normal seams), must stay in place on every level
+ */
+static std::vector<bool> find_locked_verticies(const MeshData& mesh, const MeshLod& lod)
+{
+    std::vector<bool> locked(mesh.verticies.size(), false);
+    std::vector<uint32_t> owner(mesh.verticies.size(), UINT32_MAX);
+
+    for (uint32_t s = lod.submesh_start; s < lod.submesh_start + lod.submesh_count; s++)
+    {
+        const MeshSubmesh& submesh = mesh.submeshes[s];
+
+        for (uint32_t i = submesh.start_index; i < submesh.start_index + submesh.index_count; i++)
+        {
+            uint32_t index = mesh.indicies[i];
+
+            if (owner[index] != UINT32_MAX && owner[index] != s)
+            {
+                locked[index] = true;
+            }
+
+            owner[index] = s;
+        }
+    }
+
+    std::unordered_map<glm::vec3, uint32_t, PositionHash> positions;
+    for (uint32_t v = 0; v < (uint32_t) mesh.verticies.size(); v++)
+    {
+        auto result = positions.insert({ glm::vec3(mesh.verticies[v].position), v });
+
+        if (!result.second)
+        {
+            locked[v] = true;
+            locked[result.first->second] = true;
+        }
+    }
+
+    return locked;
+}
+
+void generate_mesh_lods(MeshData *mesh)
+{
+    DEBUG_ASSERT(mesh->lods.size() == 1);
+
+    std::vector<bool> locked = find_locked_verticies(*mesh, mesh->lods[0]);
+    std::vector<uint32_t> source;
+    std::vector<uint32_t> clusters;
+
+    while (mesh->lods.size() < MESH_MAX_LODS)
+    {
+        MeshLod previous = mesh->lods.back();
+        MeshLod lod{ (uint32_t) mesh->submeshes.size(), 0, previous.error };
+
+        size_t previous_index_count = 0;
+        size_t index_count = 0;
+        size_t index_start = mesh->indicies.size();
+
+        for (uint32_t s = previous.submesh_start; s < previous.submesh_start + previous.submesh_count; s++)
+        {
+            MeshSubmesh submesh = mesh->submeshes[s];
+            source.assign(mesh->indicies.begin() + submesh.start_index, mesh->indicies.begin() + submesh.start_index + submesh.index_count);
+
+            size_t target = (size_t) (submesh.index_count * MESH_LOD_REDUCTION) / 3 * 3;
+            float error = 0.0f;
+
+            uint32_t start = (uint32_t) mesh->indicies.size();
+            mesh->indicies.resize(start + source.size());
+
+            size_t count = simplify_mesh(
+                mesh->indicies.data() + start,
+                source.data(), source.size(),
+                mesh->verticies.data(), mesh->verticies.size(),
+                locked, target, &error
+            );
+
+            mesh->indicies.resize(start + count);
+            previous_index_count += submesh.index_count;
+            index_count += count;
+
+            if (count == 0)
+            {
+                continue;
+            }
+
+            optimize_vertex_cache(mesh->indicies.data() + start, count, mesh->verticies.size(), &clusters);
+
+            mesh->submeshes.push_back({ submesh.material, start, (uint32_t) count });
+            lod.submesh_count++;
+            lod.error = std::max(lod.error, error);
+        }
+
+        /* Stop once simplification stalls, usually because everything left is locked */
+        if (lod.submesh_count == 0 || index_count > previous_index_count * MESH_LOD_MIN_REDUCTION)
+        {
+            mesh->indicies.resize(index_start);
+            mesh->submeshes.resize(lod.submesh_start);
+            break;
+        }
+
+        LOG_INFO("Generated lod %zu: %zu -> %zu triangles, error %f", mesh->lods.size(), previous_index_count / 3, index_count / 3, lod.error);
+
+        mesh->lods.push_back(lod);
+    }
+}
@@ -22,6 +22,7 @@
 
 #include "r_model.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <map>
@@ -39,108 +40,176 @@
 #include "u_defines.h"
 #include "u_io.h"
 
-Model::Model(std::shared_ptr<GraphicsDevice>& device, std::shared_ptr<GraphicsDevmem>& devmem, std::shared_ptr<Renderer>& renderer, std::vector<Vertex>& verticies, std::vector<std::unique_ptr<Material>>& materials, std::vector<std::vector<uint32_t>>& indicies)
-    : device(device), devmem(devmem), renderer(renderer), position(0, 0, 0)
+ModelMesh::ModelMesh(std::shared_ptr<GraphicsDevmem>& devmem, GeometryArena *arena, const MeshView& mesh, std::vector<std::unique_ptr<Material>>& materials, GraphicsTransferBatch *batch)
+    : devmem(devmem), materials(std::move(materials)), submeshes(mesh.submeshes), lods(mesh.lods), bounds(mesh.bounds), arena(arena)
+{
+    DEBUG_ASSERT(!lods.empty());
+
+    range = arena->allocate(mesh.vertex_format, mesh.vertex_count, mesh.index_count);
+
+    if (batch)
+    {
+        this->record_geometry_upload(*batch, mesh);
+    }
+    else
+    {
+        const std::shared_ptr<GraphicsDevice>& device = devmem->get_device();
+
+        auto own_batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eTransfer);
+        this->record_geometry_upload(*own_batch, mesh);
+        device->transfer_context->end_batch(std::move(own_batch), true);
+    }
+}
+
+void ModelMesh::record_geometry_upload(GraphicsTransferBatch& batch, const MeshView& mesh) const
 {
     /*
-     * transfer data from indicies + materials to material_data
+     * The mesh view may point straight into a mapped cooked mesh, so this is
+     * the only copy made between the file and the device, packing on the
+     * way if the mesh uses the compact format
      */
-    size_t index = 0;
+    const GraphicsDevmemBuffer *vertex_buffer = arena->get_vertex_buffer();
+    VkDeviceSize stride = get_vertex_stride(mesh.vertex_format);
 
-    for (unsigned int i = 0; i < materials.size(); i++)
+    if (vertex_buffer->is_visible())
     {
-        material_data.push_back(
-            std::make_unique<MaterialData>(
-                materials[i],
-                indicies[i],
-                index
-            )
-        );
-
-        index += indicies[i].size();
+        void *data;
+        vertex_buffer->map_memory(&data);
+        write_verticies((uint8_t *) data + range.vertex_offset, mesh.verticies, mesh.vertex_count, mesh.vertex_format);
+        vertex_buffer->unmap_memory();
     }
+    else
+    {
+        uint32_t chunk_verticies = (uint32_t) (batch.get_staging_chunk_size() / stride);
 
-    this->index_count = (uint32_t) index;
-
-    vk::BufferCreateInfo vbuf_create_info(
-        vk::BufferCreateFlags(0),
-        verticies.size() * sizeof(Vertex),
-        vk::BufferUsageFlagBits::eVertexBuffer,
-        vk::SharingMode::eExclusive
-    );
+        for (uint32_t first = 0; first < mesh.vertex_count; first += chunk_verticies)
+        {
+            uint32_t count = std::min(chunk_verticies, mesh.vertex_count - first);
 
-    VmaAllocationCreateInfo vbuf_alloc_info{};
-    vbuf_alloc_info.flags = 0;
-    vbuf_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-    vbuf_alloc_info.pUserData = STRING_TO_DATA("Vertex Buffer");
+            GraphicsStagingRegion region = batch.stage(count * stride);
+            write_verticies(region.data, mesh.verticies + first, count, mesh.vertex_format);
 
-    vertex_buffer = devmem->create_buffer(vbuf_create_info, vbuf_alloc_info);
+            batch.blit_buffer_to_buffer(region.buffer, vertex_buffer->buffer, { vk::BufferCopy(region.offset, range.vertex_offset + first * stride, region.size) });
+        }
+    }
 
-    void *data;
-    vertex_buffer->map_memory(&data);
-    memcpy(data, verticies.data(), verticies.size() * sizeof(Vertex));
-    vertex_buffer->unmap_memory();
-    vertex_buffer->commit_memory();
+    arena->get_index_buffer()->record_upload(batch, mesh.indicies, range.index_size, range.index_offset);
+}
 
-    vk::BufferCreateInfo ibuf_create_info(
-        vk::BufferCreateFlags(0),
-        sizeof(uint32_t) * index_count,
-        vk::BufferUsageFlagBits::eIndexBuffer,
-        vk::SharingMode::eExclusive
-    );
+ModelMesh::~ModelMesh()
+{
+    /* The range may be handed out again, so wait until no frame draws from it */
+    GeometryArena *arena = this->arena;
+    GeometryRange range = this->range;
 
-    VmaAllocationCreateInfo ibuf_alloc_info{};
-    ibuf_alloc_info.flags = 0;
-    ibuf_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-    ibuf_alloc_info.pUserData = STRING_TO_DATA("Index Buffer");
+    devmem->get_device()->retire_queue->retire([arena, range]() {
+        arena->free(range);
+    });
+}
 
-    index_buffer = devmem->create_buffer(ibuf_create_info, ibuf_alloc_info);
+bool ModelMesh::refresh_materials()
+{
+    bool changed = false;
 
-    index_buffer->map_memory(&data);
-    for (const auto & material : material_data)
+    for (auto & material : materials)
     {
-        memcpy(data, material->indicies.data(), material->indicies.size() * sizeof(uint32_t));
+        changed |= material->refresh_textures();
     }
-    index_buffer->unmap_memory();
-    index_buffer->commit_memory();
 
-    command_buffers = renderer->alloc_render_command_buffers();
-    this->invalidate_recording();
+    return changed;
 }
 
-Model::~Model()
+bool ModelMesh::update_frame(uint32_t frame)
 {
+    bool changed = false;
+
+    for (auto & material : materials)
+    {
+        changed |= material->update_frame(frame);
+    }
+
+    return changed;
 }
 
-void Model::invalidate_recording()
+void ModelMesh::record_draws(vk::CommandBuffer cmd, uint32_t lod_index, const VertexShaderData& shader_data, uint32_t frame) const
 {
-	for (auto i = 0; i < command_buffers.size(); i++)
+	const MeshLod& lod = lods[lod_index];
+	const GraphicsPipeline *bound_pipeline = nullptr;
+
+	for (uint32_t s = lod.submesh_start; s < lod.submesh_start + lod.submesh_count; s++)
 	{
-		renderer->start_secondary_command_buffer(command_buffers[i], i, 0);
+		const auto & submesh = submeshes[s];
+		const auto & material = materials[submesh.material];
+
+		/* Bindless materials sharing a pipeline differ only in the index the draw passes */
+		if (material->is_bindless())
+		{
+			if (material->get_pipeline() != bound_pipeline)
+			{
+				material->bind_material(cmd, frame);
+				material->push_shader_data(cmd, 0, vk::ShaderStageFlagBits::eVertex, sizeof(VertexShaderData), (void *) &shader_data);
+				bound_pipeline = material->get_pipeline();
+			}
+
+			cmd.drawIndexed(submesh.index_count, 1, range.first_index + submesh.start_index, range.base_vertex, material->get_bindless_instance(frame));
+			continue;
+		}
 
-		std::vector<vk::Buffer> vbufs{ vertex_buffer->buffer };
-		std::vector<VkDeviceSize> voffsets{ 0 };
+		material->bind_material(cmd, frame);
+		material->push_shader_data(cmd, 0, vk::ShaderStageFlagBits::eVertex, sizeof(VertexShaderData), (void *) &shader_data);
 
-		command_buffers[i].bindVertexBuffers(0, (uint32_t)vbufs.size(), vbufs.data(), voffsets.data());
-		command_buffers[i].bindIndexBuffer(index_buffer->buffer, 0, vk::IndexType::eUint32);
+		cmd.drawIndexed(submesh.index_count, 1, range.first_index + submesh.start_index, range.base_vertex, 0);
+	}
+}
 
-		glm::mat4 translation = glm::translate(glm::mat4(1), position);
-        glm::mat4 rotation = glm::toMat4(this->rotation);
-		VertexShaderData shader_data(translation);
+uint32_t ModelMesh::select_lod(const glm::vec3& camera_position, const glm::vec3& position, float error_scale) const
+{
+    glm::vec3 closest = glm::clamp(camera_position, bounds.min + position, bounds.max + position);
+    float distance = glm::length(closest - camera_position);
 
-		for (const auto & data : material_data)
-		{
-			data->material->bind_material(command_buffers[i]);
-			data->material->push_shader_data(command_buffers[i], 0, vk::ShaderStageFlagBits::eVertex, sizeof(VertexShaderData), &shader_data);
+    if (distance > 0.0f)
+    {
+        for (uint32_t i = (uint32_t) lods.size(); i-- > 1;)
+        {
+            if (lods[i].error * error_scale <= distance)
+            {
+                return i;
+            }
+        }
+    }
 
-			command_buffers[i].drawIndexed((uint32_t)data->indicies.size(), 1, data->start_index, 0, 0);
-		}
+    return 0;
+}
 
-		renderer->end_secondary_command_buffer(command_buffers[i]);
-	}
+Model::Model(std::shared_ptr<ModelMesh> mesh)
+    : mesh(std::move(mesh)), current_lod(0), position(0, 0, 0)
+{
+}
+
+Model::~Model()
+{
+}
+
+bool Model::refresh_materials()
+{
+    return mesh->refresh_materials();
+}
+
+bool Model::update_frame(uint32_t frame)
+{
+    return mesh->update_frame(frame);
+}
+
+void Model::record_draws(vk::CommandBuffer cmd, uint32_t frame) const
+{
+	glm::mat4 translation = glm::translate(glm::mat4(1), position);
+    glm::mat4 rotation = glm::toMat4(this->rotation);
+	VertexShaderData shader_data(translation);
+
+	mesh->record_draws(cmd, current_lod, shader_data, frame);
 }
 
-void Model::render(vk::CommandBuffer cmd, uint32_t image) const
+void Model::update_lod(const glm::vec3& camera_position, float error_scale)
 {
-	cmd.executeCommands(this->command_buffers[image]);
+    current_lod = mesh->select_lod(camera_position, position, error_scale);
 }
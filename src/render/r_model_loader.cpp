@@ -21,15 +21,17 @@
 ******************************************************************************/
 #include "r_model_loader.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#include <future>
+#include <unordered_set>
 
+#include "r_mesh_optimizer.h"
+#include "r_mesh_simplifier.h"
 #include "u_io.h"
 #include "u_debug.h"
 #include "u_defines.h"
 
-ModelLoader::ModelLoader(std::shared_ptr<GraphicsDevice> &device, std::shared_ptr<GraphicsDevmem> &devmem, std::shared_ptr<Renderer> &renderer)
-    : device(device), devmem(devmem), renderer(renderer), image_loader(std::make_unique<RenderImageLoader>(device, devmem))
+ModelLoader::ModelLoader(std::shared_ptr<GraphicsDevice> &device, std::shared_ptr<GraphicsDevmem> &devmem, std::shared_ptr<Renderer> &renderer, std::shared_ptr<ThreadPool> thread_pool)
+    : device(device), devmem(devmem), renderer(renderer), thread_pool(thread_pool), image_loader(std::make_unique<RenderImageLoader>(device, devmem, thread_pool))
 {
     this->create_dummy_texture_sampler();
 }
@@ -38,133 +40,166 @@ ModelLoader::~ModelLoader()
 {
 }
 
-glm::vec4 ModelLoader::get_vertex(const tinyobj::attrib_t& attrib, int vertex_index)
+std::unique_ptr<Model> ModelLoader::load_model(std::string path)
 {
-    if (vertex_index == -1)
-        return { 0, 0, 0, 0 };
+    std::shared_ptr<ModelMesh> mesh = mesh_cache[path].lock();
 
-    return { attrib.vertices[3 * vertex_index], attrib.vertices[3 * vertex_index + 1], attrib.vertices[3 * vertex_index + 2], 1.0f };
+    if (mesh)
+    {
+        LOG_INFO("Reusing cached model %s", path.c_str());
+    }
+    else
+    {
+        mesh = this->load_mesh(path);
+        mesh_cache[path] = mesh;
+    }
+
+    return std::make_unique<Model>(mesh);
 }
 
-glm::vec4 ModelLoader::get_normal(const tinyobj::attrib_t& attrib, int index)
+std::vector<std::unique_ptr<Model>> ModelLoader::load_models(const std::vector<std::string>& paths)
 {
-    if (index == -1)
-        return { 0, 0, 0, 0 };
+    std::vector<std::string> pending_paths;
+    std::vector<std::future<std::unique_ptr<PreparedMesh>>> pending_meshes;
+    std::unordered_set<std::string> seen_paths;
+
+    for (const auto & path : paths)
+    {
+        if (!mesh_cache[path].expired() || !seen_paths.insert(path).second)
+        {
+            continue;
+        }
+
+        pending_paths.push_back(path);
+        pending_meshes.push_back(thread_pool->submit([path]() { return prepare_mesh(path); }));
+    }
+
+    /*
+     * Meshes still have to be created on this thread, they allocate device
+     * memory and materials, only their geometry copies share the batch
+     */
+    std::vector<std::shared_ptr<ModelMesh>> meshes;
+
+    if (!pending_meshes.empty())
+    {
+        auto batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eTransfer);
+
+        try
+        {
+            for (size_t i = 0; i < pending_meshes.size(); i++)
+            {
+                std::unique_ptr<PreparedMesh> prepared = pending_meshes[i].get();
 
-    return { attrib.normals[3 * index], attrib.normals[3 * index + 1], attrib.normals[3 * index + 2], 1.0f };
+                std::shared_ptr<ModelMesh> mesh = this->create_mesh(prepared->get_view(), prepared->get_materials(), batch.get());
+                mesh_cache[pending_paths[i]] = mesh;
+                meshes.push_back(mesh);
+            }
+        }
+        catch (...)
+        {
+            /* An open batch holds the staging ring, end it with the meshes created so far */
+            device->transfer_context->end_batch(std::move(batch), true);
+            throw;
+        }
+
+        device->transfer_context->end_batch(std::move(batch), true);
+    }
+
+    std::vector<std::unique_ptr<Model>> models;
+
+    for (const auto & path : paths)
+    {
+        models.push_back(std::make_unique<Model>(mesh_cache[path].lock()));
+    }
+
+    return models;
 }
 
-glm::vec2 ModelLoader::get_uv(const tinyobj::attrib_t& attrib, int index)
+uint32_t ModelLoader::process_texture_uploads()
 {
-    if (index == -1)
-        return { 0, 0 };
+    if (!image_loader->has_pending_uploads())
+    {
+        return 0;
+    }
 
-    return { attrib.texcoords[2 * index], 1 - attrib.texcoords[2 * index + 1] };
+    return image_loader->process_uploads(false);
 }
 
-glm::vec4 ModelLoader::to_vec4(float f[3])
+std::shared_ptr<ModelMesh> ModelLoader::load_mesh(const std::string& path)
 {
-    return glm::vec4(f[0], f[1], f[2], f[3]);
+    std::unique_ptr<PreparedMesh> prepared = prepare_mesh(path);
+
+    return this->create_mesh(prepared->get_view(), prepared->get_materials(), nullptr);
 }
 
-std::unique_ptr<Model> ModelLoader::load_model(std::string path)
+std::unique_ptr<ModelLoader::PreparedMesh> ModelLoader::prepare_mesh(const std::string& path)
 {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> obj_materials;
-    std::string err;
+    std::unique_ptr<PreparedMesh> prepared = std::make_unique<PreparedMesh>();
+    std::string cooked_path = path + MESH_FILE_EXTENSION;
+
+    file_stamp source_stamp;
+    bool has_source = get_file_stamp(path, &source_stamp);
 
     LOG_INFO("Loading model %s", path.c_str());
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &obj_materials, &err, FILENAME_TO_PATH(path).c_str(), FILENAME_TO_PATH(std::string("models")).c_str()))
+    /*
+     * Prefer the cooked mesh, the mapping stays live until the model has
+     * copied the geometry into its staging buffers
+     */
+    prepared->is_cooked = prepared->cooked.open(cooked_path, has_source ? &source_stamp : nullptr);
+    if (prepared->is_cooked)
     {
-        throw std::runtime_error(err);
+        return prepared;
     }
 
-    if (err.length() > 0)
+    MeshData& mesh = prepared->mesh;
+    mesh = load_obj_mesh(path);
+    optimize_mesh(&mesh);
+    generate_mesh_lods(&mesh);
+    mesh.vertex_format = choose_vertex_format(mesh.get_view());
+
+    if (has_source && !MeshFile::write(cooked_path, mesh, source_stamp))
     {
-        LOG_WARN("TinyObjLoading Output:\n%s", err.c_str());
+        LOG_WARN("Failed to write cooked mesh %s", cooked_path.c_str());
     }
 
-    std::vector<Vertex> verticies;
-    std::vector<std::vector<uint32_t>> indicies;
-    std::vector<std::unique_ptr<Material>> materials;
+    return prepared;
+}
 
-    materials.push_back(
-        std::move(
-            std::make_unique<Material>(
-                device,
-                renderer,
-                glm::vec4(1, 1, 1, 1),
-                glm::vec4(1, 1, 1, 1),
-                glm::vec4(1, 1, 1, 1),
-                1.0f,
-                dummy_image,
-                dummy_image,
-                dummy_image
-                )
-        )
-    );
+std::shared_ptr<ModelMesh> ModelLoader::create_mesh(const MeshView& mesh, const std::vector<MeshMaterialInfo>& material_infos, GraphicsTransferBatch *batch)
+{
+    std::vector<std::unique_ptr<Material>> materials;
 
-    for (auto material : obj_materials)
+    for (const auto & info : material_infos)
     {
-        std::shared_ptr<GraphicsDevmemImage> image;
+        std::shared_ptr<RenderTexture> texture;
 
-        if (material.diffuse_texname.length() > 0)
+        if (info.diffuse_texture.length() > 0)
         {
-            image = image_loader->load_image(FILENAME_TO_PATH(material.diffuse_texname).c_str());
+            texture = image_loader->load_texture_async(info.diffuse_texture, dummy_texture->get_sampler());
         }
         else
         {
-            image = dummy_image;
+            texture = dummy_texture;
         }
 
         materials.push_back(
-            std::move(
-                std::make_unique<Material>(
-                    device, 
-                    renderer, 
-                    to_vec4(material.ambient), 
-                    to_vec4(material.diffuse), 
-                    to_vec4(material.specular), 
-                    material.dissolve,
-                    dummy_image,
-                    image,
-                    dummy_image
-                )
+            std::make_unique<Material>(
+                device,
+                renderer,
+                info.ambient,
+                info.diffuse,
+                info.specular,
+                info.alpha,
+                dummy_texture,
+                texture,
+                dummy_texture,
+                mesh.vertex_format
             )
         );
     }
 
-    indicies.resize(obj_materials.size() + 1);
-
-    int v = 0, i = 0, m = 0;
-
-    for (auto shape : shapes)
-    {
-        for (auto num_vertices : shape.mesh.num_face_vertices)
-        {
-            for (int j = 0; j < num_vertices; i++, j++)
-            {
-                auto index = shape.mesh.indices[i];
-
-                verticies.push_back(
-                    Vertex(
-                        get_vertex(attrib, index.vertex_index),
-                        get_normal(attrib, index.normal_index),
-                        { 1.0f, 1.0f, 1.0f, 1.0f },
-                        get_uv(attrib, index.texcoord_index)
-                    )
-                );
-
-                indicies[shape.mesh.material_ids[m] + 1].push_back(v++);
-            }
-
-            m++;
-        }
-    }
-
-    return std::make_unique<Model>(device, devmem, renderer, verticies, materials, indicies);
+    return std::make_shared<ModelMesh>(devmem, renderer->get_geometry_arena(), mesh, materials, batch);
 }
 
 std::string ModelLoader::get_library_path(const std::string& library, const std::string& file)
@@ -178,27 +213,6 @@ void ModelLoader::create_dummy_texture_sampler()
 
     LOG_INFO("Allocating dummy 1x1 white texture");
 
-    vk::BufferCreateInfo staging_buffer_create_info(
-        vk::BufferCreateFlags(),
-        image_size,
-        vk::BufferUsageFlagBits::eTransferSrc,
-        vk::SharingMode::eExclusive,
-        0,
-        nullptr
-    );
-
-    VmaAllocationCreateInfo staging_buffer_alloc_info{};
-    staging_buffer_alloc_info.flags = 0;
-    staging_buffer_alloc_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
-    staging_buffer_alloc_info.pUserData = STRING_TO_DATA("DummyImageStagingBuffer");
-
-    std::unique_ptr<GraphicsDevmemBuffer> staging_buffer = devmem->create_buffer(staging_buffer_create_info, staging_buffer_alloc_info);
-
-    uint32_t *data;
-    staging_buffer->map_memory((void **) &data);
-    *data = UINT32_MAX; /* WHITE */
-    staging_buffer->unmap_memory();
-
     vk::ImageCreateInfo image_create_info(
         vk::ImageCreateFlags(),
         vk::ImageType::e2D,
@@ -216,15 +230,20 @@ void ModelLoader::create_dummy_texture_sampler()
     );
 
     VmaAllocationCreateInfo image_alloc_info{};
-    image_alloc_info.flags = VMA_ALLOCATION_CREATE_EXT_DONT_CREATE_STAGING_BUFFER;
+    image_alloc_info.flags = 0;
     image_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
     image_alloc_info.pUserData = STRING_TO_DATA("DummyImage");
 
     std::unique_ptr<GraphicsDevmemImage> image = devmem->create_image(image_create_info, image_alloc_info);
     image->transition_layout(vk::ImageLayout::eTransferDstOptimal);
 
+    auto batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eGraphics);
+
+    GraphicsStagingRegion staging = batch->stage(image_size);
+    *(uint32_t *) staging.data = UINT32_MAX; /* WHITE */
+
     vk::BufferImageCopy region(
-        0, 0,
+        staging.offset, 0,
         0,
         vk::ImageSubresourceLayers(
             vk::ImageAspectFlagBits::eColor,
@@ -244,11 +263,9 @@ void ModelLoader::create_dummy_texture_sampler()
         )
     );
 
-    auto batch = device->transfer_context->start_batch(GraphicsTransferHardwareDest::eGraphics);
-    batch->blit_buffer_to_image(staging_buffer->buffer, image->image, vk::ImageLayout::eTransferDstOptimal, region);
-    device->transfer_context->end_batch(std::move(batch), false);
-
-    device->device.waitIdle();
+    batch->blit_buffer_to_image(staging.buffer, image->image, vk::ImageLayout::eTransferDstOptimal, region);
+    GraphicsTransferTicket ticket = device->transfer_context->end_batch(std::move(batch), false);
+    device->transfer_context->wait_for_batch(ticket);
 
-    dummy_image = std::move(image);
+    dummy_texture = std::make_shared<RenderTexture>(image_loader->create_texture(std::move(image)));
 }
@@ -28,27 +28,12 @@
 #include "u_debug.h"
 #include "u_defines.h"
 
-static vk::DescriptorPool create_descriptor_pool(std::shared_ptr<GraphicsDevice> device, uint32_t set_count, uint32_t uniform_count)
-{
-    std::vector<vk::DescriptorPoolSize> pool_sizes{
-        vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, uniform_count)
-    };
-
-    vk::DescriptorPoolCreateInfo create_info(
-        vk::DescriptorPoolCreateFlags(0),
-        set_count,
-        (uint32_t)pool_sizes.size(), pool_sizes.data()
-    );
-
-    return device->device.createDescriptorPool(create_info);
-}
-
-Renderer::Renderer(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<GraphicsWindow> window, std::shared_ptr<GraphicsDevmem> devmem, std::shared_ptr<GraphicsSwapchain> swapchain)
+Renderer::Renderer(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<GraphicsWindow> window, std::shared_ptr<GraphicsDevmem> devmem, std::shared_ptr<GraphicsSwapchain> swapchain, std::shared_ptr<ThreadPool> thread_pool)
 	: device(device), 
         window(window), 
         devmem(devmem), 
         swapchain(swapchain), 
-        renderpass(std::make_shared<GraphicsRenderpass>(device, create_descriptor_pool(device, 8, 8)))
+        renderpass(std::make_shared<GraphicsRenderpass>(device, thread_pool))
 {
 	attachments.color = this->create_attachment(vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eColorAttachment, "Color");
 	attachments.position = this->create_attachment(vk::Format::eR16G16B16A16Sfloat, vk::ImageUsageFlagBits::eColorAttachment, "Position");
@@ -156,7 +141,21 @@ Renderer::Renderer(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<Graph
     );
     this->deferred_sampler = this->device->device.createSampler(sampler_create_info);
 
-    this->update_buffer_descriptor_sets();
+    if (device->get_bindless_texture_limit() > 0)
+    {
+        this->bindless = std::make_unique<BindlessTable>(this->device, this->devmem, this->get_frame_count());
+    }
+
+    /* Every shader the renderer draws with, read in one batch rather than as each pipeline asks */
+    device->shader_cache->load_modules({
+        "shaders/deferred.vert",
+        "shaders/deferred.frag",
+        "shaders/model.vert",
+        "shaders/model_packed.vert",
+        this->bindless ? "shaders/model_bindless.frag" : "shaders/model.frag",
+    });
+
+    this->geometry_arena = std::make_unique<GeometryArena>(this->devmem);
 
 	for (uint32_t i = 0; i < swapchain->get_image_count(); i++)
 	{
@@ -175,7 +174,9 @@ Renderer::Renderer(std::shared_ptr<GraphicsDevice> device, std::shared_ptr<Graph
 
 Renderer::~Renderer()
 {
-    device->device.destroyDescriptorPool(this->deferred_descriptor_pool);
+    /* Retired meshes and materials still point into the arena and bindless table */
+    device->retire_queue->flush();
+
     device->device.destroySampler(this->deferred_sampler);
 	for (const auto & framebuffer : framebuffers)
 	{
@@ -235,6 +236,35 @@ void Renderer::end_secondary_command_buffer(vk::CommandBuffer cmd) const
 
 void Renderer::render_final_image(const vk::CommandBuffer& cmd, uint32_t index)
 {
+    /* The frame's last use has finished, so its set and command buffer are free to rewrite */
+    vk::DescriptorSet descriptor_set = device->descriptor_allocator->allocate_transient(this->deferred_pipeline->get_descriptor_set_layout(), index);
+    this->write_lighting_descriptor_set(descriptor_set);
+
+    vk::CommandBufferInheritanceInfo inheritance_info(
+        (vk::RenderPass) *renderpass,
+        1,
+        framebuffers[index]
+    );
+
+    vk::CommandBufferBeginInfo begin_info(
+        vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+        &inheritance_info
+    );
+
+    command_buffers[index].begin(begin_info);
+    this->deferred_pipeline->bind_pipeline(command_buffers[index]);
+    this->deferred_pipeline->bind_descriptor_set(command_buffers[index], descriptor_set, {
+        Camera::get()->get_dynamic_offset(index),
+        Scene::get()->get_light_data_offset(index)
+    });
+
+    std::vector<vk::Buffer> vbufs{ screen_vertex_buffer->buffer };
+    std::vector<vk::DeviceSize> voffsets{ 0 };
+    command_buffers[index].bindVertexBuffers(0, (uint32_t)vbufs.size(), vbufs.data(), voffsets.data());
+
+    command_buffers[index].draw(6, 1, 0, 0);
+    command_buffers[index].end();
+
 	cmd.executeCommands(command_buffers[index]);
 }
 
@@ -314,7 +344,7 @@ RenderAttachment Renderer::create_attachment(vk::Format format, vk::ImageUsageFl
 	return attachment;
 }
 
-void Renderer::update_buffer_descriptor_sets() const
+void Renderer::write_lighting_descriptor_set(vk::DescriptorSet descriptor_set) const
 {
     vk::DescriptorBufferInfo camera_buffer = Camera::get()->get_buffer_info();
     vk::DescriptorBufferInfo light_buffer = Scene::get()->get_light_data_info();
@@ -342,7 +372,7 @@ void Renderer::update_buffer_descriptor_sets() const
             0,
             0,
             1,
-            vk::DescriptorType::eUniformBuffer,
+            vk::DescriptorType::eUniformBufferDynamic,
             nullptr,
             &camera_buffer,
             nullptr
@@ -352,7 +382,7 @@ void Renderer::update_buffer_descriptor_sets() const
             1,
             0,
             1,
-            vk::DescriptorType::eUniformBuffer,
+            vk::DescriptorType::eUniformBufferDynamic,
             nullptr,
             &light_buffer,
             nullptr
@@ -389,7 +419,7 @@ void Renderer::update_buffer_descriptor_sets() const
         )
     };
 
-    this->deferred_pipeline->update_descriptor_sets(writes);
+    this->deferred_pipeline->update_descriptor_sets(writes, descriptor_set);
 }
 
 void Renderer::create_lighting_pass_resources()
@@ -421,86 +451,18 @@ void Renderer::create_lighting_pass_resources()
     data[5] = Vertex(glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), glm::vec2(0.0f, 0.0f));
     screen_vertex_buffer->unmap_memory();
 
-	// Create lighting pass command buffers
+	// Lighting pass command buffers, recorded each frame in render_final_image
 	command_buffers = device->graphics_queue->allocate_command_buffers(swapchain->get_image_count(), vk::CommandBufferLevel::eSecondary);
-
-	for (uint32_t i = 0; i < swapchain->get_image_count(); i++)
-	{
-		vk::CommandBufferInheritanceInfo inheritance_info(
-			(vk::RenderPass) *renderpass,
-			1,
-			framebuffers[i]
-		);
-
-		vk::CommandBufferBeginInfo begin_info(
-			vk::CommandBufferUsageFlagBits::eSimultaneousUse | vk::CommandBufferUsageFlagBits::eRenderPassContinue,
-			&inheritance_info
-		);
-
-		command_buffers[i].begin(begin_info);
-        this->deferred_pipeline->bind_pipeline(command_buffers[i]);
-
-        std::vector<vk::Buffer> vbufs{ screen_vertex_buffer->buffer };
-        std::vector<vk::DeviceSize> voffsets{ 0 };
-        command_buffers[i].bindVertexBuffers(0, (uint32_t)vbufs.size(), vbufs.data(), voffsets.data());
-
-        command_buffers[i].draw(6, 1, 0, 0);
-		command_buffers[i].end();
-	}
 }
 
-std::unique_ptr<GraphicsPipeline> Renderer::create_deffered_pipeline()
+std::shared_ptr<GraphicsPipeline> Renderer::create_deffered_pipeline()
 {
     auto create_info = std::make_unique<GraphicsPipelineCreateInfo>(this->device, "shaders/deferred.vert", "shaders/deferred.frag");
     create_info->viewports = { vk::Viewport(0, 0, (float) this->swapchain->get_extent().width,  (float) this->swapchain->get_extent().height) };
     create_info->scissors = { vk::Rect2D(vk::Offset2D(0, 0), this->swapchain->get_extent()) };
 
-    std::vector<vk::DescriptorPoolSize> pool_sizes{
-        vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 2),
-        vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 3)
-    };
-
-    vk::DescriptorPoolCreateInfo descriptor_pool_create_info(
-        vk::DescriptorPoolCreateFlags(0),
-        1,
-        (uint32_t)pool_sizes.size(), pool_sizes.data()
-    );
-
-    this->deferred_descriptor_pool = device->device.createDescriptorPool(descriptor_pool_create_info);
-
-    std::vector<vk::DescriptorSetLayoutBinding> set_bindings = {
-        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex),
-        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment),
-        vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment),
-        vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment),
-        vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment),
-    };
-
-    vk::DescriptorSetLayoutCreateInfo set_create_info(
-        vk::DescriptorSetLayoutCreateFlags(0),
-        (uint32_t)set_bindings.size(), set_bindings.data()
-    );
-
-    create_info->descriptor_set_layout = device->device.createDescriptorSetLayout(set_create_info);
-
-    vk::DescriptorSetAllocateInfo descriptor_set_alloc_info(
-        deferred_descriptor_pool,
-        1, &create_info->descriptor_set_layout
-    );
-
-    create_info->descriptor_set = device->device.allocateDescriptorSets(descriptor_set_alloc_info)[0];
-
-    std::vector<vk::DescriptorSetLayout> descriptor_sets{
-        create_info->descriptor_set_layout
-    };
-
-    vk::PipelineLayoutCreateInfo pipeline_layout_create_info(
-        vk::PipelineLayoutCreateFlags(0),
-        (uint32_t)descriptor_sets.size(), descriptor_sets.data(),
-        0, nullptr
-    );
-
-    create_info->pipeline_layout = device->device.createPipelineLayout(pipeline_layout_create_info);
+    /* Sets are allocated per frame against the layout, so fetch it rather than leave it to the builder */
+    create_info->descriptor_set_layout = device->layout_cache->get_descriptor_set_layout(create_info->set_bindings);
 
     create_info->color_attachments = {
         // Final Presented Image
@@ -22,22 +22,16 @@
 
 #include "r_scene.h"
 
+#include <cmath>
+
+#include "r_camera.h"
+
 std::shared_ptr<Scene> Scene::current_scene;
 
 Scene::Scene(std::shared_ptr<GraphicsDevice>& device, std::shared_ptr<GraphicsDevmem>& devmem)
-	: device(device), devmem(devmem)
+	: device(device), devmem(devmem), lod_viewport_height(800.0f), lod_max_pixel_error(1.0f)
 {
-	vk::BufferCreateInfo buffer_create_info(
-		vk::BufferCreateFlags(0),
-		sizeof(LightShaderData),
-		vk::BufferUsageFlagBits::eUniformBuffer
-	);
-
-	VmaAllocationCreateInfo alloc_create_info{};
-	alloc_create_info.flags = 0;
-	alloc_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
-
-	light_data_buffer = devmem->create_buffer(buffer_create_info, alloc_create_info);
+	light_data_block = devmem->get_uniform_ring()->allocate(sizeof(LightShaderData));
 
     light_data.lights[0] = 
     {
@@ -55,30 +49,131 @@ Scene::~Scene()
 
 vk::DescriptorBufferInfo Scene::get_light_data_info() const
 {
-	return vk::DescriptorBufferInfo(
-		light_data_buffer->buffer,
-		0, sizeof(LightShaderData)
-	);
+	return devmem->get_uniform_ring()->get_buffer_info(light_data_block);
+}
+
+uint32_t Scene::get_light_data_offset(uint32_t frame) const
+{
+	return devmem->get_uniform_ring()->get_dynamic_offset(light_data_block, frame);
+}
+
+void Scene::set_renderer(std::shared_ptr<Renderer>& renderer)
+{
+    this->renderer = renderer;
+
+    command_buffers = renderer->alloc_render_command_buffers();
+    recorded_lods.assign(command_buffers.size(), {});
+    recording_invalid.assign(command_buffers.size(), true);
 }
 
 void Scene::add_model(std::unique_ptr<Model> model)
 {
-    model->invalidate_recording();
     models.push_back(std::move(model));
+    this->invalidate_recording();
 }
 
-void Scene::render_models(vk::CommandBuffer buffer, uint32_t index)
+void Scene::refresh_materials()
+{
+    /* Each image is re-recorded by update_frame once its descriptors are rewritten */
+    for (auto & model : models)
+    {
+        model->refresh_materials();
+    }
+}
+
+void Scene::update_frame(uint32_t index)
+{
+    bool changed = false;
+
+    for (auto & model : models)
+    {
+        changed |= model->update_frame(index);
+    }
+
+    /* Rewriting a set invalidates the secondaries it was bound in */
+    if (changed)
+    {
+        recording_invalid[index] = true;
+    }
+}
+
+void Scene::invalidate_recording()
+{
+    recording_invalid.assign(recording_invalid.size(), true);
+}
+
+bool Scene::needs_recording(uint32_t index) const
 {
+    const std::vector<uint32_t>& lods = recorded_lods[index];
+
+    if (recording_invalid[index])
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        if (lods[i] != models[i]->get_lod())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Scene::record_command_buffer(uint32_t index)
+{
+    vk::CommandBuffer cmd = command_buffers[index];
+    renderer->start_secondary_command_buffer(cmd, index, 0);
+
+    /* Every mesh lives in the arena, so one bind covers the whole scene */
+    renderer->get_geometry_arena()->bind(cmd);
+
+    recorded_lods[index].clear();
+
     for (const auto &model : models)
     {
-        model->render(buffer, index);
+        model->record_draws(cmd, index);
+        recorded_lods[index].push_back(model->get_lod());
     }
+
+    renderer->end_secondary_command_buffer(cmd);
+    recording_invalid[index] = false;
+}
+
+void Scene::render_models(vk::CommandBuffer buffer, uint32_t index)
+{
+    std::shared_ptr<Camera> camera = Camera::get();
+
+    if (camera)
+    {
+        /* Pixels covered by one unit at distance one */
+        float pixel_scale = lod_viewport_height / (2.0f * tanf(camera->get_fov() * 0.5f));
+        glm::vec3 camera_position = camera->get_world_position();
+
+        for (const auto &model : models)
+        {
+            model->update_lod(camera_position, pixel_scale / lod_max_pixel_error);
+        }
+    }
+
+    /* The caller has waited on this image, so its secondary is free to re-record */
+    if (this->needs_recording(index))
+    {
+        this->record_command_buffer(index);
+    }
+
+    buffer.executeCommands(command_buffers[index]);
+}
+
+void Scene::set_lod_target(float viewport_height, float max_pixel_error)
+{
+    lod_viewport_height = viewport_height;
+    lod_max_pixel_error = max_pixel_error;
 }
 
 void Scene::update_buffer() const
 {
-	void *data;
-	light_data_buffer->map_memory(&data);
-	memcpy(data, &light_data, sizeof(light_data));
-	light_data_buffer->unmap_memory();
+	devmem->get_uniform_ring()->write(light_data_block, &light_data);
 }
@@ -0,0 +1,391 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "r_texture_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+uint32_t get_texture_mip_count(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+
+    for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+    {
+        levels++;
+    }
+
+    return levels;
+}
+
+void downsample_rgba8(const uint8_t *src, uint32_t src_width, uint32_t src_height, uint8_t *dest)
+{
+    uint32_t dest_width = std::max(src_width / 2, 1u);
+    uint32_t dest_height = std::max(src_height / 2, 1u);
+
+    for (uint32_t y = 0; y < dest_height; y++)
+    {
+        uint32_t y0 = std::min(y * 2, src_height - 1);
+        uint32_t y1 = std::min(y * 2 + 1, src_height - 1);
+
+        for (uint32_t x = 0; x < dest_width; x++)
+        {
+            uint32_t x0 = std::min(x * 2, src_width - 1);
+            uint32_t x1 = std::min(x * 2 + 1, src_width - 1);
+
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                uint32_t sum = src[(y0 * src_width + x0) * 4 + c]
+                    + src[(y0 * src_width + x1) * 4 + c]
+                    + src[(y1 * src_width + x0) * 4 + c]
+                    + src[(y1 * src_width + x1) * 4 + c];
+
+                dest[(y * dest_width + x) * 4 + c] = (uint8_t) ((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+uint32_t get_texture_block_size(vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eBc1RgbUnormBlock:
+    case vk::Format::eBc1RgbSrgbBlock:
+    case vk::Format::eBc1RgbaUnormBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+    case vk::Format::eBc4UnormBlock:
+    case vk::Format::eBc4SnormBlock:
+        return 8;
+    case vk::Format::eBc3UnormBlock:
+    case vk::Format::eBc3SrgbBlock:
+    case vk::Format::eBc5UnormBlock:
+    case vk::Format::eBc5SnormBlock:
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+size_t get_texture_level_size(vk::Format format, uint32_t width, uint32_t height)
+{
+    uint32_t block_size = get_texture_block_size(format);
+
+    if (block_size == 0)
+    {
+        return (size_t) width * height * 4;
+    }
+
+    return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * block_size;
+}
+
+static void write_u16(uint8_t *dest, uint16_t value)
+{
+    dest[0] = (uint8_t) (value & 0xff);
+    dest[1] = (uint8_t) (value >> 8);
+}
+
+static uint16_t pack_565(const float color[3])
+{
+    int r = std::min(std::max((int) (color[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+    int g = std::min(std::max((int) (color[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+    int b = std::min(std::max((int) (color[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+
+    return (uint16_t) ((r << 11) | (g << 5) | b);
+}
+
+static void unpack_565(uint16_t packed, int color[3])
+{
+    int r = (packed >> 11) & 0x1f;
+    int g = (packed >> 5) & 0x3f;
+    int b = packed & 0x1f;
+
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+/*
+ * Fit the block's colours along their principal axis, inset the endpoints
+ * by 1/16 of the range to make up for quantization, then pick the nearest
+ * of the four palette entries for each pixel
+ */
+static void encode_bc1_block(const uint8_t block[64], uint8_t *dest)
+{
+    float mean[3] = { 0, 0, 0 };
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            mean[c] += block[i * 4 + c];
+        }
+    }
+
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        mean[c] /= 16.0f;
+    }
+
+    /* Covariance as rr rg rb gg gb bb */
+    float cov[6] = { 0, 0, 0, 0, 0, 0 };
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        float r = block[i * 4 + 0] - mean[0];
+        float g = block[i * 4 + 1] - mean[1];
+        float b = block[i * 4 + 2] - mean[2];
+
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+
+    for (uint32_t iteration = 0; iteration < 8; iteration++)
+    {
+        float next[3] = {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+        };
+
+        float length = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+        if (length < 1e-6f)
+        {
+            break;
+        }
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float length_sq = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float min_t = 0.0f;
+    float max_t = 0.0f;
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        float t = ((block[i * 4 + 0] - mean[0]) * axis[0]
+            + (block[i * 4 + 1] - mean[1]) * axis[1]
+            + (block[i * 4 + 2] - mean[2]) * axis[2]) / length_sq;
+
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+
+    float inset = (max_t - min_t) / 16.0f;
+    min_t += inset;
+    max_t -= inset;
+
+    float max_color[3];
+    float min_color[3];
+
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        max_color[c] = mean[c] + axis[c] * max_t;
+        min_color[c] = mean[c] + axis[c] * min_t;
+    }
+
+    uint16_t color0 = pack_565(max_color);
+    uint16_t color1 = pack_565(min_color);
+
+    /* color0 > color1 selects the four colour mode */
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+    }
+
+    uint32_t indicies = 0;
+
+    if (color0 != color1)
+    {
+        int palette[4][3];
+        unpack_565(color0, palette[0]);
+        unpack_565(color1, palette[1]);
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            uint32_t best = 0;
+            int best_error = INT32_MAX;
+
+            for (uint32_t p = 0; p < 4; p++)
+            {
+                int error = 0;
+                for (uint32_t c = 0; c < 3; c++)
+                {
+                    int delta = block[i * 4 + c] - palette[p][c];
+                    error += delta * delta;
+                }
+
+                if (error < best_error)
+                {
+                    best = p;
+                    best_error = error;
+                }
+            }
+
+            indicies |= best << (i * 2);
+        }
+    }
+
+    write_u16(dest + 0, color0);
+    write_u16(dest + 2, color1);
+    dest[4] = (uint8_t) (indicies & 0xff);
+    dest[5] = (uint8_t) ((indicies >> 8) & 0xff);
+    dest[6] = (uint8_t) ((indicies >> 16) & 0xff);
+    dest[7] = (uint8_t) (indicies >> 24);
+}
+
+/*
+ * Single channel block in the eight value mode, endpoints are the channel's
+ * minimum and maximum. Used for BC3 alpha and both BC5 channels.
+ */
+static void encode_bc4_block(const uint8_t block[64], uint32_t channel, uint8_t *dest)
+{
+    uint8_t max_value = 0;
+    uint8_t min_value = 255;
+
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        max_value = std::max(max_value, block[i * 4 + channel]);
+        min_value = std::min(min_value, block[i * 4 + channel]);
+    }
+
+    dest[0] = max_value;
+    dest[1] = min_value;
+
+    uint64_t indicies = 0;
+
+    if (max_value != min_value)
+    {
+        int palette[8];
+        palette[0] = max_value;
+        palette[1] = min_value;
+
+        for (int code = 2; code < 8; code++)
+        {
+            palette[code] = ((8 - code) * max_value + (code - 1) * min_value) / 7;
+        }
+
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            uint64_t best = 0;
+            int best_error = INT32_MAX;
+
+            for (uint32_t p = 0; p < 8; p++)
+            {
+                int error = std::abs(block[i * 4 + channel] - palette[p]);
+                if (error < best_error)
+                {
+                    best = p;
+                    best_error = error;
+                }
+            }
+
+            indicies |= best << (i * 3);
+        }
+    }
+
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        dest[2 + i] = (uint8_t) ((indicies >> (i * 8)) & 0xff);
+    }
+}
+
+std::vector<uint8_t> compress_texture(vk::Format format, const uint8_t *rgba, uint32_t width, uint32_t height)
+{
+    uint32_t block_size = get_texture_block_size(format);
+
+    switch (format)
+    {
+    case vk::Format::eBc1RgbUnormBlock:
+    case vk::Format::eBc1RgbSrgbBlock:
+    case vk::Format::eBc1RgbaUnormBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+    case vk::Format::eBc3UnormBlock:
+    case vk::Format::eBc3SrgbBlock:
+    case vk::Format::eBc5UnormBlock:
+        break;
+    default:
+        throw std::invalid_argument("unsupported texture compression format");
+    }
+
+    uint32_t blocks_x = (width + 3) / 4;
+    uint32_t blocks_y = (height + 3) / 4;
+
+    std::vector<uint8_t> result((size_t) blocks_x * blocks_y * block_size);
+    uint8_t block[64];
+
+    for (uint32_t by = 0; by < blocks_y; by++)
+    {
+        for (uint32_t bx = 0; bx < blocks_x; bx++)
+        {
+            /* Partial blocks repeat the last row/column */
+            for (uint32_t y = 0; y < 4; y++)
+            {
+                uint32_t sy = std::min(by * 4 + y, height - 1);
+
+                for (uint32_t x = 0; x < 4; x++)
+                {
+                    uint32_t sx = std::min(bx * 4 + x, width - 1);
+                    memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t) sy * width + sx) * 4], 4);
+                }
+            }
+
+            uint8_t *dest = &result[((size_t) by * blocks_x + bx) * block_size];
+
+            switch (format)
+            {
+            case vk::Format::eBc3UnormBlock:
+            case vk::Format::eBc3SrgbBlock:
+                encode_bc4_block(block, 3, dest);
+                encode_bc1_block(block, dest + 8);
+                break;
+            case vk::Format::eBc5UnormBlock:
+                encode_bc4_block(block, 0, dest);
+                encode_bc4_block(block, 1, dest + 8);
+                break;
+            default:
+                encode_bc1_block(block, dest);
+                break;
+            }
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,388 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "r_texture_file.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "r_texture_codec.h"
+#include "u_debug.h"
+
+#define DDS_MAGIC 0x20534444 /* "DDS " */
+#define DDS_FOURCC(a, b, c, d) ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16) | ((uint32_t) (d) << 24))
+
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDSD_DEPTH 0x800000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+#define DDSCAPS2_CUBEMAP 0x200
+#define DDS_DIMENSION_TEXTURE2D 3
+
+static const uint8_t ktx2_identifier[12] = { 0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+
+struct DDSPixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourcc;
+    uint32_t rgb_bit_count;
+    uint32_t bit_mask[4];
+};
+
+struct DDSHeader
+{
+    uint32_t magic;
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitch_or_linear_size;
+    uint32_t depth;
+    uint32_t mip_map_count;
+    uint32_t reserved1[11];
+    DDSPixelFormat pixel_format;
+    uint32_t caps[4];
+    uint32_t reserved2;
+};
+
+struct DDSHeaderDX10
+{
+    uint32_t dxgi_format;
+    uint32_t resource_dimension;
+    uint32_t misc_flag;
+    uint32_t array_size;
+    uint32_t misc_flags2;
+};
+
+struct KTX2Header
+{
+    uint8_t identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+    uint32_t dfd_offset;
+    uint32_t dfd_length;
+    uint32_t kvd_offset;
+    uint32_t kvd_length;
+    uint64_t sgd_offset;
+    uint64_t sgd_length;
+};
+
+struct KTX2Level
+{
+    uint64_t offset;
+    uint64_t length;
+    uint64_t uncompressed_length;
+};
+
+struct DXGIFormatMapping
+{
+    uint32_t dxgi_format;
+    vk::Format format;
+};
+
+static const DXGIFormatMapping dxgi_formats[] = {
+    { 28, vk::Format::eR8G8B8A8Unorm },
+    { 29, vk::Format::eR8G8B8A8Srgb },
+    { 71, vk::Format::eBc1RgbaUnormBlock },
+    { 72, vk::Format::eBc1RgbaSrgbBlock },
+    { 77, vk::Format::eBc3UnormBlock },
+    { 78, vk::Format::eBc3SrgbBlock },
+    { 83, vk::Format::eBc5UnormBlock },
+    { 84, vk::Format::eBc5SnormBlock },
+    { 98, vk::Format::eBc7UnormBlock },
+    { 99, vk::Format::eBc7SrgbBlock },
+};
+
+static bool is_supported_format(vk::Format format)
+{
+    for (const auto & entry : dxgi_formats)
+    {
+        if (entry.format == format)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+TextureFile::TextureFile()
+    : mapping{ 0, nullptr, nullptr }, buffer{ 0, nullptr }, format(vk::Format::eUndefined)
+{
+}
+
+TextureFile::~TextureFile()
+{
+    this->close();
+}
+
+bool TextureFile::open(const std::string& path)
+{
+    DEBUG_ASSERT(mapping.data == nullptr);
+
+    if (!map_file(path, &mapping))
+    {
+        return false;
+    }
+
+    return this->parse(path);
+}
+
+bool TextureFile::open(const std::string& path, file_data *data)
+{
+    DEBUG_ASSERT(mapping.data == nullptr);
+
+    buffer = *data;
+    *data = { 0, nullptr };
+    mapping = { buffer.size, buffer.data, nullptr };
+
+    return this->parse(path);
+}
+
+void TextureFile::close()
+{
+    if (buffer.data)
+    {
+        free_file(&buffer);
+        mapping = { 0, nullptr, nullptr };
+    }
+    else
+    {
+        unmap_file(&mapping);
+    }
+}
+
+bool TextureFile::parse(const std::string& path)
+{
+    bool parsed = false;
+
+    if (mapping.size >= sizeof(KTX2Header) && memcmp(mapping.data, ktx2_identifier, sizeof(ktx2_identifier)) == 0)
+    {
+        parsed = this->parse_ktx2();
+    }
+    else if (mapping.size >= sizeof(DDSHeader) && *(const uint32_t *) mapping.data == DDS_MAGIC)
+    {
+        parsed = this->parse_dds();
+    }
+
+    if (!parsed || !this->validate())
+    {
+        LOG_WARN("Unsupported or corrupt texture file %s", path.c_str());
+        this->close();
+        levels.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool TextureFile::parse_dds()
+{
+    const DDSHeader *header = (const DDSHeader *) mapping.data;
+    uint64_t offset = sizeof(DDSHeader);
+
+    if (header->size != sizeof(DDSHeader) - sizeof(uint32_t) || (header->flags & DDSD_DEPTH) != 0 || (header->caps[1] & DDSCAPS2_CUBEMAP) != 0)
+    {
+        return false;
+    }
+
+    if (!(header->pixel_format.flags & DDPF_FOURCC))
+    {
+        return false;
+    }
+
+    switch (header->pixel_format.fourcc)
+    {
+    case DDS_FOURCC('D', 'X', 'T', '1'):
+        format = vk::Format::eBc1RgbaUnormBlock;
+        break;
+    case DDS_FOURCC('D', 'X', 'T', '5'):
+        format = vk::Format::eBc3UnormBlock;
+        break;
+    case DDS_FOURCC('A', 'T', 'I', '2'):
+    case DDS_FOURCC('B', 'C', '5', 'U'):
+        format = vk::Format::eBc5UnormBlock;
+        break;
+    case DDS_FOURCC('D', 'X', '1', '0'):
+    {
+        if (mapping.size < offset + sizeof(DDSHeaderDX10))
+        {
+            return false;
+        }
+
+        const DDSHeaderDX10 *dx10 = (const DDSHeaderDX10 *) ((const char *) mapping.data + offset);
+        offset += sizeof(DDSHeaderDX10);
+
+        if (dx10->resource_dimension != DDS_DIMENSION_TEXTURE2D || dx10->array_size > 1)
+        {
+            return false;
+        }
+
+        for (const auto & entry : dxgi_formats)
+        {
+            if (entry.dxgi_format == dx10->dxgi_format)
+            {
+                format = entry.format;
+            }
+        }
+        break;
+    }
+    default:
+        return false;
+    }
+
+    uint32_t level_count = (header->flags & DDSD_MIPMAPCOUNT) ? std::max(header->mip_map_count, 1u) : 1;
+    if (level_count > 32)
+    {
+        return false;
+    }
+
+    for (uint32_t level = 0; level < level_count; level++)
+    {
+        uint32_t width = std::max(header->width >> level, 1u);
+        uint32_t height = std::max(header->height >> level, 1u);
+        uint64_t size = get_texture_level_size(format, width, height);
+
+        levels.push_back({ offset, size, width, height });
+        offset += size;
+    }
+
+    return true;
+}
+
+bool TextureFile::parse_ktx2()
+{
+    const KTX2Header *header = (const KTX2Header *) mapping.data;
+
+    if (header->supercompression_scheme != 0 || header->pixel_depth > 1 || header->layer_count > 1 || header->face_count != 1)
+    {
+        return false;
+    }
+
+    format = (vk::Format) header->vk_format;
+
+    /* A level count of zero asks the loader to generate mips, which we can't for BCn */
+    uint32_t level_count = std::max(header->level_count, 1u);
+    if (level_count > 32 || mapping.size < sizeof(KTX2Header) + (uint64_t) level_count * sizeof(KTX2Level))
+    {
+        return false;
+    }
+
+    const KTX2Level *level_index = (const KTX2Level *) ((const char *) mapping.data + sizeof(KTX2Header));
+
+    for (uint32_t level = 0; level < level_count; level++)
+    {
+        levels.push_back({
+            level_index[level].offset,
+            level_index[level].length,
+            std::max(header->pixel_width >> level, 1u),
+            std::max(header->pixel_height >> level, 1u)
+        });
+    }
+
+    return true;
+}
+
+bool TextureFile::validate() const
+{
+    if (!is_supported_format(format) || levels.empty() || levels[0].width == 0 || levels[0].height == 0)
+    {
+        return false;
+    }
+
+    uint32_t block_size = std::max(get_texture_block_size(format), 4u);
+
+    for (const auto & level : levels)
+    {
+        /* Copies out of the staging buffer need block aligned offsets */
+        if (level.offset > mapping.size || level.size > mapping.size - level.offset ||
+            level.size != get_texture_level_size(format, level.width, level.height) ||
+            (level.offset - levels[0].offset) % block_size != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TextureFile::write(const std::string& path, vk::Format format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels)
+{
+    uint32_t dxgi_format = 0;
+
+    for (const auto & entry : dxgi_formats)
+    {
+        if (entry.format == format)
+        {
+            dxgi_format = entry.dxgi_format;
+        }
+    }
+
+    if (dxgi_format == 0 || levels.empty())
+    {
+        return false;
+    }
+
+    DDSHeader header{};
+    header.magic = DDS_MAGIC;
+    header.size = sizeof(DDSHeader) - sizeof(uint32_t);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = height;
+    header.width = width;
+    header.pitch_or_linear_size = (uint32_t) levels[0].size();
+    header.depth = 1;
+    header.mip_map_count = (uint32_t) levels.size();
+    header.pixel_format.size = sizeof(DDSPixelFormat);
+    header.pixel_format.flags = DDPF_FOURCC;
+    header.pixel_format.fourcc = DDS_FOURCC('D', 'X', '1', '0');
+    header.caps[0] = DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+    DDSHeaderDX10 dx10{};
+    dx10.dxgi_format = dxgi_format;
+    dx10.resource_dimension = DDS_DIMENSION_TEXTURE2D;
+    dx10.array_size = 1;
+
+    std::vector<uint8_t> data(sizeof(header) + sizeof(dx10));
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), &dx10, sizeof(dx10));
+
+    for (const auto & level : levels)
+    {
+        data.insert(data.end(), level.begin(), level.end());
+    }
+
+    return write_file(path, data.data(), data.size());
+}
@@ -0,0 +1,345 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include "u_asset_pack.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+/* Identify mappings handed out by map_entry, in place of an os handle */
+static char stored_entry_tag;
+static char decompressed_entry_tag;
+
+static std::unique_ptr<AssetPack> mounted_pack;
+
+/*
+ * Decode an lz4 block, failing rather than reading or writing out of bounds
+ * on corrupt input
+ */
+static bool lz4_decompress(const uint8_t *src, size_t src_size, uint8_t *dest, size_t dest_size)
+{
+	const uint8_t *src_end = src + src_size;
+	uint8_t *dest_start = dest;
+	uint8_t *dest_end = dest + dest_size;
+
+	while (src < src_end)
+	{
+		uint8_t token = *src++;
+
+		size_t literals = token >> 4;
+		if (literals == 15)
+		{
+			uint8_t extra;
+			do
+			{
+				if (src >= src_end)
+				{
+					return false;
+				}
+
+				extra = *src++;
+				literals += extra;
+			} while (extra == 255);
+		}
+
+		if (literals > (size_t) (src_end - src) || literals > (size_t) (dest_end - dest))
+		{
+			return false;
+		}
+
+		memcpy(dest, src, literals);
+		src += literals;
+		dest += literals;
+
+		/* The last sequence is literals only */
+		if (src == src_end)
+		{
+			break;
+		}
+
+		if (src_end - src < 2)
+		{
+			return false;
+		}
+
+		size_t offset = src[0] | (src[1] << 8);
+		src += 2;
+
+		if (offset == 0 || offset > (size_t) (dest - dest_start))
+		{
+			return false;
+		}
+
+		size_t length = (token & 0xf) + 4;
+		if ((token & 0xf) == 15)
+		{
+			uint8_t extra;
+			do
+			{
+				if (src >= src_end)
+				{
+					return false;
+				}
+
+				extra = *src++;
+				length += extra;
+			} while (extra == 255);
+		}
+
+		if (length > (size_t) (dest_end - dest))
+		{
+			return false;
+		}
+
+		/* Matches may overlap their own output, copy bytewise */
+		const uint8_t *match = dest - offset;
+		for (size_t i = 0; i < length; i++)
+		{
+			dest[i] = match[i];
+		}
+
+		dest += length;
+	}
+
+	return dest == dest_end;
+}
+
+/* Asset names are looked up with forward slashes and no leading "./" */
+static std::string normalize_name(const std::string& name)
+{
+	std::string result = name;
+
+	for (auto & c : result)
+	{
+		if (c == '\\')
+		{
+			c = '/';
+		}
+	}
+
+	while (result.compare(0, 2, "./") == 0)
+	{
+		result.erase(0, 2);
+	}
+
+	return result;
+}
+
+AssetPack::AssetPack()
+	: mapping{ 0, nullptr, nullptr }, header(nullptr), entries(nullptr)
+{
+}
+
+AssetPack::~AssetPack()
+{
+	unmap_file(&mapping);
+}
+
+bool AssetPack::open(const std::string& path)
+{
+	if (!map_file(path, &mapping))
+	{
+		return false;
+	}
+
+	/* The header must be in bounds before anything is read through it */
+	if (mapping.size < sizeof(AssetPackHeader))
+	{
+		std::cerr << "Truncated asset pack " << path << std::endl;
+		unmap_file(&mapping);
+		return false;
+	}
+
+	header = (const AssetPackHeader *) mapping.data;
+	entries = (const AssetPackEntry *) ((const char *) mapping.data + header->toc_offset);
+
+	if (!validate())
+	{
+		std::cerr << "Corrupt asset pack " << path << std::endl;
+		unmap_file(&mapping);
+		header = nullptr;
+		entries = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+bool AssetPack::validate() const
+{
+	if (header->magic != ASSET_PACK_MAGIC ||
+		header->version != ASSET_PACK_VERSION)
+	{
+		return false;
+	}
+
+	if (header->toc_offset > mapping.size ||
+		header->entry_count > (mapping.size - header->toc_offset) / sizeof(AssetPackEntry) ||
+		header->toc_offset % alignof(AssetPackEntry) != 0 ||
+		header->string_table_offset > mapping.size ||
+		header->string_table_size > mapping.size - header->string_table_offset)
+	{
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header->entry_count; i++)
+	{
+		const AssetPackEntry& entry = entries[i];
+
+		if (entry.offset > mapping.size || entry.size > mapping.size - entry.offset ||
+			(uint64_t) entry.name_offset + entry.name_length > header->string_table_size ||
+			entry.compression > ASSET_PACK_COMPRESSION_LZ4 ||
+			(entry.compression == ASSET_PACK_COMPRESSION_NONE && entry.size != entry.uncompressed_size) ||
+			(i > 0 && entries[i - 1].hash > entry.hash))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+uint64_t AssetPack::hash_name(const std::string& name)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	for (char c : name)
+	{
+		hash = (hash ^ (uint8_t) c) * 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+const AssetPackEntry *AssetPack::find(const std::string& name) const
+{
+	if (!header)
+	{
+		return nullptr;
+	}
+
+	std::string key = normalize_name(name);
+	uint64_t hash = hash_name(key);
+
+	const AssetPackEntry *first = entries;
+	const AssetPackEntry *last = entries + header->entry_count;
+
+	while (first < last)
+	{
+		const AssetPackEntry *middle = first + (last - first) / 2;
+
+		if (middle->hash < hash)
+		{
+			first = middle + 1;
+		}
+		else
+		{
+			last = middle;
+		}
+	}
+
+	/* Hashes are unique in a pack, the name check only rules out misses */
+	if (first == entries + header->entry_count || first->hash != hash)
+	{
+		return nullptr;
+	}
+
+	const char *strings = (const char *) mapping.data + header->string_table_offset;
+	if (key.size() != first->name_length || memcmp(strings + first->name_offset, key.data(), key.size()) != 0)
+	{
+		return nullptr;
+	}
+
+	return first;
+}
+
+bool AssetPack::map_entry(const AssetPackEntry *entry, file_mapping *out_mapping) const
+{
+	const uint8_t *data = (const uint8_t *) mapping.data + entry->offset;
+
+	if (entry->compression == ASSET_PACK_COMPRESSION_NONE)
+	{
+		out_mapping->size = (size_t) entry->size;
+		out_mapping->data = data;
+		out_mapping->handle = &stored_entry_tag;
+		return true;
+	}
+
+	uint8_t *buffer = (uint8_t *) malloc(entry->uncompressed_size > 0 ? (size_t) entry->uncompressed_size : 1);
+	if (!buffer)
+	{
+		return false;
+	}
+
+	if (!lz4_decompress(data, (size_t) entry->size, buffer, (size_t) entry->uncompressed_size))
+	{
+		std::cerr << "Corrupt asset pack entry " << std::string((const char *) mapping.data + header->string_table_offset + entry->name_offset, entry->name_length) << std::endl;
+		free(buffer);
+		return false;
+	}
+
+	out_mapping->size = (size_t) entry->uncompressed_size;
+	out_mapping->data = buffer;
+	out_mapping->handle = &decompressed_entry_tag;
+	return true;
+}
+
+bool AssetPack::unmap_entry(file_mapping *mapping)
+{
+	if (mapping->handle == &decompressed_entry_tag)
+	{
+		free((void *) mapping->data);
+	}
+	else if (mapping->handle != &stored_entry_tag)
+	{
+		return false;
+	}
+
+	mapping->size = 0;
+	mapping->data = nullptr;
+	mapping->handle = nullptr;
+	return true;
+}
+
+bool mount_asset_pack(const std::string& path)
+{
+	std::unique_ptr<AssetPack> pack = std::make_unique<AssetPack>();
+
+	if (!pack->open(path))
+	{
+		return false;
+	}
+
+	mounted_pack = std::move(pack);
+	return true;
+}
+
+void unmount_asset_pack()
+{
+	mounted_pack.reset();
+}
+
+const AssetPack *get_asset_pack()
+{
+	return mounted_pack.get();
+}
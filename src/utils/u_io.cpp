@@ -21,17 +21,65 @@
 ******************************************************************************/
 
 #include "u_io.h"
+#include "u_asset_pack.h"
 
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef ENABLE_IO_URING
+#include <liburing.h>
+
+#define IO_URING_QUEUE_DEPTH 64
+#endif
+
 bool read_file(std::string filename, file_data *data)
 {
 	FILE *file;
 	bool result;
 
 	std::string path = FILENAME_TO_PATH(filename);
-	void *buffer;
+	void *buffer = nullptr;
 	size_t length, read_size;
+	struct stat info;
+	file_mapping mapping;
+
+	/* Packed assets are copied out of the pack mapping */
+	const AssetPack *pack = get_asset_pack();
+	const AssetPackEntry *entry = pack ? pack->find(filename) : nullptr;
+
+	if (entry)
+	{
+		if (!pack->map_entry(entry, &mapping))
+		{
+			return false;
+		}
+
+		buffer = malloc(mapping.size > 0 ? mapping.size : 1);
+		if (buffer)
+		{
+			memcpy(buffer, mapping.data, mapping.size);
+			data->size = mapping.size;
+			data->data = buffer;
+		}
+
+		unmap_file(&mapping);
+		return buffer != nullptr;
+	}
 
 	file = fopen(path.c_str(), "rb");
 	if (!file)
@@ -41,11 +89,15 @@ bool read_file(std::string filename, file_data *data)
 		goto err_out;
 	}
 
-	fseek(file, 0, SEEK_END);
-	length = ftell(file);
-	fseek(file, 0, SEEK_SET);
+	if (fstat(fileno(file), &info) != 0)
+	{
+		std::cerr << "Error reading file " << path << " " << std::strerror(errno) << std::endl;
+		result = false;
+		goto err_close;
+	}
 
-	buffer = malloc(length);
+	length = (size_t) info.st_size;
+	buffer = malloc(length > 0 ? length : 1);
 
 	if (!buffer)
 	{
@@ -60,7 +112,7 @@ bool read_file(std::string filename, file_data *data)
 	{
 		std::cerr << "Error reading file " << path << " (" << read_size << "!=" << length << ") " << std::strerror(errno) << std::endl;
 		result = false;
-		goto err_out;
+		goto err_close;
 	}
 
 	data->size = length;
@@ -72,9 +124,398 @@ err_close:
 	{
 		std::cerr << "Error closing file " << path << " " << std::strerror(errno) << std::endl;
 		result = false;
-		goto err_out;
+	}
+
+	if (!result)
+	{
+		free(buffer);
 	}
 
 err_out:
 	return result;
 }
+
+void free_file(file_data *data)
+{
+	free(data->data);
+	data->size = 0;
+	data->data = nullptr;
+}
+
+#ifdef ENABLE_IO_URING
+/*
+ * Open every file up front then keep up to IO_URING_QUEUE_DEPTH reads in
+ * flight, resubmitting the remainder of any short read. Returns false if
+ * the ring could not be created.
+ */
+static bool read_files_uring(std::vector<file_read_request>& requests, bool *out_result)
+{
+	struct io_uring ring;
+	if (io_uring_queue_init(IO_URING_QUEUE_DEPTH, &ring, 0) < 0)
+	{
+		return false;
+	}
+
+	std::vector<int> fds(requests.size(), -1);
+	std::vector<size_t> read_sizes(requests.size(), 0);
+
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		file_read_request& request = requests[i];
+		std::string path = FILENAME_TO_PATH(request.path);
+		struct stat info;
+
+		request.data = { 0, nullptr };
+		request.result = false;
+
+		fds[i] = open(path.c_str(), O_RDONLY);
+		if (fds[i] < 0 || fstat(fds[i], &info) != 0)
+		{
+			std::cerr << "Error reading file " << path << " " << std::strerror(errno) << std::endl;
+			continue;
+		}
+
+		request.data.size = (size_t) info.st_size;
+		request.data.data = malloc(request.data.size > 0 ? request.data.size : 1);
+	}
+
+	auto queue_read = [&](size_t i)
+	{
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+		io_uring_prep_read(sqe, fds[i], (char *) requests[i].data.data + read_sizes[i], (unsigned) (requests[i].data.size - read_sizes[i]), read_sizes[i]);
+		io_uring_sqe_set_data(sqe, (void *) (uintptr_t) i);
+	};
+
+	auto finish_read = [&](size_t i, bool success)
+	{
+		close(fds[i]);
+		fds[i] = -1;
+
+		requests[i].result = success;
+		if (!success)
+		{
+			std::cerr << "Error reading file " << FILENAME_TO_PATH(requests[i].path) << std::endl;
+			free_file(&requests[i].data);
+		}
+	};
+
+	size_t next = 0;
+	size_t in_flight = 0;
+
+	while (next < requests.size() || in_flight > 0)
+	{
+		for (; next < requests.size() && in_flight < IO_URING_QUEUE_DEPTH; next++)
+		{
+			if (fds[next] < 0 || !requests[next].data.data)
+			{
+				continue;
+			}
+
+			if (requests[next].data.size == 0)
+			{
+				finish_read(next, true);
+				continue;
+			}
+
+			queue_read(next);
+			in_flight++;
+		}
+
+		if (in_flight == 0)
+		{
+			break;
+		}
+
+		io_uring_submit(&ring);
+
+		struct io_uring_cqe *cqe;
+		if (io_uring_wait_cqe(&ring, &cqe) < 0)
+		{
+			break;
+		}
+
+		size_t i = (size_t) (uintptr_t) io_uring_cqe_get_data(cqe);
+		int res = cqe->res;
+		io_uring_cqe_seen(&ring, cqe);
+
+		if (res <= 0)
+		{
+			finish_read(i, false);
+			in_flight--;
+			continue;
+		}
+
+		read_sizes[i] += (size_t) res;
+		if (read_sizes[i] < requests[i].data.size)
+		{
+			queue_read(i);
+		}
+		else
+		{
+			finish_read(i, true);
+			in_flight--;
+		}
+	}
+
+	io_uring_queue_exit(&ring);
+
+	bool result = true;
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		if (fds[i] >= 0)
+		{
+			finish_read(i, false);
+		}
+
+		result &= requests[i].result;
+	}
+
+	*out_result = result;
+	return true;
+}
+#endif
+
+bool read_files(std::vector<file_read_request>& requests)
+{
+	bool result = true;
+
+	/* Packed assets are a copy out of memory, only loose files go to the kernel */
+	const AssetPack *pack = get_asset_pack();
+	std::vector<file_read_request> loose_requests;
+	std::vector<size_t> loose_indices;
+
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		if (pack && pack->find(requests[i].path))
+		{
+			requests[i].data = { 0, nullptr };
+			requests[i].result = read_file(requests[i].path, &requests[i].data);
+			result &= requests[i].result;
+		}
+		else
+		{
+			loose_requests.push_back({ requests[i].path, { 0, nullptr }, false });
+			loose_indices.push_back(i);
+		}
+	}
+
+#ifdef ENABLE_IO_URING
+	/* Fall back to blocking reads if the ring can't be created */
+	bool loose_result;
+	if (read_files_uring(loose_requests, &loose_result))
+	{
+		for (size_t i = 0; i < loose_requests.size(); i++)
+		{
+			requests[loose_indices[i]].data = loose_requests[i].data;
+			requests[loose_indices[i]].result = loose_requests[i].result;
+		}
+
+		return result && loose_result;
+	}
+#endif
+
+	for (size_t i : loose_indices)
+	{
+		requests[i].data = { 0, nullptr };
+		requests[i].result = read_file(requests[i].path, &requests[i].data);
+		result &= requests[i].result;
+	}
+
+	return result;
+}
+
+bool write_file(std::string filename, const void *data, size_t size)
+{
+	std::string path = FILENAME_TO_PATH(filename);
+	std::string temp_path = path + ".tmp";
+
+	/*
+	 * Write to a temporary file first and move it over the destination, so a
+	 * crash part way through never leaves a truncated file behind
+	 */
+	FILE *file = fopen(temp_path.c_str(), "wb");
+	if (!file)
+	{
+		std::cerr << "Error opening file " << temp_path << " " << std::strerror(errno) << std::endl;
+		return false;
+	}
+
+	size_t write_size = fwrite(data, sizeof(char), size, file);
+	bool result = ferror(file) == 0 && write_size == size;
+
+	if (fclose(file) != 0 || !result)
+	{
+		std::cerr << "Error writing file " << temp_path << " " << std::strerror(errno) << std::endl;
+		remove(temp_path.c_str());
+		return false;
+	}
+
+#ifdef _WIN32
+	result = MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	result = rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+
+	if (!result)
+	{
+		std::cerr << "Error replacing file " << path << " " << std::strerror(errno) << std::endl;
+		remove(temp_path.c_str());
+	}
+
+	return result;
+}
+
+bool get_file_stamp(std::string filename, file_stamp *stamp)
+{
+	std::string path = FILENAME_TO_PATH(filename);
+	struct stat info;
+
+	const AssetPack *pack = get_asset_pack();
+	const AssetPackEntry *entry = pack ? pack->find(filename) : nullptr;
+
+	if (entry)
+	{
+		stamp->size = entry->uncompressed_size;
+		stamp->mtime = entry->mtime;
+		return true;
+	}
+
+	if (stat(path.c_str(), &info) != 0)
+	{
+		return false;
+	}
+
+	stamp->size = (uint64_t) info.st_size;
+	stamp->mtime = (int64_t) info.st_mtime;
+	return true;
+}
+
+std::string get_canonical_path(std::string filename)
+{
+	std::string path = FILENAME_TO_PATH(filename);
+
+#ifdef _WIN32
+	char resolved[MAX_PATH];
+	if (_fullpath(resolved, path.c_str(), MAX_PATH) == nullptr)
+	{
+		return path;
+	}
+
+	/* Windows paths are case insensitive and accept either separator */
+	std::string result(resolved);
+	for (auto & c : result)
+	{
+		c = c == '/' ? '\\' : (char) tolower((unsigned char) c);
+	}
+
+	return result;
+#else
+	char *resolved = realpath(path.c_str(), nullptr);
+	if (resolved == nullptr)
+	{
+		return path;
+	}
+
+	std::string result(resolved);
+	free(resolved);
+	return result;
+#endif
+}
+
+bool map_file(std::string filename, file_mapping *mapping)
+{
+	std::string path = FILENAME_TO_PATH(filename);
+
+	const AssetPack *pack = get_asset_pack();
+	const AssetPackEntry *entry = pack ? pack->find(filename) : nullptr;
+
+	if (entry)
+	{
+		return pack->map_entry(entry, mapping);
+	}
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+
+	if (!map)
+	{
+		std::cerr << "Error mapping file " << path << std::endl;
+		return false;
+	}
+
+	void *data = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		std::cerr << "Error mapping file " << path << std::endl;
+		CloseHandle(map);
+		return false;
+	}
+
+	mapping->size = (size_t) length.QuadPart;
+	mapping->data = data;
+	mapping->handle = map;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+	{
+		std::cerr << "Error mapping file " << path << " " << std::strerror(errno) << std::endl;
+		return false;
+	}
+
+	madvise(data, (size_t) info.st_size, MADV_SEQUENTIAL);
+
+	mapping->size = (size_t) info.st_size;
+	mapping->data = data;
+	mapping->handle = nullptr;
+#endif
+
+	return true;
+}
+
+void unmap_file(file_mapping *mapping)
+{
+	if (!mapping->data || AssetPack::unmap_entry(mapping))
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(mapping->data);
+	CloseHandle((HANDLE) mapping->handle);
+#else
+	munmap((void *) mapping->data, mapping->size);
+#endif
+
+	mapping->size = 0;
+	mapping->data = nullptr;
+	mapping->handle = nullptr;
+}
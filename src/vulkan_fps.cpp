@@ -33,13 +33,20 @@
 #include "r_camera.h"
 #include "r_model.h"
 #include "r_scene.h"
+#include "u_asset_pack.h"
 #include "u_debug.h"
+#include "u_thread_pool.h"
 #include "r_model_loader.h"
 
 int main(int argc, char *argv[])
 {
 	LOG_INFO("Starting vulkan application");
 
+	if (!mount_asset_pack(ASSET_PACK_NAME))
+	{
+		LOG_INFO("No asset pack, loading loose files");
+	}
+
 	{
 		std::shared_ptr<GraphicsWindow> window = std::make_shared<GraphicsWindow>("Vulkan FPS", 800, 800);
 		std::shared_ptr<GraphicsDevice> device = std::make_shared<GraphicsDevice>(window);
@@ -60,76 +67,52 @@ int main(int argc, char *argv[])
         std::shared_ptr<Scene> main_scene = std::make_unique<Scene>(device, devmem);
         Scene::set(main_scene);
 
-        std::shared_ptr<Renderer> renderer = std::make_shared<Renderer>(device, window, devmem, swapchain);
-
-        std::unique_ptr<ModelLoader> model_loader = std::make_unique<ModelLoader>(device, devmem, renderer);
-
-        std::unique_ptr<Model> chalet_model = model_loader->load_model("models/chalet.obj");
-        chalet_model->set_position(glm::vec3(0, 0, 0));
-        main_scene->add_model(std::move(chalet_model));
+        std::shared_ptr<ThreadPool> thread_pool = std::make_shared<ThreadPool>();
+        std::shared_ptr<Renderer> renderer = std::make_shared<Renderer>(device, window, devmem, swapchain, thread_pool);
+        main_scene->set_renderer(renderer);
+
+        std::unique_ptr<ModelLoader> model_loader = std::make_unique<ModelLoader>(device, devmem, renderer, thread_pool);
+
+        std::vector<std::string> model_paths = {
+            "models/chalet.obj",
+            "models/plane.obj", "models/plane.obj", "models/plane.obj",
+            "models/plane.obj", "models/plane.obj", "models/plane.obj",
+            "models/plane.obj", "models/plane.obj", "models/plane.obj",
+        };
+        std::vector<glm::vec3> model_positions = {
+            glm::vec3(0, 0, 0),
+            glm::vec3(-5, 0, 0), glm::vec3(0, 0, 0), glm::vec3(5, 0, 0),
+            glm::vec3(-5, 0, 5), glm::vec3(0, 0, 5), glm::vec3(5, 0, 5),
+            glm::vec3(-5, 0, -5), glm::vec3(0, 0, -5), glm::vec3(5, 0, -5),
+        };
+
+        /* Parsed in parallel, uploaded together */
+        std::vector<std::unique_ptr<Model>> models = model_loader->load_models(model_paths);
+
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            models[i]->set_position(model_positions[i]);
+            main_scene->add_model(std::move(models[i]));
+        }
 
  /*       std::unique_ptr<Model> sphere_model1 = model_loader->load_model("models/sphere.obj");
         sphere_model1->set_position(glm::vec3({ 1, 0, 0 }));
         std::unique_ptr<Model> sphere_model2 = model_loader->load_model("models/sphere.obj");
-        sphere_model2->set_position(glm::vec3({ -1, 1, 0 })); */
-
-        std::unique_ptr<Model> plane_model1 = model_loader->load_model("models/plane.obj");
-        plane_model1->set_position(glm::vec3({ -5, 0, 0 }));
-        std::unique_ptr<Model> plane_model2 = model_loader->load_model("models/plane.obj");
-        plane_model2->set_position(glm::vec3({ 0, 0, 0 }));
-        std::unique_ptr<Model> plane_model3 = model_loader->load_model("models/plane.obj");
-        plane_model3->set_position(glm::vec3({ 5, 0, 0 }));
-        std::unique_ptr<Model> plane_model4 = model_loader->load_model("models/plane.obj");
-        plane_model4->set_position(glm::vec3({ -5, 0, 5 }));
-        std::unique_ptr<Model> plane_model5 = model_loader->load_model("models/plane.obj");
-        plane_model5->set_position(glm::vec3({ 0, 0, 5 }));
-        std::unique_ptr<Model> plane_model6 = model_loader->load_model("models/plane.obj");
-        plane_model6->set_position(glm::vec3({ 5, 0, 5 }));
-        std::unique_ptr<Model> plane_model7 = model_loader->load_model("models/plane.obj");
-        plane_model7->set_position(glm::vec3({ -5, 0, -5 }));
-        std::unique_ptr<Model> plane_model8 = model_loader->load_model("models/plane.obj");
-        plane_model8->set_position(glm::vec3({ 0, 0, -5 }));
-        std::unique_ptr<Model> plane_model9 = model_loader->load_model("models/plane.obj");
-        plane_model9->set_position(glm::vec3({ 5, 0, -5 }));
-
-        /* main_scene->add_model(std::move(sphere_model1));
+        sphere_model2->set_position(glm::vec3({ -1, 1, 0 }));
+        main_scene->add_model(std::move(sphere_model1));
         main_scene->add_model(std::move(sphere_model2));*/
-        main_scene->add_model(std::move(plane_model1));
-        main_scene->add_model(std::move(plane_model2));
-        main_scene->add_model(std::move(plane_model3));
-        main_scene->add_model(std::move(plane_model4));
-        main_scene->add_model(std::move(plane_model5));
-        main_scene->add_model(std::move(plane_model6));
-        main_scene->add_model(std::move(plane_model7));
-        main_scene->add_model(std::move(plane_model8));
-        main_scene->add_model(std::move(plane_model9));
+
+        main_scene->set_lod_target((float) swapchain->get_extent().height, 1.0f);
 
         std::vector<vk::Semaphore> acquire_semaphores;
         std::vector<vk::Semaphore> release_semaphores;
         std::vector<std::unique_ptr<GraphicsFence>> render_fences;
 
-		// Record command buffers
 		for (uint32_t i = 0; i < swapchain->get_image_count(); i++)
 		{
             acquire_semaphores.push_back(device->create_semaphore());
             release_semaphores.push_back(device->create_semaphore());
             render_fences.emplace_back(std::make_unique<GraphicsFence>(device));
-
-			vk::CommandBuffer cmd = command_buffers[i];
-			cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eSimultaneousUse, nullptr));
-
-            // Main render loop
-			renderer->begin_renderpass(cmd, i);
-			{
-                main_scene->render_models(cmd, i);
-
-				renderer->next_subpass(cmd);
-
-				renderer->render_final_image(cmd, i);
-			}
-			renderer->end_renderpass(cmd);
-
-			cmd.end();
 		}
 
 		LOG_INFO("Setup vulkan application");
@@ -171,6 +154,21 @@ int main(int argc, char *argv[])
                 window->close();
             }
 
+            // Swap in textures decoded and pipelines compiled since the last frame
+            uint32_t texture_uploads = model_loader->process_texture_uploads();
+            uint32_t compiled_pipelines = renderer->get_renderpass()->process_compiled_pipelines();
+
+            if (texture_uploads > 0)
+            {
+                main_scene->refresh_materials();
+            }
+
+            // A compiled pipeline is picked up at bind time, each image just records again after its fence wait
+            if (compiled_pipelines > 0)
+            {
+                main_scene->invalidate_recording();
+            }
+
 			uint32_t image = swapchain->aquire_image(device->device, acquire_semaphores[0]);
 
             if (render_fences[image]->get_status() != GraphicsFenceStatus::Reset)
@@ -179,6 +177,34 @@ int main(int argc, char *argv[])
                 render_fences[image]->reset();
             }
 
+            // The image's last frame is done, so are its transient descriptor sets
+            device->descriptor_allocator->reset_frame(image);
+
+            // Nor is anything reading its material descriptors, rewrite the stale ones
+            main_scene->update_frame(image);
+
+            // Nor is anything reading its copy of the uniforms, bring it up to date
+            devmem->get_uniform_ring()->begin_frame(image);
+
+            // Resources retired before the oldest frame still in flight can go
+            device->retire_queue->begin_frame(image);
+
+            // Record command buffers, model lods can change every frame
+			vk::CommandBuffer cmd = command_buffers[image];
+			cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit, nullptr));
+
+			renderer->begin_renderpass(cmd, image);
+			{
+                main_scene->render_models(cmd, image);
+
+				renderer->next_subpass(cmd);
+
+				renderer->render_final_image(cmd, image);
+			}
+			renderer->end_renderpass(cmd);
+
+			cmd.end();
+
 			device->graphics_queue->submit_commands(
 				{ command_buffers[image] },
 				acquire_semaphores[0], release_semaphores[image],
@@ -199,6 +225,8 @@ int main(int argc, char *argv[])
         }
 	}
 
+	unmount_asset_pack();
+
 	LOG_INFO("Destroyed vulkan application");
 
 	while (true);
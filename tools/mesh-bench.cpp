@@ -0,0 +1,105 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "r_mesh.h"
+#include "r_mesh_optimizer.h"
+
+/*
+ * Reports post-transform cache efficiency of each mesh before and after
+ * every stage of the mesh optimizer. Run from the build directory, model
+ * names are relative to the resources folder.
+ */
+
+static const char *default_models[] = {
+    "models/chalet.obj",
+    "models/cone.obj",
+    "models/plane.obj",
+    "models/sphere.obj",
+};
+
+static void print_stats(const char *stage, const MeshData& mesh)
+{
+    MeshCacheStats stats = analyze_vertex_cache(mesh.indicies.data(), mesh.indicies.size(), mesh.verticies.size());
+    printf("    %-12s ACMR %6.3f  ATVR %6.3f\n", stage, stats.acmr, stats.atvr);
+}
+
+static void bench_model(const std::string& name)
+{
+    MeshData mesh;
+
+    try
+    {
+        mesh = load_obj_mesh(name);
+    }
+    catch (std::exception& e)
+    {
+        printf("%s: %s\n", name.c_str(), e.what());
+        return;
+    }
+
+    printf("%s: %zu verticies, %zu triangles, %zu submeshes\n", name.c_str(), mesh.verticies.size(), mesh.indicies.size() / 3, mesh.submeshes.size());
+    print_stats("source", mesh);
+
+    std::vector<uint32_t> clusters;
+    std::vector<std::vector<uint32_t>> submesh_clusters;
+
+    for (const auto & submesh : mesh.submeshes)
+    {
+        optimize_vertex_cache(mesh.indicies.data() + submesh.start_index, submesh.index_count, mesh.verticies.size(), &clusters);
+        submesh_clusters.push_back(clusters);
+    }
+    print_stats("vertex cache", mesh);
+
+    for (size_t i = 0; i < mesh.submeshes.size(); i++)
+    {
+        const auto & submesh = mesh.submeshes[i];
+        optimize_overdraw(mesh.indicies.data() + submesh.start_index, submesh.index_count, mesh.verticies.data(), submesh_clusters[i]);
+    }
+    print_stats("overdraw", mesh);
+
+    optimize_vertex_fetch(&mesh);
+    print_stats("fetch", mesh);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            bench_model(argv[i]);
+        }
+    }
+    else
+    {
+        for (const char *name : default_models)
+        {
+            bench_model(name);
+        }
+    }
+
+    return 0;
+}
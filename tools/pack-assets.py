@@ -0,0 +1,179 @@
+#! /usr/bin/python
+
+import argparse
+import os
+import struct
+
+#
+# Asset pack layout, must match include/utils/u_asset_pack.h. All values are
+# little endian and every entry's data is aligned to ALIGNMENT bytes.
+#
+#   AssetPackHeader
+#   entry data
+#   AssetPackEntry[entry_count], sorted by name hash
+#   char[] name string table
+#
+MAGIC = 0x4b415056 # VPAK
+VERSION = 1
+ALIGNMENT = 16
+
+HEADER = struct.Struct('<IIIIQQQ')
+ENTRY = struct.Struct('<QQQQqIIII')
+
+COMPRESSION_NONE = 0
+COMPRESSION_LZ4 = 1
+
+# Already compressed, not worth running through lz4
+STORED_EXTENSIONS = ('.jpg', '.jpeg', '.png', '.pak')
+
+FNV_OFFSET = 0xcbf29ce484222325
+FNV_PRIME = 0x100000001b3
+
+def hash_name(name):
+    h = FNV_OFFSET
+    for c in name.encode('utf-8'):
+        h = ((h ^ c) * FNV_PRIME) & 0xffffffffffffffff
+    return h
+
+def normalize_name(name):
+    name = name.replace('\\', '/')
+    while name.startswith('./'):
+        name = name[2:]
+    return name
+
+def lz4_length(length):
+    out = bytearray()
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+    return out
+
+def lz4_compress(src):
+    '''
+    Greedy lz4 block compressor, a single hash table entry per 4 byte
+    sequence. The format requires the last 5 bytes to be literals and the
+    last match to start at least 12 bytes before the end.
+    '''
+    n = len(src)
+    out = bytearray()
+    table = {}
+    anchor = 0
+    i = 0
+    match_limit = n - 12
+
+    while i < match_limit:
+        key = src[i:i + 4]
+        candidate = table.get(key, -1)
+        table[key] = i
+
+        if candidate < 0 or i - candidate > 0xffff:
+            i += 1
+            continue
+
+        length = 4
+        while i + length < n - 5 and src[candidate + length] == src[i + length]:
+            length += 1
+
+        literals = i - anchor
+        token = (min(literals, 15) << 4) | min(length - 4, 15)
+        out.append(token)
+        if literals >= 15:
+            out += lz4_length(literals - 15)
+        out += src[anchor:i]
+        out += struct.pack('<H', i - candidate)
+        if length - 4 >= 15:
+            out += lz4_length(length - 4 - 15)
+
+        i += length
+        anchor = i
+
+    literals = n - anchor
+    out.append(min(literals, 15) << 4)
+    if literals >= 15:
+        out += lz4_length(literals - 15)
+    out += src[anchor:]
+
+    return bytes(out)
+
+def align(offset):
+    return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1)
+
+def pack(args):
+    data = bytearray(HEADER.size)
+    entries = []
+    strings = bytearray()
+    stored_size = 0
+    source_size = 0
+
+    for name in args.assets:
+        name = normalize_name(name)
+        path = os.path.join(args.root, name)
+
+        with open(path, 'rb') as src:
+            contents = src.read()
+
+        compression = COMPRESSION_NONE
+        stored = contents
+
+        # Only keep compressed data when it saves at least an eighth
+        if args.compress and not name.lower().endswith(STORED_EXTENSIONS) and len(contents) > 64:
+            compressed = lz4_compress(contents)
+            if len(compressed) <= len(contents) - len(contents) // 8:
+                compression = COMPRESSION_LZ4
+                stored = compressed
+
+        data += b'\0' * (align(len(data)) - len(data))
+        offset = len(data)
+        data += stored
+
+        name_bytes = name.encode('utf-8')
+        entries.append((hash_name(name), offset, len(stored), len(contents), int(os.stat(path).st_mtime), len(strings), len(name_bytes), compression, 0))
+        strings += name_bytes
+
+        stored_size += len(stored)
+        source_size += len(contents)
+
+    hashes = [entry[0] for entry in entries]
+    if len(set(hashes)) != len(hashes):
+        raise RuntimeError('asset name hash collision')
+
+    entries.sort(key=lambda entry: entry[0])
+
+    data += b'\0' * (align(len(data)) - len(data))
+    toc_offset = len(data)
+    for entry in entries:
+        data += ENTRY.pack(*entry)
+
+    string_table_offset = len(data)
+    data += strings
+
+    data[0:HEADER.size] = HEADER.pack(MAGIC, VERSION, len(entries), 0, toc_offset, string_table_offset, len(strings))
+
+    # Write next to the destination and move it over, the game may have it mapped
+    temp = args.output + '.tmp'
+    with open(temp, 'wb') as dst:
+        dst.write(data)
+    os.replace(temp, args.output)
+
+    return len(entries), source_size, stored_size
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description='Pack assets into a single archive')
+    parser.add_argument('output',
+                        help='The pack file to write');
+    parser.add_argument('root',
+                        help='The directory asset names are relative to');
+    parser.add_argument('assets', nargs='+',
+                        help='The asset names to pack');
+    parser.add_argument('--compress', action='store_true',
+                        help='Compress entries with lz4 where it helps');
+    return parser.parse_args()
+
+def main():
+    args = parse_arguments()
+    count, source_size, stored_size = pack(args)
+    print("Packed {count} assets into {output} ({source} -> {stored} bytes)".format(count=count, output=args.output, source=source_size, stored=stored_size))
+
+if __name__ == "__main__":
+    main()
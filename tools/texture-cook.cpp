@@ -0,0 +1,159 @@
+/******************************************************************************
+* Copyright 2017 James Fitzpatrick <james_fitzpatrick@outlook.com>           *
+*                                                                            *
+* Permission is hereby granted, free of charge, to any person obtaining a    *
+* copy of this software and associated documentation files (the "Software"), *
+* to deal in the Software without restriction, including without limitation  *
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+* and/or sell copies of the Software, and to permit persons to whom the      *
+* Software is furnished to do so, subject to the following conditions:       *
+*                                                                            *
+* The above copyright notice and this permission notice shall be included in *
+* all copies or substantial portions of the Software.                        *
+*                                                                            *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        *
+* DEALINGS IN THE SOFTWARE.                                                  *
+******************************************************************************/
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <iterator>
+#include <vector>
+
+#include "stb_image.h"
+
+#include "r_texture_codec.h"
+#include "r_texture_file.h"
+#include "u_io.h"
+
+/*
+ * Compress textures into block compressed DDS files the image loader picks
+ * up in place of the source, written beside it as <name>.dds. Run from the
+ * build directory, texture names are relative to the resources folder.
+ *
+ *   TextureCook [--bc1|--bc3|--bc5] texture...
+ *
+ * Without a format BC1 is used for opaque textures and BC3 otherwise, BC5
+ * is meant for two channel normal maps.
+ */
+
+static const char *default_textures[] = {
+    "textures/chalet.jpg",
+};
+
+static bool has_alpha(const uint8_t *pixels, size_t pixel_count)
+{
+    for (size_t i = 0; i < pixel_count; i++)
+    {
+        if (pixels[i * 4 + 3] != 255)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool cook_texture(const std::string& name, vk::Format format)
+{
+    std::string path = FILENAME_TO_PATH(name);
+
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels)
+    {
+        printf("%s: %s\n", name.c_str(), stbi_failure_reason());
+        return false;
+    }
+
+    if (format == vk::Format::eUndefined)
+    {
+        format = has_alpha(pixels, (size_t) width * height) ? vk::Format::eBc3UnormBlock : vk::Format::eBc1RgbaUnormBlock;
+    }
+
+    uint32_t level_width = (uint32_t) width;
+    uint32_t level_height = (uint32_t) height;
+    uint32_t mip_count = get_texture_mip_count(level_width, level_height);
+
+    std::vector<uint8_t> level(pixels, pixels + (size_t) width * height * 4);
+    std::vector<std::vector<uint8_t>> levels;
+    size_t source_size = 0;
+    size_t cooked_size = 0;
+
+    stbi_image_free(pixels);
+
+    for (uint32_t i = 0; i < mip_count; i++)
+    {
+        levels.push_back(compress_texture(format, level.data(), level_width, level_height));
+        source_size += level.size();
+        cooked_size += levels.back().size();
+
+        if (i + 1 < mip_count)
+        {
+            std::vector<uint8_t> next((size_t) std::max(level_width / 2, 1u) * std::max(level_height / 2, 1u) * 4);
+            downsample_rgba8(level.data(), level_width, level_height, next.data());
+
+            level.swap(next);
+            level_width = std::max(level_width / 2, 1u);
+            level_height = std::max(level_height / 2, 1u);
+        }
+    }
+
+    std::string cooked_name = name + TEXTURE_FILE_EXTENSION;
+    if (!TextureFile::write(cooked_name, format, (uint32_t) width, (uint32_t) height, levels))
+    {
+        printf("%s: failed to write %s\n", name.c_str(), cooked_name.c_str());
+        return false;
+    }
+
+    printf("%s: %dx%d, %u levels, %zu -> %zu bytes (%.1fx)\n",
+        cooked_name.c_str(), width, height, mip_count, source_size, cooked_size, (double) source_size / cooked_size);
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    vk::Format format = vk::Format::eUndefined;
+    std::vector<std::string> textures;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bc1") == 0)
+        {
+            format = vk::Format::eBc1RgbaUnormBlock;
+        }
+        else if (strcmp(argv[i], "--bc3") == 0)
+        {
+            format = vk::Format::eBc3UnormBlock;
+        }
+        else if (strcmp(argv[i], "--bc5") == 0)
+        {
+            format = vk::Format::eBc5UnormBlock;
+        }
+        else
+        {
+            textures.push_back(argv[i]);
+        }
+    }
+
+    if (textures.empty())
+    {
+        textures.assign(std::begin(default_textures), std::end(default_textures));
+    }
+
+    bool success = true;
+
+    for (const auto & texture : textures)
+    {
+        success &= cook_texture(texture, format);
+    }
+
+    return success ? 0 : 1;
+}